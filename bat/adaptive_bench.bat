@@ -0,0 +1 @@
+exe\app.exe adaptive_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --leaf 10 --adapt 4 --queries 10000
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe anytime_bench --in data\uniform_3d_e5.txt --dim 3 --k 10 --queries 10000
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe cache_bench --in data\uniform_3d_e5.txt --dim 3 --k 10 --locations 2000 --memory 1024
\ No newline at end of file
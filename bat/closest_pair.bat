@@ -0,0 +1 @@
+exe\app.exe closest_pair --in data\clusters_2d_e5.txt --in2 data\uniform_2d_e5.txt --dim 2 --k 10
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe coord_bench --in data\s1.txt --dim 2 --k 10 --leaf 10 --queries 100000
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe cursor_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --step 0.001
\ No newline at end of file
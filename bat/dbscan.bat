@@ -0,0 +1 @@
+exe\app.exe dbscan --in data\s1.txt --dim 2 --leaf 10 --radius 20000 --min 10
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe dbscan --dim 2 --leaf 10 --min 10 --scale 10000000
\ No newline at end of file
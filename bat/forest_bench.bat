@@ -0,0 +1 @@
+exe\app.exe forest_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --leaf 10 --buffer 128 --queries 100000
\ No newline at end of file
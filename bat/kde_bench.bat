@@ -0,0 +1 @@
+exe\app.exe kde_bench --in data\clusters_2d_e5.txt --dim 2 --leaf 10 --bandwidth 0.01 --error 0.01 --queries 1000
\ No newline at end of file
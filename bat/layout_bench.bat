@@ -0,0 +1 @@
+exe\app.exe layout_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --eps 0 --leaf 10 --queries 100000 --block 4096
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe lazy_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --leaf 10 --expand 16 --queries 500
\ No newline at end of file
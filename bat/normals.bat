@@ -0,0 +1 @@
+exe\app.exe normals --in data\clusters_3d_e5.txt --k 10 --leaf 10
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe rebuild_bench --in data\clusters_3d_e5.txt --dim 3 --k 10 --leaf 10 --threads 4 --rebuilds 10
\ No newline at end of file
@@ -0,0 +1 @@
+exe\app.exe rknn --in data\clusters_2d_e5.txt --dim 2 --k 10 --queries 1000
\ No newline at end of file
@@ -0,0 +1,101 @@
+#ifndef AKNN_AGGREGATE_H
+#define AKNN_AGGREGATE_H
+
+#include <vector>
+
+#include "search.h"
+
+//! Majority vote of labels of the neighbors, label(const ObjData&) returns integer label of the point object.
+//! Ties are resolved in favor of the label of the closer neighbor. Nothing is allocated, the votes are counted in O(k^2) for small k.
+template<typename LabelFuncT>
+struct MajorityVote
+{
+    LabelFuncT label;
+
+    explicit MajorityVote(LabelFuncT label) : label(label) {}
+
+    template<typename FloatT, int Dim, typename ObjData>
+    auto operator()(const DistObj<FloatT, Dim, ObjData>* beg, const DistObj<FloatT, Dim, ObjData>* end) const
+    {
+        decltype(label(beg->obj.data)) bestLabel{};
+        int bestVotes = 0;
+        DistT<FloatT> bestDist = GetMaxValue<DistT<FloatT>>();
+        for (const DistObj<FloatT, Dim, ObjData>* it = beg; it != end; ++it) {
+            auto itLabel = label(it->obj.data);
+            int votes = 0;
+            for (const DistObj<FloatT, Dim, ObjData>* other = beg; other != end; ++other)
+                votes += label(other->obj.data) == itLabel;
+            if (votes > bestVotes || (votes == bestVotes && it->dist < bestDist)) {
+                bestLabel = itLabel;
+                bestVotes = votes;
+                bestDist = it->dist;
+            }
+        }
+        return bestLabel;
+    }
+};
+
+//! Average of value(const ObjData&) of the neighbors weighted by inverse of their distance. The distances are reduced distances
+//! of the search metric, so the weights are inverse squared distances for the default L2Metric. When some neighbors coincide
+//! with the query point, their plain average is returned. Returns 0 when no neighbor was found.
+template<typename ValueFuncT>
+struct InverseDistanceWeightedAverage
+{
+    ValueFuncT value;
+
+    explicit InverseDistanceWeightedAverage(ValueFuncT value) : value(value) {}
+
+    template<typename FloatT, int Dim, typename ObjData>
+    double operator()(const DistObj<FloatT, Dim, ObjData>* beg, const DistObj<FloatT, Dim, ObjData>* end) const
+    {
+        double weightedSum = 0;
+        double weightSum = 0;
+        double zeroSum = 0;
+        int zeroCount = 0;
+        for (const DistObj<FloatT, Dim, ObjData>* it = beg; it != end; ++it) {
+            double itValue = value(it->obj.data);
+            if (it->dist <= 0) {
+                zeroSum += itValue;
+                ++zeroCount;
+            } else {
+                weightedSum += itValue / it->dist;
+                weightSum += 1.0 / it->dist;
+            }
+        }
+        if (zeroCount != 0)
+            return zeroSum / zeroCount;
+        return weightSum != 0 ? weightedSum / weightSum : 0;
+    }
+};
+
+//! Finds k aproximate nearest neighbors and returns reducer(const DistObj* beg, const DistObj* end) of the found neighbors (in no particular order).
+//! The reducer runs directly over the queue of the search, so the neighbors aren't copied into result vector (see MajorityVote, InverseDistanceWeightedAverage).
+template<typename FloatT, int Dim, typename ObjData = Empty, typename ReducerT, typename MetricT = L2Metric>
+auto AggregateKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue,
+                                          const ReducerT& reducer, const MetricT& metric = MetricT())
+{
+    aknnQueue.Init(k, DistObjCompare<FloatT, Dim, ObjData>());
+    TraversalStats<FloatT, Dim> dummyStats;
+    SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, queryPoint, epsilon, aknnQueue, dummyStats, metric);
+    return reducer(aknnQueue.GetData(), aknnQueue.GetData() + aknnQueue.GetSize());
+}
+//! Finds k nearest neighbors and returns reducer(const DistObj* beg, const DistObj* end) of the found neighbors
+template<typename FloatT, int Dim, typename ObjData = Empty, typename ReducerT, typename MetricT = L2Metric>
+auto AggregateKNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue,
+                                const ReducerT& reducer, const MetricT& metric = MetricT())
+{
+    return AggregateKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, queryPoint, k, 0, knnQueue, reducer, metric);
+}
+
+//! Aggregates k aproximate nearest neighbors of each query point, result[i] is the reducer result for queryPoints[i].
+//! The queue and result buffer are reused between the queries, so only the growth of the result buffer allocates.
+template<typename FloatT, int Dim, typename ObjData = Empty, typename ReducerT, typename ResultT, typename MetricT = L2Metric>
+void AggregateKAproximateNearestNeighborsBatch(const BBDTree<FloatT, Dim, ObjData>& tree, const std::vector<Vec<FloatT, Dim>>& queryPoints, int k, EpsilonT<FloatT> epsilon,
+                                               FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, const ReducerT& reducer, std::vector<ResultT>& result, const MetricT& metric = MetricT())
+{
+    result.resize(queryPoints.size());
+    for (size_t i = 0; i < queryPoints.size(); ++i)
+        result[i] = AggregateKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, queryPoints[i], k, epsilon, aknnQueue, reducer, metric);
+}
+
+#endif // AKNN_AGGREGATE_H
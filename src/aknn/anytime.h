@@ -0,0 +1,117 @@
+#ifndef AKNN_ANYTIME_H
+#define AKNN_ANYTIME_H
+
+#include <chrono>
+#include <limits>
+#include <vector>
+
+#include "search.h"
+
+//! Limits of work of anytime kNN search, zero means no limit. The limits are hard, a leaf which would exceed them isn't scanned.
+struct SearchBudget
+{
+    //! maximum number of scanned leafs
+    int maxLeafs = 0;
+    //! maximum number of distance computations of point objects (quantized points count once for their lower bound)
+    int64_t maxDistComputations = 0;
+    //! deadline in nanoseconds since the start of the search, the clock is read at each leaf and every 16 traversal steps
+    int64_t maxNanoseconds = 0;
+};
+
+//! Outcome of anytime kNN search
+struct AnytimeSearchResult
+{
+    //! True if the search finished within the budget, then the neighbors are within the requested epsilon
+    bool isComplete = true;
+    //! Ratio of the k-th found distance to the distance of the nearest unvisited node (reduced distances, squared for L2Metric), at least 1.
+    //! Distance of each found i-th neighbor is at most errorBound times the exact i-th neighbor distance. Infinity when less than k neighbors were found.
+    double errorBound = 1;
+    int visitedLeafs = 0;
+    int64_t distComputations = 0;
+    int64_t nanoseconds = 0;
+};
+
+//! Budget policy of the kNN searches (see UnlimitedBudget) which counts the work of the search into result and stops it when SearchBudget runs out
+class SearchBudgetTracker
+{
+public:
+    SearchBudgetTracker(const SearchBudget& budget, AnytimeSearchResult& result)
+        : _budget(budget), _result(result), _start(std::chrono::steady_clock::now()) {}
+
+    template<typename TreeT, typename DistNodeT>
+    bool IsVisitAllowed(const TreeT& tree, const DistNodeT& distNode) const
+    {
+        const Node* node = tree.GetNode(distNode.nodeIdx);
+        bool isLeaf = node->GetType() == NodeType::LEAF;
+        if (_budget.maxNanoseconds != 0 && (isLeaf || ++_steps % 16 == 0) && GetNanoseconds() >= _budget.maxNanoseconds) {
+            _result.isComplete = false;
+            return false;
+        }
+        if (isLeaf) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            int64_t leafSize = leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex();
+            if ((_budget.maxLeafs != 0 && _result.visitedLeafs >= _budget.maxLeafs) ||
+                (_budget.maxDistComputations != 0 && _result.distComputations + leafSize > _budget.maxDistComputations)) {
+                _result.isComplete = false;
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void OnLeafVisited(const LeafNode* leafNode) const
+    {
+        ++_result.visitedLeafs;
+        _result.distComputations += leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex();
+    }
+
+    //! Nanoseconds since construction of the tracker
+    int64_t GetNanoseconds() const
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+private:
+    const SearchBudget& _budget;
+    AnytimeSearchResult& _result;
+    std::chrono::steady_clock::time_point _start;
+    mutable int _steps = 0;
+};
+
+//! Searches BBD tree for k aproximate nearest neighbors and pushes them into already initialized aknnQueue, stops when the budget runs out.
+//! It's SearchKAproximateNearestNeighbors with SearchBudgetTracker, so the best neighbors found so far are returned together with
+//! the achieved error bound and search with unlimited budget gives the same result as SearchKAproximateNearestNeighbors.
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false, typename MetricT = L2Metric>
+AnytimeSearchResult SearchKAproximateNearestNeighborsAnytime(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon, const SearchBudget& budget,
+                                                             FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats, const MetricT& metric = MetricT())
+{
+    AnytimeSearchResult result;
+    SearchBudgetTracker tracker(budget, result);
+    if (tree.GetObjCount() == 0)
+        return result;
+    // distance of the nearest node, which wasn't visited
+    DistT<FloatT> unvisitedDist = SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, aknnQueue, stats, metric, GetMaxValue<DistT<FloatT>>(),
+                                                                                                         AcceptAllFilter(), tracker);
+
+    // the exact i-th neighbor is either visited (then it's not closer than the found i-th one) or not closer than the unvisited node
+    if (!aknnQueue.IsFull())
+        result.errorBound = result.isComplete ? 1 : std::numeric_limits<double>::infinity();
+    else if (aknnQueue.GetLast().dist > unvisitedDist)
+        result.errorBound = unvisitedDist > 0 ? (double)aknnQueue.GetLast().dist / (double)unvisitedDist : std::numeric_limits<double>::infinity();
+    result.nanoseconds = tracker.GetNanoseconds();
+    return result;
+}
+
+//! Finds k aproximate nearest neighbors using BBD tree within the budget, result describes completeness and achieved error bound of the search
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsAnytime(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon,
+                                                                                    const SearchBudget& budget, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, AnytimeSearchResult& result,
+                                                                                    const MetricT& metric = MetricT())
+{
+    TraversalStats<FloatT, Dim> dummyStats;
+    aknnQueue.Init(k, DistObjCompare<FloatT, Dim, ObjData>());
+    result = SearchKAproximateNearestNeighborsAnytime<FloatT, Dim, ObjData, false>(tree, queryPoint, epsilon, budget, aknnQueue, dummyStats, metric);
+    return DistObjsToPointObjs(aknnQueue.GetValues());
+}
+
+#endif // AKNN_ANYTIME_H
@@ -0,0 +1,110 @@
+#ifndef AKNN_BBD_FOREST_H
+#define AKNN_BBD_FOREST_H
+
+#include <vector>
+#include <algorithm>
+
+#include "vec.h"
+#include "bbd_tree.h"
+#include "search.h"
+
+//! Dynamic index supporting insertions, made of static BBD trees of geometrically growing sizes (Bentley-Saxe logarithmic method).
+//! New points are collected in a small buffer. When the buffer is full, it is merged with all the smallest trees into one new tree,
+//! the same way as carry propagates when incrementing binary counter. Tree at slot i has bufferSize * 2^i points,
+//! so there are at most log2(n / bufferSize) + 1 trees and each point is rebuilt O(log n) times (amortized O(log^2 n) per insert).
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class BBDForest
+{
+public:
+    using PointObjT = PointObj<FloatT, Dim, ObjData>;
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    //! Initialize empty forest, leafMaxSize is used for building the trees
+    BBDForest(int leafMaxSize = 10, int bufferSize = 128) : _leafMaxSize(leafMaxSize), _bufferSize(std::max(1, bufferSize)) {}
+
+    //! Inserts point object
+    void Insert(const PointObjT& obj)
+    {
+        _buffer.push_back(obj);
+        ++_objCount;
+        if ((int)_buffer.size() >= _bufferSize)
+            MergeBuffer();
+    }
+
+    //! Gets number of point objects inside the forest
+    index_t GetObjCount() const { return _objCount; }
+    //! Gets slots of trees, empty slots contain trees without objects
+    const std::vector<BBDTreeT>& GetTrees() const { return _trees; }
+    //! Gets number of non empty trees
+    int GetTreeCount() const {
+        return (int)std::count_if(_trees.begin(), _trees.end(), [](const BBDTreeT& tree) { return tree.GetObjCount() > 0; });
+    }
+    //! Gets point objects which aren't inside any tree yet
+    const std::vector<PointObjT>& GetBuffer() const { return _buffer; }
+
+private:
+    //! Trees with bufferSize * 2^i points at slot i, or empty trees
+    std::vector<BBDTreeT> _trees;
+    //! Recently inserted point objects
+    std::vector<PointObjT> _buffer;
+    //! Max leaf size of the trees
+    int _leafMaxSize;
+    //! Size of the buffer
+    int _bufferSize;
+    //! Number of all point objects
+    index_t _objCount = 0;
+
+    //! Merges buffer with the smallest trees into first empty slot
+    void MergeBuffer()
+    {
+        std::vector<PointObjT> objs = std::move(_buffer);
+        _buffer.clear();
+        size_t slot = 0;
+        for (; slot < _trees.size() && _trees[slot].GetObjCount() > 0; ++slot) {
+            const BBDTreeT& tree = _trees[slot];
+            objs.insert(objs.end(), tree.GetObj(0), tree.GetObj(0) + tree.GetObjCount());
+            _trees[slot] = BBDTreeT();
+        }
+        if (slot == _trees.size())
+            _trees.emplace_back();
+        _trees[slot] = BBDTreeT::BuildMidpointSplitTree(_leafMaxSize, objs);
+    }
+};
+
+//! Finds k aproximate nearest neighbors using BBD forest. All trees are searched with shared k-th distance bound, starting with trees closest to the query point.
+//! Metric is distance policy (see metric.h).
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const BBDForest<FloatT, Dim, ObjData>& forest, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue,
+                                                                            const MetricT& metric = MetricT())
+{
+    DistObjCompare<FloatT, Dim, ObjData> distObjCompare;
+    aknnQueue.Init(k, distObjCompare);
+    for (const PointObj<FloatT, Dim, ObjData>& obj : forest.GetBuffer()) {
+        aknnQueue.Push(DistObj<FloatT, Dim, ObjData>({queryPoint.Distance(obj.point, metric), obj}));
+    }
+
+    std::vector<std::pair<DistT<FloatT>, const BBDTree<FloatT, Dim, ObjData>*>> trees;
+    for (const BBDTree<FloatT, Dim, ObjData>& tree : forest.GetTrees()) {
+        if (tree.GetObjCount() > 0)
+            trees.push_back({tree.GetBBox().Distance(queryPoint, metric), &tree});
+    }
+    std::sort(trees.begin(), trees.end(), [](const auto& t1, const auto& t2) { return t1.first < t2.first; });
+
+    TraversalStats<FloatT, Dim> dummyStats;
+    EpsilonT<FloatT> relaxFactor = metric.RelaxFactor(epsilon);
+    for (const auto& [treeDist, tree] : trees) {
+        if (aknnQueue.IsFull() && treeDist > aknnQueue.GetLast().dist / relaxFactor)
+            break;
+        SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData, false>(*tree, queryPoint, epsilon, aknnQueue, dummyStats, metric);
+    }
+    return DistObjsToPointObjs(aknnQueue.GetValues());
+}
+//! Finds k nearest neighbors using BBD forest
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighbors(const BBDForest<FloatT, Dim, ObjData>& forest, const Vec<FloatT, Dim>& queryPoint, int k, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue,
+                                                                  const MetricT& metric = MetricT())
+{
+    return FindKAproximateNearestNeighbors<FloatT, Dim, ObjData>(forest, queryPoint, k, 0, knnQueue, metric);
+}
+
+#endif // AKNN_BBD_FOREST_H
@@ -2,6 +2,15 @@
 #define AKNN_BBD_TREE_H
 
 #include <vector>
+#include <queue>
+#include <algorithm>
+#include <unordered_set>
+#include <memory>
+#include <shared_mutex>
+#include <mutex>
+#include <new>
+#include <type_traits>
+#include <cassert>
 #include <stdint.h>
 
 #include "vec.h"
@@ -14,7 +23,9 @@ enum class NodeType
     //! Shrink inner node
     SHRINK,
     //! Leaf node
-    LEAF
+    LEAF,
+    //! Link to another node, stored in place of left child moved elsewhere by relayout
+    LINK
 };
 
 //! Index type for normal-sized datasets, up to 10^8
@@ -28,7 +39,7 @@ using index_t = uint32_t;
 #define NODE_TYPE_BITS 2
 #define DIM_BITS 2
 #define LEFT_CHILD_BITS 1
-#define RIGHT_CHILD_BITS (sizeof(index_t) - (LEFT_CHILD_BITS + DIM_BITS + NODE_TYPE_BITS))
+#define RIGHT_CHILD_BITS (8 * sizeof(index_t) - (LEFT_CHILD_BITS + DIM_BITS + NODE_TYPE_BITS))
 
 // Positions of sections inside the binary representation
 #define DIM_POS (NODE_TYPE_BITS)
@@ -40,11 +51,45 @@ using index_t = uint32_t;
 
 #define LOW_DIM_MASK ((1 << DIM_BITS) - 1)
 #define LOW_LEFT_CHILD_MASK ((1 << LEFT_CHILD_BITS) - 1)
-#define LOW_RIGHT_CHILD_MASK ((1 << RIGHT_CHILD_BITS) - 1)
+#define LOW_RIGHT_CHILD_MASK ((((index_t)1) << RIGHT_CHILD_BITS) - 1)
 
 #define DIM_MASK (((1 << DIM_BITS) - 1) << DIM_POS)
 #define LEFT_CHILD_MASK (((1 << LEFT_CHILD_BITS) - 1) << LEFT_CHILD_POS)
-#define RIGHT_CHILD_MASK (((1 << RIGHT_CHILD_BITS) - 1) << RIGHT_CHILD_POS)
+#define RIGHT_CHILD_MASK (((((index_t)1) << RIGHT_CHILD_BITS) - 1) << RIGHT_CHILD_POS)
+
+// Position and mask of the lazy flag of leaf nodes
+#define LAZY_LEAF_POS (8 * sizeof(index_t) - 1)
+#define LAZY_LEAF_MASK (((index_t)1) << LAZY_LEAF_POS)
+
+//! Size of the cache line in bytes, used for alignment of the nodes array
+#define CACHE_LINE_SIZE 64
+
+//! Allocator aligning arrays to specified power of 2 alignment, cache line size by default. Used for the nodes and points arrays,
+//! so that blocks created by relayout start at the boundaries of pages in memory. The alignment is moved and copied together with the array.
+template<typename T>
+struct AlignedAllocator
+{
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    //! Alignment in bytes
+    size_t alignment = CACHE_LINE_SIZE;
+
+    AlignedAllocator() = default;
+    explicit AlignedAllocator(size_t alignment) : alignment(alignment) {}
+    template<typename U>
+    AlignedAllocator(const AlignedAllocator<U>& other) : alignment(other.alignment) {}
+
+    T* allocate(size_t n) { return (T*)::operator new(n * sizeof(T), std::align_val_t(alignment)); }
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(alignment)); }
+
+    template<typename U>
+    bool operator==(const AlignedAllocator<U>& other) const { return alignment == other.alignment; }
+    template<typename U>
+    bool operator!=(const AlignedAllocator<U>& other) const { return alignment != other.alignment; }
+};
 
 //! Base class for all nodes inside the BBD tree
 class Node
@@ -63,7 +108,7 @@ public:
 
 //! Base class for all inner nodes of the BBD tree
 //! The _customData_nodeType variable now should always have the following format:
-//! (sizeof(index_t) - 5) bits - right child index | 1 bit - has left child | 2 bits - dimension (only split node) | 2 bits - NodeType
+//! (8 * sizeof(index_t) - 5) bits - right child index | 1 bit - has left child | 2 bits - dimension (only split node) | 2 bits - NodeType
 class InnerNode : public Node
 {
 public:
@@ -86,6 +131,10 @@ public:
     void SetRightChildIndex(index_t i) {
         _customData_nodeType = (_customData_nodeType & (~RIGHT_CHILD_MASK)) | (i << RIGHT_CHILD_POS);
     }
+    //! True if the node is shrink node with compact shrink box. The flag is stored in the lowest dimension bit, which is not used by shrink nodes otherwise.
+    bool IsCompactShrink() const {
+        return GetType() == NodeType::SHRINK && (bool)((_customData_nodeType >> DIM_POS) & 1);
+    }
 };
 
 //! Node representing split of current bounding box in half in some specified dimension.
@@ -124,8 +173,85 @@ public:
     const Box<FloatT, Dim>& GetShrinkBox() const { return _shrinkBox; }
 };
 
+// Number of bits used for subdivision level of one dimension inside compact shrink node
+#define COMPACT_LEVEL_BITS 4
+#define LOW_COMPACT_LEVEL_MASK ((1 << COMPACT_LEVEL_BITS) - 1)
+
+//! Shrink node with the shrink box encoded relative to the box of the node.
+//! Midpoint shrink box is always created by repeated halving of the box of the node, so for each dimension
+//! it is enough to store the number of halvings (subdivision level) and offset of the resulting cell, whose bits select the halves from the highest bit.
+//! Levels are stored in the lowest COMPACT_LEVEL_BITS * Dim bits of _cell, followed by the offsets.
+//! The exact shrink box is rebuilt during traversal by repeating the halvings.
+//! Size of the node is 8 or 16 bytes depending on the index_t (default 8 bytes).
+template<int Dim>
+class CompactShrinkNode : public InnerNode
+{
+private:
+    //! Subdivision levels and cell offsets
+    index_t _cell = 0;
+public:
+    //! Initialize with subdivision levels and cell offsets of each dimension, the encoding has to fit (see Encode)
+    CompactShrinkNode(const std::array<int, Dim>& levels, const std::array<index_t, Dim>& offsets) : InnerNode(NodeType::SHRINK) {
+        _customData_nodeType |= ((index_t)1) << DIM_POS;
+        int pos = 0;
+        for (int d = 0; d < Dim; ++d, pos += COMPACT_LEVEL_BITS)
+            _cell |= ((index_t)levels[d]) << pos;
+        for (int d = 0; d < Dim; pos += levels[d], ++d)
+            _cell |= offsets[d] << pos;
+    }
+
+    //! Gets the shrink box from the box of this node
+    template<typename FloatT>
+    Box<FloatT, Dim> GetShrinkBox(const Box<FloatT, Dim>& box) const {
+        Box<FloatT, Dim> shrinkBox = box;
+        int offsetPos = Dim * COMPACT_LEVEL_BITS;
+        for (int d = 0; d < Dim; ++d) {
+            int level = (int)((_cell >> (d * COMPACT_LEVEL_BITS)) & LOW_COMPACT_LEVEL_MASK);
+            for (int l = level - 1; l >= 0; --l) {
+                FloatT value = shrinkBox.GetSplitValue(d);
+                if ((_cell >> (offsetPos + l)) & 1)
+                    shrinkBox.min[d] = value;
+                else
+                    shrinkBox.max[d] = value;
+            }
+            offsetPos += level;
+        }
+        return shrinkBox;
+    }
+
+    //! Computes subdivision levels and cell offsets of the shrink box relative to the box of the node.
+    //! Returns false if the shrink box isn't result of halving or if the encoding doesn't fit into the node.
+    template<typename FloatT>
+    static bool Encode(const Box<FloatT, Dim>& box, const Box<FloatT, Dim>& shrinkBox, std::array<int, Dim>& levels, std::array<index_t, Dim>& offsets) {
+        int bits = Dim * COMPACT_LEVEL_BITS;
+        Box<FloatT, Dim> cell = box;
+        for (int d = 0; d < Dim; ++d) {
+            levels[d] = 0;
+            offsets[d] = 0;
+            while (cell.min[d] != shrinkBox.min[d] || cell.max[d] != shrinkBox.max[d]) {
+                if (levels[d] == LOW_COMPACT_LEVEL_MASK || bits == 8 * sizeof(index_t))
+                    return false;
+                FloatT value = cell.GetSplitValue(d);
+                if (shrinkBox.max[d] <= value) {
+                    cell.max[d] = value;
+                    offsets[d] = offsets[d] << 1;
+                } else if (shrinkBox.min[d] >= value) {
+                    cell.min[d] = value;
+                    offsets[d] = (offsets[d] << 1) | 1;
+                } else {
+                    return false;
+                }
+                ++levels[d];
+                ++bits;
+            }
+        }
+        return true;
+    }
+};
+
 //! Leaf node, referencing some range of objects. It stores begin and end indices to the array of objects.
-//! Begin index is stored inside upper (sizeof(index_t) - 2) bits of _customData_nodeType. End index is stored in new variable _objsEnd.
+//! Begin index is stored inside (sizeof(index_t) - 3) bits of _customData_nodeType below the highest bit, which marks lazy leafs.
+//! End index is stored in new variable _objsEnd.
 //! Size of the node is 8 or 16 bytes depending on the index_t (default 8 bytes).
 class LeafNode : public Node
 {
@@ -134,13 +260,16 @@ private:
     index_t _objsEnd = 0;
 public:
     //! Initialize with range of point objects indices
-    LeafNode(index_t pointsBeg, index_t pointsEnd) : Node(NodeType::LEAF) {
+    LeafNode(index_t pointsBeg, index_t pointsEnd, bool lazy = false) : Node(NodeType::LEAF) {
         SetPointsBegIndex(pointsBeg);
         SetPointsEndIndex(pointsEnd);
+        _customData_nodeType |= ((index_t)lazy) << LAZY_LEAF_POS;
     }
 
     //! Get begin index
-    index_t GetPointsBegIndex() const { return (index_t)(_customData_nodeType >> NODE_TYPE_BITS); }
+    index_t GetPointsBegIndex() const { return (index_t)((_customData_nodeType & ~LAZY_LEAF_MASK) >> NODE_TYPE_BITS); }
+    //! True if the points of the leaf weren't split yet (see BBDTree::BuildLazyMidpointSplitTree)
+    bool IsLazy() const { return (bool)(_customData_nodeType >> LAZY_LEAF_POS); }
     //! Get end index
     index_t GetPointsEndIndex() const { return _objsEnd; }
 private:
@@ -148,6 +277,22 @@ private:
     void SetPointsEndIndex(index_t i) { _objsEnd = i; }
 };
 
+//! Node forwarding to another node inside the array of nodes. It is used only at the position of left child,
+//! when the relayout of the tree moved the left child away from its parent.
+//! Target index is stored inside upper (8 * sizeof(index_t) - 2) bits of _customData_nodeType.
+//! Size of the node is 4 or 8 bytes depending on the index_t (default 4 bytes).
+class LinkNode : public Node
+{
+public:
+    //! Initialize with index of the target node
+    LinkNode(index_t targetIndex) : Node(NodeType::LINK) { SetTargetIndex(targetIndex); }
+
+    //! Get index of the target node
+    index_t GetTargetIndex() const { return (index_t)(_customData_nodeType >> NODE_TYPE_BITS); }
+private:
+    void SetTargetIndex(index_t i) { _customData_nodeType = (_customData_nodeType & NODE_TYPE_MASK) | (i << NODE_TYPE_BITS); }
+};
+
 //! Gets offset of specified node type inside array of Nodes (multiples of sizeof(Node))
 template<typename FloatT, int Dim>
 index_t GetNodeOffset(NodeType nodeType)
@@ -156,6 +301,7 @@ index_t GetNodeOffset(NodeType nodeType)
     static_assert(sizeof(InnerNode) == sizeof(Node));
     static_assert(sizeof(ShrinkNode<FloatT, Dim>) % sizeof(Node) == 0);
     static_assert(sizeof(LeafNode) == 2*sizeof(Node));
+    static_assert(sizeof(LinkNode) == sizeof(Node));
     switch (nodeType)
     {
     case NodeType::SPLIT:
@@ -164,12 +310,51 @@ index_t GetNodeOffset(NodeType nodeType)
         return sizeof(ShrinkNode<FloatT, Dim>) / sizeof(Node);
     case NodeType::LEAF:
         return sizeof(LeafNode) / sizeof(Node);
+    case NodeType::LINK:
+        return sizeof(LinkNode) / sizeof(Node);
     default:
         break;
     }
     return 0;
 }
 
+//! Gets offset of specified node inside array of Nodes (multiples of sizeof(Node)), handles also compact shrink nodes
+template<typename FloatT, int Dim>
+index_t GetNodeOffset(const Node* node)
+{
+    static_assert(sizeof(CompactShrinkNode<Dim>) == 2*sizeof(Node));
+    if (node->GetType() == NodeType::SHRINK && ((const InnerNode*)node)->IsCompactShrink())
+        return sizeof(CompactShrinkNode<Dim>) / sizeof(Node);
+    return GetNodeOffset<FloatT, Dim>(node->GetType());
+}
+
+//! Gets size of quantization interval of range [lo, hi] divided into levels intervals, integer steps are rounded up,
+//! so that the intervals cover the range. Zero extent gives step 0 and all the values get code 0.
+template<typename FloatT>
+inline FloatT GetQuantStep(FloatT lo, FloatT hi, int levels)
+{
+    // size of integer range may not fit into FloatT (see Box::GetSize)
+    DistT<FloatT> size = (DistT<FloatT>)hi - lo;
+    if constexpr (std::is_integral_v<FloatT>)
+        return (FloatT)(size / levels + (size % levels != 0 ? 1 : 0));
+    return (FloatT)(size / levels);
+}
+
+//! Gets bound of quantization interval q of range [lo, hi] divided into levels intervals of size step (see GetQuantStep).
+//! The same expression is used for quantization and search, so the intervals of quantized points are bit exact.
+template<typename FloatT>
+inline FloatT GetQuantBound(FloatT lo, FloatT hi, FloatT step, int q, int levels)
+{
+    if (q == levels)
+        return hi;
+    if constexpr (std::is_integral_v<FloatT>) {
+        // rounded up steps may reach past hi
+        if ((DistT<FloatT>)q * step >= (DistT<FloatT>)hi - lo)
+            return hi;
+    }
+    return lo + (FloatT)((DistT<FloatT>)q * step);
+}
+
 //! Splits array into 2 parts (like in quick sort) according to FuncT isLeft function.
 //! FuncT has 2 parameters and should return true if left parameter is "smaller" than right parameter.
 //! Returns pointer to begining of the right part (end of left part).
@@ -214,6 +399,22 @@ struct BBDTreeStats
     double avgLeafSize;
     // in bytes
     int memoryConsumption;
+    // in bytes, point objects together with their quantized copy
+    size_t objMemoryConsumption;
+};
+
+// Statistics of the BBD tree refit (see BBDTree::Refit)
+struct RefitStats
+{
+    // points which left the region of their leaf
+    int escapedCount = 0;
+    int rebuiltSubtreeCount = 0;
+    int rebuiltObjCount = 0;
+    // Node elements of the replaced subtrees
+    int rebuiltNodeCount = 0;
+    // fraction of live points inside rebuilt subtrees, full rebuild is cheaper when it gets close to 1
+    double rebuiltFraction = 0;
+    bool fullRebuild = false;
 };
 
 // Intermediate structure for computing statistics of the BBD tree
@@ -229,6 +430,16 @@ struct BBDTreeIntermediateStats
     int leafSizesSum = 0;
 };
 
+//! Childs of inner node together with their boxes (see BBDTree::GetChildren). Index 0 means that the child doesn't exist.
+template<typename FloatT, int Dim>
+struct ChildNodes
+{
+    index_t leftIdx;
+    Box<FloatT, Dim> leftBox;
+    index_t rightIdx;
+    Box<FloatT, Dim> rightBox;
+};
+
 //! BBDTree consits of 2 types of inner nodes: split nodes and shrink nodes. Each is described within their own type.
 //! This class contains functions for building the tree, accessing its nodes and getting some basic statistics.
 template<typename FloatT, int Dim, typename ObjData = Empty>
@@ -252,6 +463,42 @@ public:
     {
         BBDTree tree(leafMaxSize, objs);
         tree.BuildMidpointSplitTreeR({tree._bbox, tree._objs.data(), tree._objs.data() + tree._objs.size()});
+        tree.ComputeSubtreeCounts();
+        return tree;
+    }
+
+    //! Builds the tree using midpoint split algorithm adapted to the distribution of queries, e.g. sample from QueryRecorder.
+    //! Max leaf size of each node is leafMaxSize divided by the ratio of its share of the queries and its share of the points,
+    //! clamped to [leafMaxSize / adaptFactor, leafMaxSize * adaptFactor]. So regions receiving many queries get smaller leafs and deeper splits, cold regions are coarser.
+    static BBDTree BuildQueryAdaptiveTree(int leafMaxSize, const std::vector<PointObjT>& objs, std::vector<Vec<FloatT, Dim>> queries, int adaptFactor = 4)
+    {
+        BBDTree tree(leafMaxSize, objs);
+        tree._adaptQueryCount = (index_t)queries.size();
+        tree._adaptFactor = std::max(1, adaptFactor);
+        tree.BuildMidpointSplitTreeR({tree._bbox, tree._objs.data(), tree._objs.data() + tree._objs.size()}, {queries.data(), queries.data() + queries.size()});
+        tree.ComputeSubtreeCounts();
+        // later rebuilds of subtrees use leafMaxSize
+        tree._adaptQueryCount = 0;
+        return tree;
+    }
+
+    //! Builds only lazy root leaf referencing all the points in O(n), the rest of the tree is built by searches (see ExpandLazyLeaf).
+    //! Lazy leaf reached by a search is expanded into midpoint split subtree, whose leafs have at most 1/expandFactor of its points,
+    //! and leafs with more than leafMaxSize points are lazy again. So queries touching small part of the tree split only the points they need.
+    //! Concurrent searches are safe, they share one mutex with the expansions. Searches can't be nested, search of the lazy tree called from callback
+    //! of another search (ForEachLeaf, SearchAproximateRange) deadlocks, when it expands a leaf while the outer search holds the lock. Such callers
+    //! have to call ExpandLazyLeafs first or collect the leafs or points inside the callback and search after the outer search returns.
+    static BBDTree BuildLazyMidpointSplitTree(int leafMaxSize, const std::vector<PointObjT>& objs, int expandFactor = 16)
+    {
+        BBDTree tree(leafMaxSize, objs);
+        if (tree.GetObjCount() <= (index_t)leafMaxSize) {
+            tree.AddLeafNode(0, tree.GetObjCount());
+        } else {
+            tree._lazyState = std::make_shared<LazyState>();
+            tree._lazyState->expandFactor = std::max(2, expandFactor);
+            tree.AddLazyLeafNode(0, tree.GetObjCount());
+        }
+        tree.ComputeSubtreeCounts();
         return tree;
     }
 
@@ -265,15 +512,119 @@ public:
     //! Gets node by index, read only
     const Node* GetNode(index_t index) const { return &_nodes[index]; }
     
-    //! Gets point object by index, read only
-    const PointObjT* GetObj(index_t index) const { return _objs.data() + index; }
+    //! Gets index of the left child of specified inner node. Follows the link, if the left child was moved by relayout.
+    index_t GetLeftChildIndex(index_t nodeIndex) const {
+        index_t leftIndex = nodeIndex + GetNodeOffset<FloatT, Dim>(GetNode(nodeIndex));
+        const Node* leftNode = GetNode(leftIndex);
+        if (leftNode->GetType() == NodeType::LINK)
+            return ((const LinkNode*)leftNode)->GetTargetIndex();
+        return leftIndex;
+    }
+
+    //! Gets shrink box of specified shrink node. Box of the node is needed for decoding of compact shrink nodes.
+    Box<FloatT, Dim> GetShrinkBox(index_t nodeIndex, const Box<FloatT, Dim>& nodeBox) const {
+        const InnerNode* innerNode = (const InnerNode*)GetNode(nodeIndex);
+        if (innerNode->IsCompactShrink())
+            return ((const CompactShrinkNode<Dim>*)innerNode)->GetShrinkBox(nodeBox);
+        return ((const ShrinkNode<FloatT, Dim>*)innerNode)->GetShrinkBox();
+    }
+
+    //! Gets childs of specified inner node and their boxes computed from the box of the node, all traversals split the boxes this way.
+    //! Outer child of shrink node has the box of the node. Indices are read at once, so they stay valid when lazy expansion inside the left subtree reallocates the nodes.
+    ChildNodes<FloatT, Dim> GetChildren(index_t nodeIndex, const Box<FloatT, Dim>& nodeBox) const {
+        const InnerNode* innerNode = (const InnerNode*)GetNode(nodeIndex);
+        ChildNodes<FloatT, Dim> childs = {innerNode->HasLeftChild() ? GetLeftChildIndex(nodeIndex) : 0, nodeBox, innerNode->GetRightChildIndex(), nodeBox};
+        if (innerNode->GetType() == NodeType::SPLIT) {
+            int splitDim = ((const SplitNode*)innerNode)->GetSplitDim();
+            FloatT splitValue = nodeBox.GetSplitValue(splitDim);
+            childs.leftBox.max[splitDim] = splitValue;
+            childs.rightBox.min[splitDim] = splitValue;
+        } else {
+            childs.leftBox = GetShrinkBox(nodeIndex, nodeBox);
+        }
+        return childs;
+    }
+
+    //! Gets point object by index, read only, requires HasExactPoints (GetDecodedObj gets the points of trees without them)
+    const PointObjT* GetObj(index_t index) const {
+        assert(_hasExactPoints);
+        return _objs.data() + index;
+    }
+    //! Gets number of point objects stored inside the tree
+    index_t GetObjCount() const { return _hasExactPoints ? (index_t)_objs.size() : (index_t)(_quantPoints.size() * 8 / (Dim * _quantBits)); }
+    //! Gets number of removed point objects, which are still stored inside the tree
+    index_t GetDeletedCount() const { return _deletedCount; }
+    //! Gets number of point objects which weren't removed
+    index_t GetLiveObjCount() const { return GetObjCount() - _deletedCount; }
+    //! True if point object with specified index was removed
+    bool IsDeleted(index_t index) const { return _deletedCount != 0 && ((_deleted[index >> 6] >> (index & 63)) & 1); }
+    //! True if the tree keeps point object counts of subtrees (trees built by midpoint split or trees with removed points)
+    bool HasSubtreeCounts() const { return !_subtreeCounts.empty(); }
+    //! Gets number of point objects inside the subtree which weren't removed, requires HasSubtreeCounts
+    index_t GetSubtreeLiveCount(index_t nodeIndex) const { return _subtreeCounts[nodeIndex].liveCount; }
+    //! Gets bitmask of categories of point objects inside the subtree, all categories when the tree doesn't keep the masks
+    uint64_t GetSubtreeCategoryMask(index_t nodeIndex) const { return _categoryMasks.empty() ? ~(uint64_t)0 : _categoryMasks[nodeIndex]; }
+    //! Sets fraction of removed points of subtree which triggers rebuild of the subtree (default 0.5)
+    void SetRebuildThreshold(double rebuildThreshold) { _rebuildThreshold = rebuildThreshold; }
+
+    //! Gets number of bits of quantized point coordinates, 0 when points aren't quantized (see QuantizeLeafPoints)
+    int GetQuantBits() const { return _quantBits; }
+    //! Gets quantized coordinates of point object by index, QuantT has to match GetQuantBits
+    template<typename QuantT>
+    const std::array<QuantT, Dim>* GetQuantPoint(index_t index) const { return (const std::array<QuantT, Dim>*)_quantPoints.data() + index; }
+    //! False when the full precision points were dropped by QuantizeLeafPoints and only the quantized points are stored
+    bool HasExactPoints() const { return _hasExactPoints; }
+    //! Gets point object by index with point in the center of its quantization interval, leafBox is the box of its leaf. Requires quantized points.
+    PointObjT GetDecodedObj(index_t index, const Box<FloatT, Dim>& leafBox) const
+    {
+        PointObjT obj;
+        if (_quantBits == 8)
+            obj.point = DecodeQuantPoint<uint8_t>(index, leafBox);
+        else
+            obj.point = DecodeQuantPoint<uint16_t>(index, leafBox);
+        if constexpr (!std::is_empty_v<ObjData>)
+            obj.data = _hasExactPoints ? _objs[index].data : _quantObjDatas[index];
+        return obj;
+    }
 
     //! Gets bounding box of all the points.
     const Box<FloatT, Dim>& GetBBox() const { return _bbox; }
 
+    //! True if the tree was built lazily and wasn't completed yet (see BuildLazyMidpointSplitTree)
+    bool IsLazy() const { return _lazyState != nullptr; }
+    //! Locks lazy tree for searching, other trees get empty lock. Has to be held while searching, ExpandLazyLeaf releases it temporarily.
+    //! The lock isn't reentrant, so the searches can't be nested (see BuildLazyMidpointSplitTree).
+    std::shared_lock<std::shared_mutex> LockLazyLeafs() const {
+        if (_lazyState == nullptr)
+            return std::shared_lock<std::shared_mutex>();
+        return std::shared_lock<std::shared_mutex>(_lazyState->mutex);
+    }
+    //! Expands lazy leaf reached by search, box is the box of the leaf. Searching lock from LockLazyLeafs is released during the expansion,
+    //! so all pointers to the nodes have to be read again. The node at nodeIndex becomes root of the new subtree.
+    void ExpandLazyLeaf(index_t nodeIndex, const Box<FloatT, Dim>& box, std::shared_lock<std::shared_mutex>& lock) const
+    {
+        lock.unlock();
+        {
+            std::unique_lock<std::shared_mutex> expandLock(_lazyState->mutex);
+            const LeafNode* leafNode = (const LeafNode*)GetNode(nodeIndex);
+            index_t leafSize = leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex();
+            // the expansion changes only mutable members, so it is well defined also for trees declared const
+            const_cast<BBDTree*>(this)->ExpandLazyLeafNode(nodeIndex, box, leafSize / _lazyState->expandFactor);
+        }
+        lock.lock();
+    }
+    //! Expands all lazy leafs, so that the tree is complete. Modifications of the tree do it automatically.
+    void ExpandLazyLeafs()
+    {
+        if (_lazyState == nullptr)
+            return;
+        ExpandLazyLeafsR(0, _bbox);
+        _lazyState.reset();
+    }
+
     //! Gets number of point objects referenced by leaf node
     int GetLeafSize(const LeafNode* leafNode) const {
-        return GetObj(leafNode->GetPointsEndIndex()) - GetObj(leafNode->GetPointsBegIndex());
+        return (int)(leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex());
     }
 
     //! Gets tree statistics
@@ -290,22 +641,325 @@ public:
         stats.avgDepth = (double)interStats.depthSum / (double)interStats.leafNodeCount;
         stats.avgLeafSize = (double)interStats.leafSizesSum / (double)interStats.leafNodeCount;
         stats.memoryConsumption = sizeof(Node) * _nodes.size();
+        stats.objMemoryConsumption = sizeof(PointObjT) * _objs.size() + _quantPoints.size() + sizeof(ObjData) * _quantObjDatas.size();
         return stats;
     }
+
+    //! Rewrites shrink nodes into compact form (see CompactShrinkNode), which takes 8 B instead of sizeof(index_t) + 2 * Dim * sizeof(FloatT) B.
+    //! Shrink nodes whose encoding doesn't fit keep the full shrink box. Nodes are written in depth first order, so any relayout should be done afterwards.
+    //! Returns false if the tree is empty or doesn't keep the exact points.
+    bool CompactShrinkNodes()
+    {
+        if (_nodes.empty() || !_hasExactPoints)
+            return false;
+        ExpandLazyLeafs();
+        NodeArray nodes(_nodes.get_allocator());
+        nodes.reserve(_nodes.size());
+        CompactShrinkNodesR(nodes, 0, _bbox);
+        _nodes = std::move(nodes);
+        _garbageNodeCount = 0;
+        if (!_subtreeCounts.empty())
+            ComputeSubtreeCounts();
+        return true;
+    }
+
+    //! Removes point object with specified index (see GetObj). The point is only marked deleted and the searches skip it.
+    //! When the fraction of deleted points inside some subtree exceeds the rebuild threshold, only this subtree is rebuilt from its live points.
+    //! Rebuilds (and relayouts) change indices of point objects, so ObjData should be used for identification of the points.
+    //! Returns false if the index is invalid or the point was already removed.
+    bool Remove(index_t index)
+    {
+        if (!_hasExactPoints || index >= GetObjCount() || IsDeleted(index))
+            return false;
+        ExpandLazyLeafs();
+        if (_deleted.empty())
+            _deleted.resize((_objs.size() + 63) / 64, 0);
+        if (_subtreeCounts.empty())
+            ComputeSubtreeCounts();
+        std::vector<PathNode> path;
+        if (!FindLeafPath(index, path))
+            return false;
+        _deleted[index >> 6] |= ((uint64_t)1) << (index & 63);
+        ++_deletedCount;
+        for (const PathNode& pathNode : path)
+            --_subtreeCounts[pathNode.nodeIndex].liveCount;
+
+        // rebuild the biggest subtree with too many deleted points, whole tree is rebuilt when there are too many deleted points or unused nodes
+        if (_deletedCount > _rebuildThreshold * _objs.size() || 2 * _garbageNodeCount > _nodes.size()) {
+            RebuildAll();
+            return true;
+        }
+        for (int i = 1; i < (int)path.size(); ++i) {
+            const SubtreeCounts& counts = _subtreeCounts[path[i].nodeIndex];
+            if (counts.objCount > (index_t)_leafMaxSize && counts.objCount - counts.liveCount > _rebuildThreshold * counts.objCount) {
+                RebuildSubtree(path, i);
+                break;
+            }
+        }
+        return true;
+    }
+
+    //! Updates coordinates of all point objects, points[i] is the new position of GetObj(i), and keeps the nodes for points which stayed inside their cells.
+    //! Points which left their leaf are moved by rebuilding the smallest subtree whose region contains them again, so that only the touched part of the tree changes.
+    //! The whole tree is rebuilt only when some point left the bounding box or moved between childs of the root.
+    //! Returns false and does nothing if the size of points doesn't match GetObjCount() or if the tree doesn't keep the exact points.
+    bool Refit(const std::vector<Vec<FloatT, Dim>>& points, RefitStats& stats)
+    {
+        stats = RefitStats();
+        if (!_hasExactPoints || (index_t)points.size() != GetObjCount())
+            return false;
+        if (_nodes.empty())
+            return true;
+        ExpandLazyLeafs();
+        for (index_t i = 0; i < GetObjCount(); ++i)
+            _objs[i].point = points[i];
+
+        std::vector<PathNode> path = {{0, _bbox, false}};
+        std::vector<Box<FloatT, Dim>> excluded;
+        std::vector<index_t> escaped;
+        std::vector<std::vector<PathNode>> rebuilds;
+        RefitR(path, std::array<bool, Dim>(), excluded, escaped, rebuilds, stats);
+
+        index_t liveObjCount = GetLiveObjCount();
+        if (!escaped.empty() || (!rebuilds.empty() && rebuilds.back().size() == 1)) {
+            stats.rebuiltSubtreeCount = 1;
+            stats.rebuiltObjCount = liveObjCount;
+            stats.rebuiltNodeCount = _nodes.size() - _garbageNodeCount;
+            stats.fullRebuild = true;
+            RebuildAll();
+        } else {
+            // rebuild of a subtree covers all the rebuilds inside it
+            std::unordered_set<index_t> rebuildNodes;
+            for (const std::vector<PathNode>& rebuildPath : rebuilds)
+                rebuildNodes.insert(rebuildPath.back().nodeIndex);
+            for (const std::vector<PathNode>& rebuildPath : rebuilds) {
+                if (std::any_of(rebuildPath.begin(), rebuildPath.end() - 1, [&](const PathNode& pathNode) { return rebuildNodes.count(pathNode.nodeIndex) != 0; }))
+                    continue;
+                index_t garbageNodeCount = _garbageNodeCount;
+                stats.rebuiltObjCount += RebuildSubtree(rebuildPath, (int)rebuildPath.size() - 1);
+                stats.rebuiltNodeCount += _garbageNodeCount - garbageNodeCount;
+                ++stats.rebuiltSubtreeCount;
+            }
+            if (2 * _garbageNodeCount > _nodes.size()) {
+                stats.fullRebuild = true;
+                RebuildAll();
+            } else if (_quantBits != 0) {
+                QuantizeLeafPoints(_quantBits);
+            }
+        }
+        stats.rebuiltFraction = liveObjCount > 0 ? (double)stats.rebuiltObjCount / liveObjCount : 0;
+        return true;
+    }
+    //! Updates coordinates of all point objects without statistics (see Refit above)
+    bool Refit(const std::vector<Vec<FloatT, Dim>>& points)
+    {
+        RefitStats stats;
+        return Refit(points, stats);
+    }
+
+    //! Stores quantized copy of point coordinates with 8 or 16 bits per coordinate relative to the box of their leaf, 0 bits removes the quantized points.
+    //! Search then scans the quantized points for lower bounds of distances and reads full precision points only for candidates which can get into the result.
+    //! When keepExactPoints is false, the full precision points are freed, so that the points take Dim * bits / 8 B each (plus their ObjData).
+    //! The nearest neighbor, kNN, range and counting searches of search.h and NearestNeighborIterator then use centers of the quantization intervals (see GetDecodedObj), which are off by at most half of the interval
+    //! of their leaf in each coordinate, so the results aren't exact even with epsilon 0. Such tree can't be modified, relayouted or quantized again
+    //! (these calls do nothing and return false) and GetObj isn't available, so the algorithms which read the points by GetObj need the exact points.
+    void QuantizeLeafPoints(int bits, bool keepExactPoints = true)
+    {
+        if (!_hasExactPoints)
+            return;
+        _quantBits = 0;
+        _quantPoints.clear();
+        _quantPoints.shrink_to_fit();
+        if (_nodes.empty() || (bits != 8 && bits != 16))
+            return;
+        ExpandLazyLeafs();
+        _quantBits = bits;
+        _quantPoints.resize(_objs.size() * Dim * bits / 8);
+        if (bits == 8)
+            QuantizeLeafPointsR<uint8_t>(0, _bbox);
+        else
+            QuantizeLeafPointsR<uint16_t>(0, _bbox);
+        if (!keepExactPoints) {
+            if constexpr (!std::is_empty_v<ObjData>) {
+                _quantObjDatas.reserve(_objs.size());
+                for (const PointObjT& obj : _objs)
+                    _quantObjDatas.push_back(obj.data);
+            }
+            ObjArray(_objs.get_allocator()).swap(_objs);
+            _hasExactPoints = false;
+        }
+    }
+
+    //! Relayouts the nodes, so that connected subtrees are grouped into blocks of specified size in bytes (4 kB pages, 2 MB huge pages).
+    //! Large subtrees are cut into blocks filled in breadth first order from their roots, small subtrees are packed whole into shared blocks.
+    //! Nodes inside blocks are written in depth first order and the blocks start at multiples of blockSize bytes from the begining of the nodes array.
+    //! The nodes and points arrays are allocated aligned to blockSize, so that the blocks are pages in memory too (blockSize has to be power of 2, otherwise they are aligned to the cache line).
+    //! Point objects are reordered, so that points of leafs inside one block are next to each other.
+    //! When the tree is served from disk or mmap, the query path then touches about depth / (height of block) pages.
+    //! Returns false if the tree is empty or doesn't keep the exact points.
+    bool RelayoutToBlocks(int blockSize = 4096)
+    {
+        if (_nodes.empty() || !_hasExactPoints)
+            return false;
+        ExpandLazyLeafs();
+        index_t blockNodes = std::max<index_t>(1, blockSize / sizeof(Node));
+        std::vector<index_t> subtreeSizes(_nodes.size(), 0);
+        ComputeSubtreeSizesR(subtreeSizes, 0);
+
+        std::vector<std::vector<index_t>> blocks;
+        std::vector<bool> selected(_nodes.size(), false);
+        // block shared by small subtrees
+        int packingBlock = -1;
+        index_t packingUsedNodes = 0;
+        std::queue<index_t> blockRoots;
+        blockRoots.push(0);
+        while (!blockRoots.empty())
+        {
+            index_t blockRoot = blockRoots.front();
+            blockRoots.pop();
+            // whole subtree fits into block, pack it together with other small subtrees
+            if (subtreeSizes[blockRoot] <= blockNodes) {
+                if (packingBlock < 0 || packingUsedNodes + subtreeSizes[blockRoot] > blockNodes) {
+                    blocks.emplace_back();
+                    packingBlock = (int)blocks.size() - 1;
+                    packingUsedNodes = 0;
+                }
+                packingUsedNodes += subtreeSizes[blockRoot];
+                AppendPreorderR(blocks[packingBlock], blockRoot);
+                continue;
+            }
+            // select connected subtree, which fits into the block, in breadth first order
+            // pair of node index and flag if the node would be placed right after its parent
+            std::queue<std::pair<index_t, bool>> nodeQueue;
+            nodeQueue.push({blockRoot, false});
+            index_t usedNodes = 0;
+            while (!nodeQueue.empty())
+            {
+                index_t nodeIndex = nodeQueue.front().first;
+                bool afterParent = nodeQueue.front().second;
+                nodeQueue.pop();
+                // inner node needs space for link, until its left child is added to the block
+                index_t nodeCost = GetRelayoutSize(nodeIndex) - (afterParent ? 1 : 0);
+                if (usedNodes > 0 && usedNodes + nodeCost > blockNodes) {
+                    blockRoots.push(nodeIndex);
+                    continue;
+                }
+                usedNodes += nodeCost;
+                selected[nodeIndex] = true;
+                const Node* node = GetNode(nodeIndex);
+                if (node->GetType() != NodeType::LEAF) {
+                    const InnerNode* innerNode = (const InnerNode*)node;
+                    if (innerNode->HasLeftChild())
+                        nodeQueue.push({GetLeftChildIndex(nodeIndex), true});
+                    if (innerNode->GetRightChildIndex() != 0)
+                        nodeQueue.push({innerNode->GetRightChildIndex(), false});
+                }
+            }
+            // write the selected nodes in depth first order, so that left childs stay right after their parents
+            blocks.emplace_back();
+            AppendSelectedPreorderR(blocks.back(), selected, blockRoot);
+        }
+        size_t alignment = (blockSize & (blockSize - 1)) == 0 ? std::max<size_t>(blockSize, CACHE_LINE_SIZE) : CACHE_LINE_SIZE;
+        Relayout(blocks, blockNodes, alignment);
+        return true;
+    }
+
+    //! Relayouts the nodes into van Emde Boas order. The tree is recursively cut at half of its height
+    //! and the top subtree is written before all the bottom subtrees, so that root to leaf path touches
+    //! O(log_B n) cache lines for any cache line size B. Point objects are reordered in the order of leafs.
+    //! Returns false if the tree is empty or doesn't keep the exact points.
+    bool RelayoutVanEmdeBoas()
+    {
+        if (_nodes.empty() || !_hasExactPoints)
+            return false;
+        ExpandLazyLeafs();
+        BBDTreeIntermediateStats interStats;
+        GetStatsR(interStats, 0, 0);
+        std::vector<index_t> order;
+        AppendVanEmdeBoasR(order, 0, interStats.maxDepth + 1);
+        Relayout({order}, 1, CACHE_LINE_SIZE);
+        return true;
+    }
 private:
+    //! Array of nodes aligned to the cache line size or to the block size of RelayoutToBlocks
+    using NodeArray = std::vector<Node, AlignedAllocator<Node>>;
+    //! Array of point objects with the same alignment as the nodes array
+    using ObjArray = std::vector<PointObjT, AlignedAllocator<PointObjT>>;
+
     //! Array of inner and leaf nodes. The actual nodes are written in an "unsafe" way.
     //! Depending on the node type the node may span on multiple Node elements. For example when sizeof(index_t)=4 and sizeof(FloatT)=4:
     //! Then SplitNode is 1 * Node, LeafNode is 2 * Node, ShrinkNode is 7 * Node for Dim = 3
-    std::vector<Node> _nodes;
+    //! Members marked mutable are changed by expansions of lazy leafs during const searches (see ExpandLazyLeaf).
+    mutable NodeArray _nodes;
     //! Source point objects for which the search is optimized
-    std::vector<PointObjT> _objs;
+    mutable ObjArray _objs;
     //! Bounding box of the point objects
     Box<FloatT, Dim> _bbox;
     //! Max leaf size
     int _leafMaxSize;
+    //! Number of bits of quantized point coordinates, 0 when points aren't quantized
+    int _quantBits = 0;
+
+    //! Total and live point object counts of subtree
+    struct SubtreeCounts
+    {
+        index_t objCount = 0;
+        index_t liveCount = 0;
+    };
+    //! Node on the path from root to some leaf, together with its box
+    struct PathNode
+    {
+        index_t nodeIndex;
+        Box<FloatT, Dim> box;
+        //! True if the node is left child of previous node on the path
+        bool isLeft;
+    };
+    //! Bitset of deleted point objects aligned with _objs, empty until first point is removed
+    std::vector<uint64_t> _deleted;
+    //! Number of deleted point objects
+    index_t _deletedCount = 0;
+    //! Point object counts of subtrees indexed by node index, computed by the midpoint split builds or by the first removal
+    mutable std::vector<SubtreeCounts> _subtreeCounts;
+    //! Bitmasks of categories present inside subtrees indexed by node index (see GetCategoryMask), kept together with _subtreeCounts
+    //! when ObjData has categories. Removals don't clear them, so they may contain categories of removed points.
+    mutable std::vector<uint64_t> _categoryMasks;
+    //! Number of Node elements of subtrees replaced by their rebuilds
+    index_t _garbageNodeCount = 0;
+    //! Fraction of deleted points of subtree which triggers its rebuild
+    double _rebuildThreshold = 0.5;
+    //! Quantized coordinates of point objects in the same order as _objs, std::array<QuantT, Dim> per point
+    mutable std::vector<uint8_t, AlignedAllocator<uint8_t>> _quantPoints;
+    //! False when _objs were freed by QuantizeLeafPoints, the data of point objects are then kept in _quantObjDatas (empty for empty ObjData)
+    bool _hasExactPoints = true;
+    std::vector<ObjData> _quantObjDatas;
+
+    //! Synchronization of searches and expansions of lazy leafs, shared by copies of the tree
+    struct LazyState
+    {
+        std::shared_mutex mutex;
+        //! Leafs of expanded subtree have at most 1/expandFactor of its points
+        index_t expandFactor;
+    };
+    //! State of lazy tree, null for complete trees
+    std::shared_ptr<LazyState> _lazyState;
+    //! Point ranges of at most this size become lazy leafs during building, 0 builds complete subtrees
+    mutable index_t _lazyLeafMaxSize = 0;
+
+    //! Range of sampled queries inside the box of the node being built (see BuildQueryAdaptiveTree)
+    struct QueryRange
+    {
+        Vec<FloatT, Dim>* beg = nullptr;
+        Vec<FloatT, Dim>* end = nullptr;
+
+        index_t size() const { return end - beg; }
+    };
+    //! Number of all sampled queries during query adaptive building, otherwise 0
+    index_t _adaptQueryCount = 0;
+    //! Max ratio between adapted leaf size and leafMaxSize
+    int _adaptFactor = 1;
 
     //! Initialization before building the tree
-    BBDTree(int leafMaxSize, const std::vector<PointObjT>& objs) : _leafMaxSize(leafMaxSize), _objs(objs), _bbox(Box<FloatT, Dim>::GetBoundingBox(objs)) {}
+    BBDTree(int leafMaxSize, const std::vector<PointObjT>& objs) : _leafMaxSize(leafMaxSize), _objs(objs.begin(), objs.end()), _bbox(Box<FloatT, Dim>::GetBoundingBox(objs)) {}
 
     //! Adds SplitNode to nodes array and returns its index
     index_t AddSplitNode(int splitDim) {
@@ -335,6 +989,84 @@ private:
         return index;
     }
 
+    //! Adds lazy LeafNode followed by one unused Node, so that it can be replaced by split node or compact shrink node with link to its left child
+    index_t AddLazyLeafNode(index_t pointsBeg, index_t pointsEnd) {
+        index_t index = AddLeafNode(pointsBeg, pointsEnd);
+        *((LeafNode*)&_nodes[index]) = LeafNode(pointsBeg, pointsEnd, true);
+        _nodes.push_back(Node());
+        return index;
+    }
+
+    //! Builds subtree from the points of lazy leaf and writes its root in place of the leaf, box is the box of the leaf.
+    //! Leafs of the subtree with more than leafMaxSize and at most lazyLeafMaxSize points are lazy. Does nothing if the leaf isn't lazy.
+    void ExpandLazyLeafNode(index_t nodeIndex, const Box<FloatT, Dim>& box, index_t lazyLeafMaxSize)
+    {
+        const LeafNode* leafNode = (const LeafNode*)GetNode(nodeIndex);
+        if (leafNode->GetType() != NodeType::LEAF || !leafNode->IsLazy())
+            return;
+        index_t pointsBeg = leafNode->GetPointsBegIndex();
+        index_t pointsEnd = leafNode->GetPointsEndIndex();
+        _lazyLeafMaxSize = lazyLeafMaxSize;
+        index_t rootIndex = BuildMidpointSplitTreeR({box, _objs.data() + pointsBeg, _objs.data() + pointsEnd});
+        _lazyLeafMaxSize = 0;
+
+        // the lazy leaf spans 3 Node elements, the root is written there and its left child stays behind link
+        const InnerNode* rootNode = (const InnerNode*)GetNode(rootIndex);
+        index_t leftIndex = rootIndex + GetNodeOffset<FloatT, Dim>(rootNode);
+        std::array<int, Dim> levels;
+        std::array<index_t, Dim> offsets;
+        if (rootNode->GetType() == NodeType::SPLIT) {
+            InnerNode splitNode = *rootNode;
+            _nodes[nodeIndex] = splitNode;
+            if (splitNode.HasLeftChild())
+                _nodes[nodeIndex + 1] = LinkNode(leftIndex);
+        } else if (rootNode->GetType() == NodeType::SHRINK && CompactShrinkNode<Dim>::Encode(box, ((const ShrinkNode<FloatT, Dim>*)rootNode)->GetShrinkBox(), levels, offsets)) {
+            CompactShrinkNode<Dim> shrinkNode(levels, offsets);
+            shrinkNode.SetLeftChild(rootNode->HasLeftChild());
+            shrinkNode.SetRightChildIndex(rootNode->GetRightChildIndex());
+            *((CompactShrinkNode<Dim>*)&_nodes[nodeIndex]) = shrinkNode;
+            if (shrinkNode.HasLeftChild())
+                _nodes[nodeIndex + 2] = LinkNode(leftIndex);
+        } else if (rootNode->GetType() == NodeType::LEAF) {
+            // points which can't be split
+            *((LeafNode*)&_nodes[nodeIndex]) = LeafNode(pointsBeg, pointsEnd);
+        } else {
+            // shrink box which doesn't fit the compact node, the full shrink node stays appended behind compact shrink node to the same box
+            std::array<int, Dim> noLevels = {};
+            std::array<index_t, Dim> noOffsets = {};
+            CompactShrinkNode<Dim> shrinkNode(noLevels, noOffsets);
+            shrinkNode.SetLeftChild(true);
+            shrinkNode.SetRightChildIndex(0);
+            *((CompactShrinkNode<Dim>*)&_nodes[nodeIndex]) = shrinkNode;
+            _nodes[nodeIndex + 2] = LinkNode(rootIndex);
+        }
+        if (!_subtreeCounts.empty()) {
+            _subtreeCounts.resize(_nodes.size());
+            if constexpr (HasCategoryMask<ObjData>::value)
+                _categoryMasks.resize(_nodes.size());
+            ComputeSubtreeCountsR(nodeIndex);
+        }
+        if (_quantBits == 8)
+            QuantizeLeafPointsR<uint8_t>(nodeIndex, box);
+        else if (_quantBits == 16)
+            QuantizeLeafPointsR<uint16_t>(nodeIndex, box);
+    }
+
+    //! Expands all lazy leafs of the subtree into complete subtrees, box is the box of the node
+    void ExpandLazyLeafsR(index_t nodeIndex, const Box<FloatT, Dim>& box)
+    {
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF) {
+            ExpandLazyLeafNode(nodeIndex, box, 0);
+            return;
+        }
+        ChildNodes<FloatT, Dim> childs = GetChildren(nodeIndex, box);
+        if (childs.leftIdx != 0)
+            ExpandLazyLeafsR(childs.leftIdx, childs.leftBox);
+        if (childs.rightIdx != 0)
+            ExpandLazyLeafsR(childs.rightIdx, childs.rightBox);
+    }
+
     //! Builds child subtrees using only splits (used only for testing purposes)
     void BuildBasicSplitChilds(index_t parentIndex, const Box<FloatT, Dim>& leftBox, const Box<FloatT, Dim>& rightBox, PointObjT* pointsBeg, PointObjT* pointsEnd, PointObjT* splitTo)
     {
@@ -358,8 +1090,8 @@ private:
         if (state.size() == 0) {
             // indicate that there is no child with 0 index (only root has 0 index and it can't be child of any node)
             return 0;
-        } else if (state.size() <= _leafMaxSize) {
-            // add leaf node if number of points is small enough
+        } else if (state.size() <= _leafMaxSize || !state.box.CanSplit()) {
+            // add leaf node if number of points is small enough or if the box can't be split anymore (duplicate points)
             return AddLeafNode(state.pointsBeg - _objs.data(), state.pointsEnd - _objs.data());
         } else {
             BoxSplit<FloatT, Dim> split = state.box.Split();
@@ -374,16 +1106,17 @@ private:
     }
 
     //! Builds the child subtrees of parent node using midpoint split algorithm.
-    void BuildMidpointSplitChilds(index_t parentIndex, const Box<FloatT, Dim>& leftBox, const Box<FloatT, Dim>& rightBox, PointObjT* pointsBeg, PointObjT* pointsEnd, PointObjT* splitTo)
+    void BuildMidpointSplitChilds(index_t parentIndex, const Box<FloatT, Dim>& leftBox, const Box<FloatT, Dim>& rightBox, PointObjT* pointsBeg, PointObjT* pointsEnd, PointObjT* splitTo,
+                                  QueryRange leftQueries, QueryRange rightQueries)
     {
         // build left subtree
-        index_t leftChildIndex = BuildMidpointSplitTreeR({leftBox, pointsBeg, splitTo});
+        index_t leftChildIndex = BuildMidpointSplitTreeR({leftBox, pointsBeg, splitTo}, leftQueries);
         if (leftChildIndex) {
             InnerNode* parentNode = (InnerNode*) &_nodes[parentIndex];
             parentNode->SetLeftChild(true);
         }
         // build right subtree
-        index_t rightChildIndex = BuildMidpointSplitTreeR({rightBox, splitTo, pointsEnd});
+        index_t rightChildIndex = BuildMidpointSplitTreeR({rightBox, splitTo, pointsEnd}, rightQueries);
         if (rightChildIndex) {
             InnerNode* parentNode = (InnerNode*) &_nodes[parentIndex];
             parentNode->SetRightChildIndex(rightChildIndex);
@@ -409,42 +1142,572 @@ private:
         }
     }
 
-    //! Builds the tree using midpoint split algorithm recursively.
-    index_t BuildMidpointSplitTreeR(SplitState<FloatT, Dim, ObjData> state)
+    //! Gets max leaf size of node with pointCount points and queryCount sampled queries (see BuildQueryAdaptiveTree)
+    index_t GetLeafMaxSize(index_t pointCount, index_t queryCount) const
+    {
+        if (_adaptQueryCount == 0)
+            return _leafMaxSize;
+        // ratio of the share of the queries and the share of the points, mixed half and half with uniform heat,
+        // because queries close to the node also visit it and the sample doesn't cover the cold regions well
+        double heat = 0.5 + 0.5 * ((double)queryCount * _objs.size()) / ((double)_adaptQueryCount * pointCount);
+        double minSize = std::max(1.0, (double)_leafMaxSize / _adaptFactor);
+        double maxSize = (double)_leafMaxSize * _adaptFactor;
+        return (index_t)std::clamp(_leafMaxSize / heat, minSize, maxSize);
+    }
+
+    //! Builds the tree using midpoint split algorithm recursively. Sampled queries inside the box of the node are partitioned together with the points.
+    index_t BuildMidpointSplitTreeR(SplitState<FloatT, Dim, ObjData> state, QueryRange queries = QueryRange())
     {
         if (state.size() == 0) {
             // indicate that there is no child with 0 index (only root has 0 index and it can't be child of any node)
             return 0;
-        } else if (state.size() <= _leafMaxSize) {
-            // add leaf node if number of points is small enough
+        }
+        index_t leafMaxSize = GetLeafMaxSize(state.size(), queries.size());
+        if (state.size() <= leafMaxSize || !state.box.CanSplit()) {
+            // add leaf node if number of points is small enough or if the box can't be split anymore (duplicate points)
             return AddLeafNode(state.pointsBeg - _objs.data(), state.pointsEnd - _objs.data());
+        } else if (state.size() <= _lazyLeafMaxSize) {
+            // points are split later by the search which reaches them
+            return AddLazyLeafNode(state.pointsBeg - _objs.data(), state.pointsEnd - _objs.data());
         } else {
             BoxSplit<FloatT, Dim> split;
             PointObjT* splitTo;
             SplitState<FloatT, Dim, ObjData> splitState = state;
             int splitCount = 0;
             // split until number of points is <= 2/3 total number of points in current node
-            while (3 * splitState.size() > 2 * state.size() && splitState.size() > _leafMaxSize) {
+            while (3 * splitState.size() > 2 * state.size() && splitState.size() > leafMaxSize && splitState.box.CanSplit()) {
                 SetBiggerSplit(splitState, split, splitTo);
                 ++splitCount;
             }
             // if there was only 1 split, we can simply create split node
             if (splitCount == 1) {
                 index_t splitNodeIndex = AddSplitNode(split.dim);
-                BuildMidpointSplitChilds(splitNodeIndex, split.left, split.right, state.pointsBeg, state.pointsEnd, splitTo);
+                Vec<FloatT, Dim>* queriesSplitTo = std::partition(queries.beg, queries.end, [&split](const Vec<FloatT, Dim>& query) {
+                    return query[split.dim] < split.value;
+                });
+                BuildMidpointSplitChilds(splitNodeIndex, split.left, split.right, state.pointsBeg, state.pointsEnd, splitTo, {queries.beg, queriesSplitTo}, {queriesSplitTo, queries.end});
                 return splitNodeIndex;
             } else { // otherwise we have a shrink node
                 // split the points according to the final box (inside box is on left, outside on right)
                 PointObjT* insideBoxTo = SplitPoints(state.pointsBeg, state.pointsEnd, [&splitState](const Vec<FloatT, Dim>& point) {
                     return splitState.box.Includes(point);
                 });
+                Vec<FloatT, Dim>* insideQueriesTo = std::partition(queries.beg, queries.end, [&splitState](const Vec<FloatT, Dim>& query) {
+                    return splitState.box.Includes(query);
+                });
                 index_t shrinkNodeIndex = AddShrinkNode(splitState.box);
-                BuildMidpointSplitChilds(shrinkNodeIndex, splitState.box, state.box, state.pointsBeg, state.pointsEnd, insideBoxTo);
+                BuildMidpointSplitChilds(shrinkNodeIndex, splitState.box, state.box, state.pointsBeg, state.pointsEnd, insideBoxTo, {queries.beg, insideQueriesTo}, {insideQueriesTo, queries.end});
                 return shrinkNodeIndex;
             }
         }
     }
 
+    //! Computes point object counts of all subtrees
+    void ComputeSubtreeCounts()
+    {
+        _subtreeCounts.assign(_nodes.size(), SubtreeCounts());
+        if constexpr (HasCategoryMask<ObjData>::value)
+            _categoryMasks.assign(_nodes.size(), 0);
+        ComputeSubtreeCountsR(0);
+    }
+
+    //! Computes point object counts of the subtree and its subtrees
+    SubtreeCounts ComputeSubtreeCountsR(index_t nodeIndex)
+    {
+        const Node* node = GetNode(nodeIndex);
+        SubtreeCounts counts;
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            counts.objCount = leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex();
+            counts.liveCount = counts.objCount;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex() && _deletedCount != 0; ++i)
+                counts.liveCount -= IsDeleted(i) ? 1 : 0;
+            if constexpr (HasCategoryMask<ObjData>::value) {
+                uint64_t categoryMask = 0;
+                for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i)
+                    categoryMask |= IsDeleted(i) ? 0 : _objs[i].data.GetCategoryMask();
+                _categoryMasks[nodeIndex] = categoryMask;
+            }
+        } else {
+            const InnerNode* innerNode = (const InnerNode*)node;
+            if constexpr (HasCategoryMask<ObjData>::value)
+                _categoryMasks[nodeIndex] = 0;
+            for (index_t childIndex : {innerNode->HasLeftChild() ? GetLeftChildIndex(nodeIndex) : 0, innerNode->GetRightChildIndex()}) {
+                if (childIndex != 0) {
+                    SubtreeCounts childCounts = ComputeSubtreeCountsR(childIndex);
+                    counts.objCount += childCounts.objCount;
+                    counts.liveCount += childCounts.liveCount;
+                    if constexpr (HasCategoryMask<ObjData>::value)
+                        _categoryMasks[nodeIndex] |= _categoryMasks[childIndex];
+                }
+            }
+        }
+        _subtreeCounts[nodeIndex] = counts;
+        return counts;
+    }
+
+    //! Finds path from root to the leaf referencing specified point object, using the same conditions as the tree building
+    bool FindLeafPath(index_t index, std::vector<PathNode>& path) const
+    {
+        const Vec<FloatT, Dim>& point = _objs[index].point;
+        index_t nodeIndex = 0;
+        Box<FloatT, Dim> box = _bbox;
+        bool isLeft = false;
+        while (true) {
+            path.push_back({nodeIndex, box, isLeft});
+            const Node* node = GetNode(nodeIndex);
+            if (node->GetType() == NodeType::LEAF) {
+                const LeafNode* leafNode = (const LeafNode*)node;
+                return index >= leafNode->GetPointsBegIndex() && index < leafNode->GetPointsEndIndex();
+            }
+            const InnerNode* innerNode = (const InnerNode*)node;
+            if (node->GetType() == NodeType::SPLIT) {
+                int splitDim = ((const SplitNode*)node)->GetSplitDim();
+                FloatT splitValue = box.GetSplitValue(splitDim);
+                isLeft = point[splitDim] < splitValue;
+                if (isLeft)
+                    box.max[splitDim] = splitValue;
+                else
+                    box.min[splitDim] = splitValue;
+            } else {
+                Box<FloatT, Dim> shrinkBox = GetShrinkBox(nodeIndex, box);
+                isLeft = shrinkBox.Includes(point);
+                if (isLeft)
+                    box = shrinkBox;
+            }
+            if (isLeft && innerNode->HasLeftChild())
+                nodeIndex = GetLeftChildIndex(nodeIndex);
+            else if (!isLeft && innerNode->GetRightChildIndex() != 0)
+                nodeIndex = innerNode->GetRightChildIndex();
+            else
+                return false;
+        }
+    }
+
+    //! True if point lies inside the region of a node, which is given by the conditions of tree building: box of the node with exclusive upper bounds
+    //! on the left sides of splits, without the shrink boxes of shrink nodes whose outer child is on the path
+    static bool IsInsideRegion(const Vec<FloatT, Dim>& point, const Box<FloatT, Dim>& box, const std::array<bool, Dim>& maxExclusive, const std::vector<Box<FloatT, Dim>>& excluded)
+    {
+        for (int d = 0; d < Dim; ++d) {
+            if (point[d] < box.min[d] || point[d] > box.max[d] || (maxExclusive[d] && point[d] == box.max[d]))
+                return false;
+        }
+        for (const Box<FloatT, Dim>& excludedBox : excluded) {
+            if (excludedBox.Includes(point))
+                return false;
+        }
+        return true;
+    }
+
+    //! Checks points of the subtree of path.back() against the regions of its nodes. Points outside the region of the subtree are added to escaped,
+    //! paths of nodes whose region contains some point escaped from their childs are added to rebuilds (in post order).
+    void RefitR(std::vector<PathNode>& path, const std::array<bool, Dim>& maxExclusive, std::vector<Box<FloatT, Dim>>& excluded,
+                std::vector<index_t>& escaped, std::vector<std::vector<PathNode>>& rebuilds, RefitStats& stats) const
+    {
+        index_t nodeIndex = path.back().nodeIndex;
+        Box<FloatT, Dim> box = path.back().box;
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                if (!IsDeleted(i) && !IsInsideRegion(_objs[i].point, box, maxExclusive, excluded)) {
+                    escaped.push_back(i);
+                    ++stats.escapedCount;
+                }
+            }
+            return;
+        }
+
+        bool isShrink = node->GetType() == NodeType::SHRINK;
+        ChildNodes<FloatT, Dim> childs = GetChildren(nodeIndex, box);
+        std::array<bool, Dim> leftMaxExclusive = maxExclusive;
+        if (isShrink) {
+            for (int d = 0; d < Dim; ++d)
+                leftMaxExclusive[d] = maxExclusive[d] && childs.leftBox.max[d] == box.max[d];
+        } else {
+            leftMaxExclusive[((const SplitNode*)node)->GetSplitDim()] = true;
+        }
+
+        std::vector<index_t> childEscaped;
+        if (childs.leftIdx != 0) {
+            path.push_back({childs.leftIdx, childs.leftBox, true});
+            RefitR(path, leftMaxExclusive, excluded, childEscaped, rebuilds, stats);
+            path.pop_back();
+        }
+        if (childs.rightIdx != 0) {
+            // shrink box of the inner child is excluded from the region of the outer child
+            if (isShrink)
+                excluded.push_back(childs.leftBox);
+            path.push_back({childs.rightIdx, childs.rightBox, false});
+            RefitR(path, maxExclusive, excluded, childEscaped, rebuilds, stats);
+            path.pop_back();
+            if (isShrink)
+                excluded.pop_back();
+        }
+
+        bool regained = false;
+        for (index_t i : childEscaped) {
+            if (IsInsideRegion(_objs[i].point, box, maxExclusive, excluded))
+                regained = true;
+            else
+                escaped.push_back(i);
+        }
+        if (regained)
+            rebuilds.push_back(path);
+    }
+
+    //! Collects live point objects of the subtree, range and number of referenced point objects and number of Node elements of the subtree
+    void CollectSubtreeR(index_t nodeIndex, std::vector<index_t>& liveIndices, index_t& rangeBeg, index_t& rangeEnd, index_t& objCount, index_t& nodeSlots) const
+    {
+        const Node* node = GetNode(nodeIndex);
+        nodeSlots += GetNodeOffset<FloatT, Dim>(node);
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            if (leafNode->GetPointsEndIndex() > leafNode->GetPointsBegIndex()) {
+                rangeBeg = std::min(rangeBeg, leafNode->GetPointsBegIndex());
+                rangeEnd = std::max(rangeEnd, leafNode->GetPointsEndIndex());
+            }
+            objCount += leafNode->GetPointsEndIndex() - leafNode->GetPointsBegIndex();
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                if (!IsDeleted(i))
+                    liveIndices.push_back(i);
+            }
+            return;
+        }
+        const InnerNode* innerNode = (const InnerNode*)node;
+        if (innerNode->HasLeftChild())
+            CollectSubtreeR(GetLeftChildIndex(nodeIndex), liveIndices, rangeBeg, rangeEnd, objCount, nodeSlots);
+        if (innerNode->GetRightChildIndex() != 0)
+            CollectSubtreeR(innerNode->GetRightChildIndex(), liveIndices, rangeBeg, rangeEnd, objCount, nodeSlots);
+    }
+
+    //! Rebuilds subtree of path[pathPos] from its live points. When the points of the subtree are contiguous, they are rebuilt in place,
+    //! otherwise live points are moved to the end of the points array. Nodes of the new subtree are appended to the nodes array
+    //! and linked from the parent, the old nodes stay unused until the next relayout or rebuild of the whole tree. Returns number of rebuilt point objects.
+    index_t RebuildSubtree(const std::vector<PathNode>& path, int pathPos)
+    {
+        const PathNode& pathNode = path[pathPos];
+        SubtreeCounts counts;
+        std::vector<index_t> liveIndices;
+        index_t rangeBeg = GetObjCount();
+        index_t rangeEnd = 0;
+        index_t nodeSlots = 0;
+        CollectSubtreeR(pathNode.nodeIndex, liveIndices, rangeBeg, rangeEnd, counts.objCount, nodeSlots);
+        counts.liveCount = (index_t)liveIndices.size();
+        _garbageNodeCount += nodeSlots;
+
+        index_t pointsBeg;
+        if (rangeEnd - rangeBeg == counts.objCount) {
+            // move live points to the begining of the range, the rest of the range stays deleted and unreferenced
+            std::sort(liveIndices.begin(), liveIndices.end());
+            pointsBeg = rangeBeg;
+            for (index_t i = 0; i < (index_t)liveIndices.size(); ++i)
+                _objs[rangeBeg + i] = _objs[liveIndices[i]];
+            for (index_t i = rangeBeg; i < rangeEnd && !_deleted.empty(); ++i) {
+                if (i < rangeBeg + counts.liveCount)
+                    _deleted[i >> 6] &= ~(((uint64_t)1) << (i & 63));
+                else
+                    _deleted[i >> 6] |= ((uint64_t)1) << (i & 63);
+            }
+        } else {
+            // copy live points to the end, their old positions become deleted
+            pointsBeg = GetObjCount();
+            _deleted.resize((_objs.size() + 63) / 64, 0);
+            for (index_t i : liveIndices) {
+                _objs.push_back(_objs[i]);
+                _deleted[i >> 6] |= ((uint64_t)1) << (i & 63);
+            }
+            _deletedCount += counts.liveCount;
+            _deleted.resize((_objs.size() + 63) / 64, 0);
+        }
+
+        index_t newIndex = BuildMidpointSplitTreeR({pathNode.box, _objs.data() + pointsBeg, _objs.data() + pointsBeg + counts.liveCount});
+
+        // link the new subtree from the parent
+        index_t parentIndex = path[pathPos - 1].nodeIndex;
+        InnerNode* parentNode = (InnerNode*)&_nodes[parentIndex];
+        if (!pathNode.isLeft)
+            parentNode->SetRightChildIndex(newIndex);
+        else if (newIndex == 0)
+            parentNode->SetLeftChild(false);
+        else
+            *((LinkNode*)&_nodes[parentIndex + GetNodeOffset<FloatT, Dim>(parentNode)]) = LinkNode(newIndex);
+
+        if (!_subtreeCounts.empty()) {
+            _subtreeCounts.resize(_nodes.size());
+            if constexpr (HasCategoryMask<ObjData>::value)
+                _categoryMasks.resize(_nodes.size());
+            if (newIndex != 0)
+                ComputeSubtreeCountsR(newIndex);
+            for (int i = 0; i < pathPos; ++i)
+                _subtreeCounts[path[i].nodeIndex].objCount -= counts.objCount - counts.liveCount;
+        }
+
+        if (_quantBits != 0) {
+            _quantPoints.resize(_objs.size() * Dim * _quantBits / 8);
+            if (newIndex != 0 && _quantBits == 8)
+                QuantizeLeafPointsR<uint8_t>(newIndex, pathNode.box);
+            else if (newIndex != 0)
+                QuantizeLeafPointsR<uint16_t>(newIndex, pathNode.box);
+        }
+        return counts.liveCount;
+    }
+
+    //! Rebuilds the whole tree from live points
+    void RebuildAll()
+    {
+        ObjArray objs(_objs.get_allocator());
+        objs.reserve(GetLiveObjCount());
+        for (index_t i = 0; i < GetObjCount(); ++i) {
+            if (!IsDeleted(i))
+                objs.push_back(_objs[i]);
+        }
+        _objs = std::move(objs);
+        _bbox = Box<FloatT, Dim>::GetBoundingBox(_objs);
+        _deleted.assign(_deleted.empty() ? 0 : (_objs.size() + 63) / 64, 0);
+        _deletedCount = 0;
+        _garbageNodeCount = 0;
+        _nodes.clear();
+        if (_objs.empty())
+            AddLeafNode(0, 0);
+        else
+            BuildMidpointSplitTreeR({_bbox, _objs.data(), _objs.data() + _objs.size()});
+        if (_quantBits != 0)
+            QuantizeLeafPoints(_quantBits);
+        if (!_subtreeCounts.empty())
+            ComputeSubtreeCounts();
+    }
+
+    //! Decodes quantized point into the centers of its quantization intervals, box is the box of its leaf
+    template<typename QuantT>
+    Vec<FloatT, Dim> DecodeQuantPoint(index_t index, const Box<FloatT, Dim>& box) const
+    {
+        constexpr int levels = 1 << (8 * sizeof(QuantT));
+        const std::array<QuantT, Dim>& quantPoint = *GetQuantPoint<QuantT>(index);
+        Vec<FloatT, Dim> point;
+        for (int d = 0; d < Dim; ++d) {
+            FloatT step = GetQuantStep(box.min[d], box.max[d], levels);
+            FloatT lo = GetQuantBound(box.min[d], box.max[d], step, quantPoint[d], levels);
+            FloatT hi = GetQuantBound(box.min[d], box.max[d], step, quantPoint[d] + 1, levels);
+            point[d] = lo + (hi - lo) / 2;
+        }
+        return point;
+    }
+
+    //! Quantizes points of leafs inside the subtree, box is the box of the node
+    template<typename QuantT>
+    void QuantizeLeafPointsR(index_t nodeIndex, const Box<FloatT, Dim>& box)
+    {
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF) {
+            constexpr int levels = 1 << (8 * sizeof(QuantT));
+            const LeafNode* leafNode = (const LeafNode*)node;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                std::array<QuantT, Dim>& quantPoint = ((std::array<QuantT, Dim>*)_quantPoints.data())[i];
+                for (int d = 0; d < Dim; ++d) {
+                    FloatT lo = box.min[d];
+                    FloatT hi = box.max[d];
+                    FloatT step = GetQuantStep(lo, hi, levels);
+                    FloatT value = _objs[i].point[d];
+                    int q = 0;
+                    // zero extent has single interval [lo, lo]
+                    if (step > 0) {
+                        q = (int)std::clamp<DistT<FloatT>>(((DistT<FloatT>)value - lo) / step, 0, levels - 1);
+                        // fix rounding errors, so that the value lies inside the interval computed by the search
+                        while (q > 0 && GetQuantBound(lo, hi, step, q, levels) > value)
+                            --q;
+                        while (q < levels - 1 && GetQuantBound(lo, hi, step, q + 1, levels) < value)
+                            ++q;
+                    }
+                    quantPoint[d] = (QuantT)q;
+                }
+            }
+            return;
+        }
+        ChildNodes<FloatT, Dim> childs = GetChildren(nodeIndex, box);
+        if (childs.leftIdx != 0)
+            QuantizeLeafPointsR<QuantT>(childs.leftIdx, childs.leftBox);
+        if (childs.rightIdx != 0)
+            QuantizeLeafPointsR<QuantT>(childs.rightIdx, childs.rightBox);
+    }
+
+    //! Copies the subtree into new nodes array in depth first order with compact shrink nodes, returns new index of the subtree root
+    index_t CompactShrinkNodesR(NodeArray& nodes, index_t nodeIndex, const Box<FloatT, Dim>& box) const
+    {
+        const Node* node = GetNode(nodeIndex);
+        index_t newIndex = (index_t)nodes.size();
+        if (node->GetType() == NodeType::LEAF) {
+            nodes.insert(nodes.end(), _nodes.begin() + nodeIndex, _nodes.begin() + nodeIndex + GetNodeOffset<FloatT, Dim>(node));
+            return newIndex;
+        }
+        ChildNodes<FloatT, Dim> childs = GetChildren(nodeIndex, box);
+        std::array<int, Dim> levels;
+        std::array<index_t, Dim> offsets;
+        if (node->GetType() == NodeType::SHRINK && CompactShrinkNode<Dim>::Encode(box, childs.leftBox, levels, offsets)) {
+            nodes.resize(newIndex + sizeof(CompactShrinkNode<Dim>) / sizeof(Node));
+            CompactShrinkNode<Dim>* compactNode = (CompactShrinkNode<Dim>*)&nodes[newIndex];
+            *compactNode = CompactShrinkNode<Dim>(levels, offsets);
+            compactNode->SetLeftChild(childs.leftIdx != 0);
+        } else {
+            nodes.insert(nodes.end(), _nodes.begin() + nodeIndex, _nodes.begin() + nodeIndex + GetNodeOffset<FloatT, Dim>(node));
+        }
+        // left child is written right after its parent
+        if (childs.leftIdx != 0)
+            CompactShrinkNodesR(nodes, childs.leftIdx, childs.leftBox);
+        if (childs.rightIdx != 0) {
+            index_t rightIndex = CompactShrinkNodesR(nodes, childs.rightIdx, childs.rightBox);
+            ((InnerNode*)&nodes[newIndex])->SetRightChildIndex(rightIndex);
+        }
+        return newIndex;
+    }
+
+    //! Gets number of Node elements occupied by node after relayout, including space for possible link to its left child
+    index_t GetRelayoutSize(index_t nodeIndex) const {
+        const Node* node = GetNode(nodeIndex);
+        index_t size = GetNodeOffset<FloatT, Dim>(node);
+        if (node->GetType() != NodeType::LEAF && ((const InnerNode*)node)->HasLeftChild())
+            ++size;
+        return size;
+    }
+
+    //! Computes number of Node elements occupied by each subtree when written in depth first order
+    index_t ComputeSubtreeSizesR(std::vector<index_t>& subtreeSizes, index_t nodeIndex) const {
+        const Node* node = GetNode(nodeIndex);
+        index_t size = GetNodeOffset<FloatT, Dim>(node);
+        if (node->GetType() != NodeType::LEAF) {
+            const InnerNode* innerNode = (const InnerNode*)node;
+            if (innerNode->HasLeftChild())
+                size += ComputeSubtreeSizesR(subtreeSizes, GetLeftChildIndex(nodeIndex));
+            if (innerNode->GetRightChildIndex() != 0)
+                size += ComputeSubtreeSizesR(subtreeSizes, innerNode->GetRightChildIndex());
+        }
+        subtreeSizes[nodeIndex] = size;
+        return size;
+    }
+
+    //! Appends all nodes of the subtree to the array in depth first order
+    void AppendPreorderR(std::vector<index_t>& order, index_t nodeIndex) const {
+        order.push_back(nodeIndex);
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF)
+            return;
+        const InnerNode* innerNode = (const InnerNode*)node;
+        if (innerNode->HasLeftChild())
+            AppendPreorderR(order, GetLeftChildIndex(nodeIndex));
+        if (innerNode->GetRightChildIndex() != 0)
+            AppendPreorderR(order, innerNode->GetRightChildIndex());
+    }
+
+    //! Appends selected nodes of the subtree to the array in depth first order
+    void AppendSelectedPreorderR(std::vector<index_t>& order, const std::vector<bool>& selected, index_t nodeIndex) const {
+        order.push_back(nodeIndex);
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF)
+            return;
+        const InnerNode* innerNode = (const InnerNode*)node;
+        if (innerNode->HasLeftChild() && selected[GetLeftChildIndex(nodeIndex)])
+            AppendSelectedPreorderR(order, selected, GetLeftChildIndex(nodeIndex));
+        if (innerNode->GetRightChildIndex() != 0 && selected[innerNode->GetRightChildIndex()])
+            AppendSelectedPreorderR(order, selected, innerNode->GetRightChildIndex());
+    }
+
+    //! Appends nodes of the subtree up to specified height to the array in van Emde Boas order
+    void AppendVanEmdeBoasR(std::vector<index_t>& order, index_t nodeIndex, int height) const {
+        if (height == 1) {
+            order.push_back(nodeIndex);
+            return;
+        }
+        int topHeight = height / 2;
+        AppendVanEmdeBoasR(order, nodeIndex, topHeight);
+        std::vector<index_t> bottomRoots;
+        AppendNodesAtDepthR(bottomRoots, nodeIndex, topHeight);
+        for (index_t bottomRoot : bottomRoots)
+            AppendVanEmdeBoasR(order, bottomRoot, height - topHeight);
+    }
+
+    //! Appends nodes of the subtree at specified depth to the array, from left to right
+    void AppendNodesAtDepthR(std::vector<index_t>& nodes, index_t nodeIndex, int depth) const {
+        if (depth == 0) {
+            nodes.push_back(nodeIndex);
+            return;
+        }
+        const Node* node = GetNode(nodeIndex);
+        if (node->GetType() == NodeType::LEAF)
+            return;
+        const InnerNode* innerNode = (const InnerNode*)node;
+        if (innerNode->HasLeftChild())
+            AppendNodesAtDepthR(nodes, GetLeftChildIndex(nodeIndex), depth - 1);
+        if (innerNode->GetRightChildIndex() != 0)
+            AppendNodesAtDepthR(nodes, innerNode->GetRightChildIndex(), depth - 1);
+    }
+
+    //! Rewrites the nodes array in the order given by blocks of node indices. Each block starts at a multiple of blockNodes (no alignment for 1).
+    //! All reachable nodes have to be present exactly once and the root has to be the first one.
+    //! Left child not placed right after its parent is referenced by link. Point objects are reordered in the order of leafs.
+    //! The new nodes and points arrays are allocated with specified alignment in bytes.
+    void Relayout(const std::vector<std::vector<index_t>>& blocks, index_t blockNodes, size_t alignment)
+    {
+        // compute new node positions
+        std::vector<index_t> newIndices(_nodes.size(), 0);
+        index_t nodesSize = 0;
+        for (const std::vector<index_t>& block : blocks) {
+            if (nodesSize % blockNodes != 0)
+                nodesSize += blockNodes - nodesSize % blockNodes;
+            for (int i = 0; i < (int)block.size(); ++i) {
+                newIndices[block[i]] = nodesSize;
+                nodesSize += GetNodeOffset<FloatT, Dim>(GetNode(block[i]));
+                const Node* node = GetNode(block[i]);
+                if (node->GetType() != NodeType::LEAF && ((const InnerNode*)node)->HasLeftChild()) {
+                    bool leftFollows = i + 1 < (int)block.size() && block[i + 1] == GetLeftChildIndex(block[i]);
+                    if (!leftFollows)
+                        ++nodesSize;
+                }
+            }
+        }
+        // copy nodes to new positions, fix child references and reorder point objects
+        NodeArray nodes(nodesSize, Node(), AlignedAllocator<Node>(alignment));
+        ObjArray objs{AlignedAllocator<PointObjT>(alignment)};
+        objs.reserve(_objs.size());
+        for (const std::vector<index_t>& block : blocks) {
+            for (index_t oldIndex : block) {
+                const Node* node = GetNode(oldIndex);
+                index_t newIndex = newIndices[oldIndex];
+                index_t nodeSize = GetNodeOffset<FloatT, Dim>(node);
+                std::copy(_nodes.begin() + oldIndex, _nodes.begin() + oldIndex + nodeSize, nodes.begin() + newIndex);
+                if (node->GetType() == NodeType::LEAF) {
+                    const LeafNode* leafNode = (const LeafNode*)node;
+                    index_t pointsBeg = (index_t)objs.size();
+                    for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                        if (!IsDeleted(i))
+                            objs.push_back(_objs[i]);
+                    }
+                    *((LeafNode*)&nodes[newIndex]) = LeafNode(pointsBeg, (index_t)objs.size());
+                } else {
+                    const InnerNode* innerNode = (const InnerNode*)node;
+                    InnerNode* newInnerNode = (InnerNode*)&nodes[newIndex];
+                    if (innerNode->GetRightChildIndex() != 0)
+                        newInnerNode->SetRightChildIndex(newIndices[innerNode->GetRightChildIndex()]);
+                    if (innerNode->HasLeftChild()) {
+                        index_t newLeftIndex = newIndices[GetLeftChildIndex(oldIndex)];
+                        if (newLeftIndex != newIndex + nodeSize)
+                            *((LinkNode*)&nodes[newIndex + nodeSize]) = LinkNode(newLeftIndex);
+                    }
+                }
+            }
+        }
+        _nodes = std::move(nodes);
+        _objs = std::move(objs);
+        _quantPoints = std::vector<uint8_t, AlignedAllocator<uint8_t>>(AlignedAllocator<uint8_t>(alignment));
+        if (_quantBits != 0)
+            QuantizeLeafPoints(_quantBits);
+        // deleted points and unused nodes were dropped
+        _deleted.assign(_deleted.empty() ? 0 : (_objs.size() + 63) / 64, 0);
+        _deletedCount = 0;
+        _garbageNodeCount = 0;
+        if (!_subtreeCounts.empty())
+            ComputeSubtreeCounts();
+    }
+
     //! Gets tree statistics recursively
     void GetStatsR(BBDTreeIntermediateStats& stats, index_t nodeIndex, int depth) const {
         const Node* node = GetNode(nodeIndex);
@@ -469,7 +1732,7 @@ private:
             }
 
             if (innerNode->HasLeftChild())
-                GetStatsR(stats, nodeIndex + GetNodeOffset<FloatT, Dim>(node->GetType()), depth + 1);
+                GetStatsR(stats, GetLeftChildIndex(nodeIndex), depth + 1);
             else
                 ++stats.nullCount;
             
@@ -0,0 +1,315 @@
+#ifndef AKNN_CLOSEST_PAIR_H
+#define AKNN_CLOSEST_PAIR_H
+
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <type_traits>
+#include <vector>
+#include <algorithm>
+#include <shared_mutex>
+
+#include "search.h"
+#include "parallel.h"
+
+//! Pair of point objects of two trees with distance between them
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty>
+struct ObjPair
+{
+    //! distance between the objects (reduced distance of the metric, see metric.h)
+    DistT<FloatT> dist;
+    //! point object of the first tree
+    PointObj<FloatT, Dim, ObjDataA> a;
+    //! point object of the second tree
+    PointObj<FloatT, Dim, ObjDataB> b;
+};
+
+//! Comparator for ObjPair objects
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty>
+struct ObjPairCompare
+{
+    bool operator()(const ObjPair<FloatT, Dim, ObjDataA, ObjDataB>& p1, const ObjPair<FloatT, Dim, ObjDataA, ObjDataB>& p2) const {
+        return p1.dist < p2.dist;
+    }
+};
+
+//! Naive search of k closest pairs between two arrays of point objects, sorted by distance
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty, typename MetricT = L2Metric>
+std::vector<ObjPair<FloatT, Dim, ObjDataA, ObjDataB>> LinearFindKClosestPairs(const std::vector<PointObj<FloatT, Dim, ObjDataA>>& objsA, const std::vector<PointObj<FloatT, Dim, ObjDataB>>& objsB, int k,
+                                                                               const MetricT& metric = MetricT())
+{
+    std::vector<ObjPair<FloatT, Dim, ObjDataA, ObjDataB>> pairs;
+    for (const PointObj<FloatT, Dim, ObjDataA>& a : objsA) {
+        for (const PointObj<FloatT, Dim, ObjDataB>& b : objsB)
+            pairs.push_back({a.point.Distance(b.point, metric), a, b});
+    }
+    k = std::min(std::max(k, 0), (int)pairs.size());
+    std::partial_sort(pairs.begin(), pairs.begin() + k, pairs.end(), ObjPairCompare<FloatT, Dim, ObjDataA, ObjDataB>());
+    pairs.resize(k);
+    return pairs;
+}
+
+//! Dual traversal of two BBD trees searching for k closest pairs of their point objects. Pairs of nodes whose boxes are farther than
+//! the k-th best pair found so far (divided by the relax factor of epsilon) are pruned, the larger node of the pair is split first. The traversal is started
+//! from pairs of subtrees near the roots in parallel, the threads share the best bound. Used inside FindKAproximateClosestPairs.
+template<typename FloatT, int Dim, typename ObjDataA, typename ObjDataB, typename MetricT>
+class ClosestPairsTraversal
+{
+public:
+    using ObjPairT = ObjPair<FloatT, Dim, ObjDataA, ObjDataB>;
+
+    ClosestPairsTraversal(const BBDTree<FloatT, Dim, ObjDataA>& treeA, const BBDTree<FloatT, Dim, ObjDataB>& treeB, EpsilonT<FloatT> epsilon, const MetricT& metric)
+        : _treeA(&treeA), _treeB(&treeB), _relaxFactor(metric.RelaxFactor(epsilon)), _metric(metric), _sharedBound(std::numeric_limits<double>::infinity()) {}
+
+    //! Finds k aproximate closest pairs sorted by distance
+    std::vector<ObjPairT> Find(int k, int threadCount)
+    {
+        if (k <= 0 || _treeA->GetObjCount() == 0 || _treeB->GetObjCount() == 0)
+            return {};
+        if (threadCount <= 0)
+            threadCount = GetDefaultThreadCount();
+
+        // about 16 subtree pairs per thread, so the threads finishing their pairs early take the remaining ones
+        size_t frontierSize = 1;
+        while (threadCount > 1 && frontierSize * frontierSize < (size_t)threadCount * 16)
+            ++frontierSize;
+        std::vector<Subtree> subtreesA = GetFrontier(*_treeA, frontierSize);
+        std::vector<Subtree> subtreesB = GetFrontier(*_treeB, frontierSize);
+        std::vector<SubtreePair> subtreePairs;
+        for (index_t a = 0; a < (index_t)subtreesA.size(); ++a) {
+            for (index_t b = 0; b < (index_t)subtreesB.size(); ++b)
+                subtreePairs.push_back({subtreesA[a].box.Distance(subtreesB[b].box, _metric), a, b});
+        }
+        // the closest subtree pairs are searched first, so that the bound is tight early
+        std::sort(subtreePairs.begin(), subtreePairs.end(), [](const SubtreePair& p1, const SubtreePair& p2) { return p1.dist < p2.dist; });
+
+        std::vector<HeapPriQueue<ObjPairT>> queues(threadCount);
+        for (HeapPriQueue<ObjPairT>& queue : queues)
+            queue.Init(k, ObjPairCompare<FloatT, Dim, ObjDataA, ObjDataB>());
+        ParallelFor(subtreePairs.size(), threadCount, [&](size_t pairIdx, int thread) {
+            const SubtreePair& subtreePair = subtreePairs[pairIdx];
+            const Subtree& subtreeA = subtreesA[subtreePair.a];
+            const Subtree& subtreeB = subtreesB[subtreePair.b];
+            // both trees may be the same object, then its lock is taken only once
+            std::shared_lock<std::shared_mutex> lockA = _treeA->LockLazyLeafs();
+            std::shared_lock<std::shared_mutex> ownLockB;
+            if ((const void*)_treeA != (const void*)_treeB)
+                ownLockB = _treeB->LockLazyLeafs();
+            std::shared_lock<std::shared_mutex>& lockB = (const void*)_treeA != (const void*)_treeB ? ownLockB : lockA;
+            SearchR(subtreeA.nodeIdx, subtreeA.box, subtreeB.nodeIdx, subtreeB.box, subtreePair.dist, queues[thread], lockA, lockB);
+        }, 1);
+
+        std::vector<ObjPairT> result;
+        for (const HeapPriQueue<ObjPairT>& queue : queues)
+            result.insert(result.end(), queue.GetData(), queue.GetData() + queue.GetSize());
+        k = std::min(k, (int)result.size());
+        std::partial_sort(result.begin(), result.begin() + k, result.end(), ObjPairCompare<FloatT, Dim, ObjDataA, ObjDataB>());
+        result.resize(k);
+        return result;
+    }
+
+private:
+    //! Root of subtree with its box
+    struct Subtree
+    {
+        index_t nodeIdx;
+        Box<FloatT, Dim> box;
+    };
+    //! Pair of subtrees of the frontiers and distance of their boxes
+    struct SubtreePair
+    {
+        DistT<FloatT> dist;
+        index_t a;
+        index_t b;
+    };
+
+    //! Expands lazy leaf if needed and gets the node. Lock of the other tree is released during the expansion too,
+    //! otherwise two threads expanding leafs of different trees would wait for each other.
+    template<typename ObjData>
+    static const Node* GetExpandedNode(const BBDTree<FloatT, Dim, ObjData>& tree, index_t nodeIdx, const Box<FloatT, Dim>& box, std::shared_lock<std::shared_mutex>& lazyLock,
+                                       std::shared_lock<std::shared_mutex>& otherLock)
+    {
+        const Node* node = tree.GetNode(nodeIdx);
+        if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+            bool releaseOther = &otherLock != &lazyLock && otherLock.owns_lock();
+            if (releaseOther)
+                otherLock.unlock();
+            tree.ExpandLazyLeaf(nodeIdx, box, lazyLock);
+            if (releaseOther)
+                otherLock.lock();
+            node = tree.GetNode(nodeIdx);
+        }
+        return node;
+    }
+
+    //! Gets child subtrees of inner node (same boxes as in the searches), returns their count
+    template<typename ObjData>
+    static int GetChilds(const BBDTree<FloatT, Dim, ObjData>& tree, index_t nodeIdx, const Box<FloatT, Dim>& box, Subtree childs[2])
+    {
+        ChildNodes<FloatT, Dim> nodeChilds = tree.GetChildren(nodeIdx, box);
+        int count = 0;
+        if (nodeChilds.leftIdx != 0)
+            childs[count++] = {nodeChilds.leftIdx, nodeChilds.leftBox};
+        if (nodeChilds.rightIdx != 0)
+            childs[count++] = {nodeChilds.rightIdx, nodeChilds.rightBox};
+        return count;
+    }
+
+    //! Splits subtrees of the tree breadth first until there are at least minSize of them or only leafs are left
+    template<typename ObjData>
+    static std::vector<Subtree> GetFrontier(const BBDTree<FloatT, Dim, ObjData>& tree, size_t minSize)
+    {
+        std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+        std::vector<Subtree> frontier = {{0, tree.GetBBox()}};
+        bool split = true;
+        while (frontier.size() < minSize && split) {
+            split = false;
+            std::vector<Subtree> next;
+            for (const Subtree& subtree : frontier) {
+                const Node* node = GetExpandedNode(tree, subtree.nodeIdx, subtree.box, lazyLock, lazyLock);
+                if (node->GetType() == NodeType::LEAF) {
+                    next.push_back(subtree);
+                    continue;
+                }
+                Subtree childs[2];
+                int childCount = GetChilds(tree, subtree.nodeIdx, subtree.box, childs);
+                next.insert(next.end(), childs, childs + childCount);
+                split = true;
+            }
+            frontier = std::move(next);
+        }
+        return frontier;
+    }
+
+    //! Gets k-th best distance of the thread or of other thread, whichever is smaller
+    DistT<FloatT> GetBound(const HeapPriQueue<ObjPairT>& queue) const
+    {
+        double sharedBound = _sharedBound.load(std::memory_order_relaxed);
+        DistT<FloatT> bound = sharedBound >= (double)GetMaxValue<DistT<FloatT>>() ? GetMaxValue<DistT<FloatT>>() : (DistT<FloatT>)sharedBound;
+        return queue.IsFull() ? std::min(bound, queue.GetLast().dist) : bound;
+    }
+
+    //! Publishes k-th best distance of the thread to the other threads
+    void UpdateSharedBound(DistT<FloatT> dist)
+    {
+        // rounded up, so that the shared bound never prunes pairs closer than the distance
+        double value = (double)dist;
+        if constexpr (!std::is_floating_point_v<DistT<FloatT>>) {
+            if (value < (double)GetMaxValue<DistT<FloatT>>() && (DistT<FloatT>)value < dist)
+                value = std::nextafter(value, std::numeric_limits<double>::infinity());
+        }
+        double bound = _sharedBound.load(std::memory_order_relaxed);
+        while (value < bound && !_sharedBound.compare_exchange_weak(bound, value, std::memory_order_relaxed));
+    }
+
+    //! Pushes closest pairs of objects of two leafs into the queue
+    void ScanLeafs(const LeafNode* leafA, const LeafNode* leafB, const Box<FloatT, Dim>& boxB, HeapPriQueue<ObjPairT>& queue)
+    {
+        DistT<FloatT> bound = GetBound(queue);
+        for (index_t i = leafA->GetPointsBegIndex(); i < leafA->GetPointsEndIndex(); ++i) {
+            if (_treeA->IsDeleted(i))
+                continue;
+            const PointObj<FloatT, Dim, ObjDataA>* objA = _treeA->GetObj(i);
+            if (boxB.Distance(objA->point, _metric) > bound / _relaxFactor)
+                continue;
+            for (index_t j = leafB->GetPointsBegIndex(); j < leafB->GetPointsEndIndex(); ++j) {
+                if (_treeB->IsDeleted(j))
+                    continue;
+                const PointObj<FloatT, Dim, ObjDataB>* objB = _treeB->GetObj(j);
+                DistT<FloatT> dist = objA->point.Distance(objB->point, _metric);
+                if (queue.IsFull() && dist >= queue.GetLast().dist)
+                    continue;
+                queue.Push({dist, *objA, *objB});
+                if (queue.IsFull()) {
+                    UpdateSharedBound(queue.GetLast().dist);
+                    bound = GetBound(queue);
+                }
+            }
+        }
+    }
+
+    void SearchR(index_t nodeIdxA, const Box<FloatT, Dim>& boxA, index_t nodeIdxB, const Box<FloatT, Dim>& boxB, DistT<FloatT> dist, HeapPriQueue<ObjPairT>& queue,
+                 std::shared_lock<std::shared_mutex>& lockA, std::shared_lock<std::shared_mutex>& lockB)
+    {
+        if (dist > GetBound(queue) / _relaxFactor)
+            return;
+        GetExpandedNode(*_treeA, nodeIdxA, boxA, lockA, lockB);
+        const Node* nodeB = GetExpandedNode(*_treeB, nodeIdxB, boxB, lockB, lockA);
+        // both locks may be released during the expansions, so the first node is read after them
+        const Node* nodeA = _treeA->GetNode(nodeIdxA);
+        bool isLeafA = nodeA->GetType() == NodeType::LEAF;
+        bool isLeafB = nodeB->GetType() == NodeType::LEAF;
+        if (isLeafA && isLeafB) {
+            ScanLeafs((const LeafNode*)nodeA, (const LeafNode*)nodeB, boxB, queue);
+            return;
+        }
+
+        // the larger node is split, so that the boxes of the pairs shrink evenly
+        bool splitA = !isLeafA && (isLeafB || boxA.GetSize(boxA.GetSplitDim()) >= boxB.GetSize(boxB.GetSplitDim()));
+        Subtree childs[2];
+        int childCount = splitA ? GetChilds(*_treeA, nodeIdxA, boxA, childs) : GetChilds(*_treeB, nodeIdxB, boxB, childs);
+        DistT<FloatT> childDists[2];
+        for (int i = 0; i < childCount; ++i)
+            childDists[i] = splitA ? childs[i].box.Distance(boxB, _metric) : boxA.Distance(childs[i].box, _metric);
+        if (childCount == 2 && childDists[1] < childDists[0]) {
+            std::swap(childs[0], childs[1]);
+            std::swap(childDists[0], childDists[1]);
+        }
+        // expansion of lazy leafs inside the first pair may reallocate the nodes, so the nodes aren't accessed after it
+        for (int i = 0; i < childCount; ++i) {
+            if (splitA)
+                SearchR(childs[i].nodeIdx, childs[i].box, nodeIdxB, boxB, childDists[i], queue, lockA, lockB);
+            else
+                SearchR(nodeIdxA, boxA, childs[i].nodeIdx, childs[i].box, childDists[i], queue, lockA, lockB);
+        }
+    }
+
+    const BBDTree<FloatT, Dim, ObjDataA>* _treeA;
+    const BBDTree<FloatT, Dim, ObjDataB>* _treeB;
+    //! Allowed ratio of reduced distances of the found and the exact pairs (see MetricT::RelaxFactor)
+    EpsilonT<FloatT> _relaxFactor;
+    MetricT _metric;
+    //! Smallest k-th best distance of all threads, rounded up to double, because atomics of 128 bit integer distances aren't lock free
+    std::atomic<double> _sharedBound;
+};
+
+//! Finds k aproximate closest pairs of point objects between two BBD trees (bichromatic closest pairs) sorted by distance, metric is distance policy (see metric.h).
+//! The i-th pair is within sqrt(1 + epsilon) times the distance of the exact i-th closest pair, as in the nearest neighbor searches (see metric.h).
+//! Pairs of subtrees near the roots are searched in parallel from threadCount threads (all hardware threads when threadCount <= 0).
+//! Returns no pairs when any of the trees doesn't keep the exact points (see BBDTree::HasExactPoints).
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty, typename MetricT = L2Metric>
+std::vector<ObjPair<FloatT, Dim, ObjDataA, ObjDataB>> FindKAproximateClosestPairs(const BBDTree<FloatT, Dim, ObjDataA>& treeA, const BBDTree<FloatT, Dim, ObjDataB>& treeB, int k, EpsilonT<FloatT> epsilon,
+                                                                                   int threadCount = 0, const MetricT& metric = MetricT())
+{
+    if (!treeA.HasExactPoints() || !treeB.HasExactPoints())
+        return {};
+    ClosestPairsTraversal<FloatT, Dim, ObjDataA, ObjDataB, MetricT> traversal(treeA, treeB, epsilon, metric);
+    return traversal.Find(k, threadCount);
+}
+//! Finds k closest pairs of point objects between two BBD trees sorted by distance
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty, typename MetricT = L2Metric>
+std::vector<ObjPair<FloatT, Dim, ObjDataA, ObjDataB>> FindKClosestPairs(const BBDTree<FloatT, Dim, ObjDataA>& treeA, const BBDTree<FloatT, Dim, ObjDataB>& treeB, int k,
+                                                                         int threadCount = 0, const MetricT& metric = MetricT())
+{
+    return FindKAproximateClosestPairs(treeA, treeB, k, 0, threadCount, metric);
+}
+//! Finds aproximate closest pair of point objects between two BBD trees. Distance of the pair is max value when any of the trees is empty
+//! or doesn't keep the exact points.
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty, typename MetricT = L2Metric>
+ObjPair<FloatT, Dim, ObjDataA, ObjDataB> FindAproximateClosestPair(const BBDTree<FloatT, Dim, ObjDataA>& treeA, const BBDTree<FloatT, Dim, ObjDataB>& treeB, EpsilonT<FloatT> epsilon,
+                                                                   int threadCount = 0, const MetricT& metric = MetricT())
+{
+    std::vector<ObjPair<FloatT, Dim, ObjDataA, ObjDataB>> pairs = FindKAproximateClosestPairs(treeA, treeB, 1, epsilon, threadCount, metric);
+    if (pairs.empty())
+        return {GetMaxValue<DistT<FloatT>>(), PointObj<FloatT, Dim, ObjDataA>(), PointObj<FloatT, Dim, ObjDataB>()};
+    return pairs[0];
+}
+//! Finds closest pair of point objects between two BBD trees. Distance of the pair is max value when any of the trees is empty
+//! or doesn't keep the exact points.
+template<typename FloatT, int Dim, typename ObjDataA = Empty, typename ObjDataB = Empty, typename MetricT = L2Metric>
+ObjPair<FloatT, Dim, ObjDataA, ObjDataB> FindClosestPair(const BBDTree<FloatT, Dim, ObjDataA>& treeA, const BBDTree<FloatT, Dim, ObjDataB>& treeB, int threadCount = 0, const MetricT& metric = MetricT())
+{
+    return FindAproximateClosestPair(treeA, treeB, 0, threadCount, metric);
+}
+
+#endif // AKNN_CLOSEST_PAIR_H
@@ -0,0 +1,322 @@
+#ifndef AKNN_DBSCAN_H
+#define AKNN_DBSCAN_H
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+#include <memory>
+
+#include "search.h"
+#include "parallel.h"
+
+//! Disjoint sets of indices [0, size), which can be united from multiple threads. Roots of the sets are their smallest indices.
+class ConcurrentUnionFind
+{
+public:
+    explicit ConcurrentUnionFind(index_t size) : _parents(new std::atomic<index_t>[size]), _size(size)
+    {
+        for (index_t i = 0; i < size; ++i)
+            _parents[i].store(i, std::memory_order_relaxed);
+    }
+
+    index_t GetSize() const { return _size; }
+
+    //! Finds root of the set containing index, halving the path to the root
+    index_t Find(index_t index)
+    {
+        index_t parent = _parents[index].load(std::memory_order_relaxed);
+        while (parent != index) {
+            index_t grandParent = _parents[parent].load(std::memory_order_relaxed);
+            // other threads may have changed the parent meanwhile, the grandparent is still in the same set
+            _parents[index].compare_exchange_weak(parent, grandParent, std::memory_order_relaxed);
+            index = parent;
+            parent = _parents[index].load(std::memory_order_relaxed);
+        }
+        return index;
+    }
+
+    //! Unites sets containing specified indices, returns false if they were already in the same set
+    bool Unite(index_t a, index_t b)
+    {
+        while (true) {
+            a = Find(a);
+            b = Find(b);
+            if (a == b)
+                return false;
+            if (a < b)
+                std::swap(a, b);
+            // link the larger root under the smaller one, retry when other thread linked it first
+            index_t expected = a;
+            if (_parents[a].compare_exchange_strong(expected, b, std::memory_order_relaxed))
+                return true;
+        }
+    }
+
+private:
+    std::unique_ptr<std::atomic<index_t>[]> _parents;
+    index_t _size;
+};
+
+//! Density based clustering (DBSCAN) of the point objects of BBD tree. Point is core point when at least minPoints points (including itself)
+//! are within radius, clusters are connected components of core points within radius of each other, border points join cluster of a core point
+//! within radius and the other points are noise. The phases are run separately (e.g. to measure them) or by Run.
+//! Core points are found by range counting of the tree. Clusters and border points are resolved between pairs of leafs within radius:
+//! all core points of a leaf whose points are within radius of each other are united at once, pairs of leafs whose points are all within radius
+//! are united without distance computations and the points are compared only between the remaining pairs. Leafs are processed in parallel.
+//! Labels are indexed as the point objects of the tree (see BBDTree::GetObj). The tree must not be modified while it is clustered.
+//! Trees without exact points (see BBDTree::HasExactPoints) aren't supported, all their points are labeled as noise.
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class DBSCAN
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    //! Label of noise points (and removed points of the tree)
+    static constexpr int NOISE = -1;
+
+    //! Prepares clustering of the tree, countEpsilon relaxes the range counting of core point test (see CountAproximateRange),
+    //! so some points with neighbors only within distance (1 + countEpsilon) * radius may become core points.
+    DBSCAN(const BBDTreeT& tree, FloatT radius, int minPoints, EpsilonT<FloatT> countEpsilon = 0, int threadCount = 0)
+        : _tree(&tree), _radius(radius), _radiusDist(Square<DistT<FloatT>>(radius)), _minPoints(minPoints), _countEpsilon(countEpsilon), _threadCount(threadCount),
+          _unionFind(tree.GetObjCount())
+    {
+        if (!tree.HasExactPoints())
+            return;
+        // expands all lazy leafs, so the leafs are searched later without the lock
+        ForEachLeaf(tree, [this](const LeafNode* leafNode, const Box<FloatT, Dim>&) {
+            Leaf leaf{leafNode->GetPointsBegIndex(), leafNode->GetPointsEndIndex(), Box<FloatT, Dim>(), 0, GetNoIndex()};
+            for (index_t i = leaf.begIndex; i < leaf.endIndex; ++i) {
+                if (!_tree->IsDeleted(i)) {
+                    leaf.box.Include(_tree->GetObj(i)->point);
+                    ++leaf.liveCount;
+                }
+            }
+            if (leaf.liveCount > 0)
+                _leafs.push_back(leaf);
+        });
+        // leafs are found by their first point object
+        std::sort(_leafs.begin(), _leafs.end(), [](const Leaf& a, const Leaf& b) { return a.begIndex < b.begIndex; });
+    }
+
+    //! Marks core points. Points of leafs whose points are within radius of each other are core points without range counting when the leaf has enough points.
+    void FindCorePoints()
+    {
+        _isCore.assign(_tree->GetObjCount(), 0);
+        ParallelFor(_leafs.size(), _threadCount, [&](size_t leafIdx, int) {
+            Leaf& leaf = _leafs[leafIdx];
+            bool denseLeaf = IsDense(leaf) && leaf.liveCount >= (index_t)_minPoints;
+            leaf.firstCore = GetNoIndex();
+            for (index_t i = leaf.begIndex; i < leaf.endIndex; ++i) {
+                if (!_tree->IsDeleted(i))
+                    _isCore[i] = denseLeaf || CountAproximateRange(*_tree, _tree->GetObj(i)->point, _radius, _countEpsilon) >= (index_t)_minPoints;
+                if (_isCore[i] && leaf.firstCore == GetNoIndex())
+                    leaf.firstCore = i;
+            }
+        });
+    }
+
+    //! Unites core points within radius of each other, requires FindCorePoints
+    void ClusterCorePoints()
+    {
+        ParallelFor(_leafs.size(), _threadCount, [&](size_t leafIdx, int) {
+            const Leaf& leaf = _leafs[leafIdx];
+            if (leaf.firstCore == GetNoIndex())
+                return;
+            if (IsDense(leaf)) {
+                for (index_t i = leaf.firstCore + 1; i < leaf.endIndex; ++i) {
+                    if (_isCore[i])
+                        _unionFind.Unite(leaf.firstCore, i);
+                }
+            } else {
+                UniteClosePoints(leaf, leaf);
+            }
+            // each pair of leafs is found from both sides, it's enough to unite it from the one with smaller points
+            ForEachCoreLeafWithin(leaf.box, [&](const Leaf& other) {
+                if (other.begIndex > leaf.begIndex)
+                    UniteLeafPair(leaf, other);
+            });
+        });
+    }
+
+    //! Assigns border points to cluster of their nearest core point and computes the labels, requires ClusterCorePoints
+    void AssignBorderPoints()
+    {
+        std::vector<index_t> roots(_tree->GetObjCount(), GetNoIndex());
+        ParallelFor(_leafs.size(), _threadCount, [&](size_t leafIdx, int) {
+            const Leaf& leaf = _leafs[leafIdx];
+            bool hasBorderCandidates = false;
+            for (index_t i = leaf.begIndex; i < leaf.endIndex; ++i) {
+                if (_isCore[i])
+                    roots[i] = _unionFind.Find(i);
+                else
+                    hasBorderCandidates = hasBorderCandidates || !_tree->IsDeleted(i);
+            }
+            if (!hasBorderCandidates)
+                return;
+            // nearest core points of the other points of the leaf, searched in the leafs within radius
+            std::vector<DistT<FloatT>> nearestDists(leaf.endIndex - leaf.begIndex, GetMaxValue<DistT<FloatT>>());
+            std::vector<index_t> nearest(leaf.endIndex - leaf.begIndex, GetNoIndex());
+            ForEachCoreLeafWithin(leaf.box, [&](const Leaf& other) {
+                for (index_t i = leaf.begIndex; i < leaf.endIndex; ++i) {
+                    const Vec<FloatT, Dim>& point = _tree->GetObj(i)->point;
+                    if (_isCore[i] || _tree->IsDeleted(i) || other.box.SquaredDistance(point) > _radiusDist)
+                        continue;
+                    for (index_t j = other.firstCore; j < other.endIndex; ++j) {
+                        if (!_isCore[j])
+                            continue;
+                        DistT<FloatT> dist = point.DistSquared(_tree->GetObj(j)->point);
+                        if (dist <= _radiusDist && dist < nearestDists[i - leaf.begIndex]) {
+                            nearestDists[i - leaf.begIndex] = dist;
+                            nearest[i - leaf.begIndex] = j;
+                        }
+                    }
+                }
+            });
+            for (index_t i = leaf.begIndex; i < leaf.endIndex; ++i) {
+                if (nearest[i - leaf.begIndex] != GetNoIndex())
+                    roots[i] = _unionFind.Find(nearest[i - leaf.begIndex]);
+            }
+        });
+
+        // clusters are numbered in order of their first point objects
+        _labels.assign(_tree->GetObjCount(), NOISE);
+        _clusterCount = 0;
+        std::vector<int> rootLabels(_tree->GetObjCount(), NOISE);
+        for (index_t i = 0; i < _tree->GetObjCount(); ++i) {
+            if (roots[i] == GetNoIndex())
+                continue;
+            if (rootLabels[roots[i]] == NOISE)
+                rootLabels[roots[i]] = _clusterCount++;
+            _labels[i] = rootLabels[roots[i]];
+        }
+    }
+
+    //! Runs all phases of the clustering, returns false when the tree doesn't keep the exact points
+    bool Run()
+    {
+        FindCorePoints();
+        ClusterCorePoints();
+        AssignBorderPoints();
+        return _tree->HasExactPoints();
+    }
+
+    //! Gets cluster labels in [0, GetClusterCount()) or NOISE, indexed as the point objects of the tree
+    const std::vector<int>& GetLabels() const { return _labels; }
+    //! True if point object with specified index is core point
+    bool IsCorePoint(index_t index) const { return _isCore[index]; }
+    int GetClusterCount() const { return _clusterCount; }
+    //! Gets number of leafs, which are processed in parallel
+    size_t GetLeafCount() const { return _leafs.size(); }
+
+private:
+    //! Range of point objects of leaf with bounding box of its live points
+    struct Leaf
+    {
+        index_t begIndex;
+        index_t endIndex;
+        Box<FloatT, Dim> box;
+        index_t liveCount;
+        //! First core point of the leaf, computed by FindCorePoints
+        index_t firstCore;
+    };
+
+    static index_t GetNoIndex() { return GetMaxValue<index_t>(); }
+
+    //! True if all points of the leaf are within radius of each other
+    bool IsDense(const Leaf& leaf) const { return leaf.box.MaxDistance(leaf.box, L2Metric()) <= _radiusDist; }
+
+    //! Calls func(const Leaf&) for each leaf with core points whose box is within radius of box
+    template<typename FuncT>
+    void ForEachCoreLeafWithin(const Box<FloatT, Dim>& box, FuncT func) const
+    {
+        ForEachCoreLeafWithinR(0, _tree->GetBBox(), box, func);
+    }
+    template<typename FuncT>
+    void ForEachCoreLeafWithinR(index_t nodeIdx, const Box<FloatT, Dim>& nodeBox, const Box<FloatT, Dim>& box, FuncT& func) const
+    {
+        if (nodeBox.Distance(box, L2Metric()) > _radiusDist)
+            return;
+        const Node* node = _tree->GetNode(nodeIdx);
+        if (node->GetType() == NodeType::LEAF) {
+            index_t begIndex = ((const LeafNode*)node)->GetPointsBegIndex();
+            if (((const LeafNode*)node)->GetPointsEndIndex() == begIndex)
+                return;
+            auto it = std::lower_bound(_leafs.begin(), _leafs.end(), begIndex, [](const Leaf& leaf, index_t index) { return leaf.begIndex < index; });
+            if (it != _leafs.end() && it->begIndex == begIndex && it->firstCore != GetNoIndex() && it->box.Distance(box, L2Metric()) <= _radiusDist)
+                func(*it);
+            return;
+        }
+        ChildNodes<FloatT, Dim> childs = _tree->GetChildren(nodeIdx, nodeBox);
+        if (childs.leftIdx != 0)
+            ForEachCoreLeafWithinR(childs.leftIdx, childs.leftBox, box, func);
+        if (childs.rightIdx != 0)
+            ForEachCoreLeafWithinR(childs.rightIdx, childs.rightBox, box, func);
+    }
+
+    //! Unites core points of different leafs within radius
+    void UniteLeafPair(const Leaf& leaf, const Leaf& other)
+    {
+        if (leaf.box.MaxDistance(other.box, L2Metric()) <= _radiusDist) {
+            // all core points are within radius of the core points of the other leaf
+            for (index_t i = leaf.firstCore; i < leaf.endIndex; ++i) {
+                if (_isCore[i])
+                    _unionFind.Unite(i, other.firstCore);
+            }
+            for (index_t j = other.firstCore; j < other.endIndex; ++j) {
+                if (_isCore[j])
+                    _unionFind.Unite(leaf.firstCore, j);
+            }
+        } else if (IsDense(leaf)) {
+            UniteWithDenseLeaf(leaf, other);
+        } else if (IsDense(other)) {
+            UniteWithDenseLeaf(other, leaf);
+        } else {
+            UniteClosePoints(leaf, other);
+        }
+    }
+
+    //! Unites core points of other leaf with core points of dense leaf, which are already united, so one close pair per point is enough
+    void UniteWithDenseLeaf(const Leaf& denseLeaf, const Leaf& other)
+    {
+        for (index_t j = other.firstCore; j < other.endIndex; ++j) {
+            const Vec<FloatT, Dim>& point = _tree->GetObj(j)->point;
+            if (!_isCore[j] || denseLeaf.box.SquaredDistance(point) > _radiusDist || _unionFind.Find(j) == _unionFind.Find(denseLeaf.firstCore))
+                continue;
+            for (index_t i = denseLeaf.firstCore; i < denseLeaf.endIndex; ++i) {
+                if (_isCore[i] && point.DistSquared(_tree->GetObj(i)->point) <= _radiusDist) {
+                    _unionFind.Unite(i, j);
+                    break;
+                }
+            }
+        }
+    }
+
+    //! Unites core points of the leafs within radius by comparing the points, the leafs may be the same leaf
+    void UniteClosePoints(const Leaf& leaf, const Leaf& other)
+    {
+        for (index_t i = leaf.firstCore; i < leaf.endIndex; ++i) {
+            const Vec<FloatT, Dim>& point = _tree->GetObj(i)->point;
+            if (!_isCore[i] || other.box.SquaredDistance(point) > _radiusDist)
+                continue;
+            for (index_t j = (&leaf == &other ? i + 1 : other.firstCore); j < other.endIndex; ++j) {
+                if (_isCore[j] && point.DistSquared(_tree->GetObj(j)->point) <= _radiusDist)
+                    _unionFind.Unite(i, j);
+            }
+        }
+    }
+
+    const BBDTreeT* _tree;
+    FloatT _radius;
+    DistT<FloatT> _radiusDist;
+    int _minPoints;
+    EpsilonT<FloatT> _countEpsilon;
+    int _threadCount;
+    std::vector<Leaf> _leafs;
+    //! Core flags of the point objects, bytes rather than bits, so that threads writing flags of different points don't race
+    std::vector<uint8_t> _isCore;
+    ConcurrentUnionFind _unionFind;
+    std::vector<int> _labels;
+    int _clusterCount = 0;
+};
+
+#endif // AKNN_DBSCAN_H
@@ -0,0 +1,205 @@
+#ifndef AKNN_KDE_H
+#define AKNN_KDE_H
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <shared_mutex>
+
+#include "search.h"
+#include "parallel.h"
+
+//! Gaussian kernel exp(-d^2 / (2 h^2)) of squared distance
+inline double GaussianKernel(double distSquared, double bandwidth)
+{
+    return std::exp(-distSquared / (2 * bandwidth * bandwidth));
+}
+
+//! Normalization of the gaussian kernel density of pointCount points, so the density integrates to 1
+inline double GaussianKernelNorm(int dim, double bandwidth, double pointCount)
+{
+    return 1.0 / (pointCount * std::pow(2 * 3.14159265358979323846, dim / 2.0) * std::pow(bandwidth, dim));
+}
+
+//! Naive linear gaussian kernel density estimate at query point
+template<typename FloatT, int Dim, typename ObjData = Empty>
+double LinearKernelDensity(const std::vector<PointObj<FloatT, Dim, ObjData>>& objs, const Vec<FloatT, Dim>& queryPoint, double bandwidth)
+{
+    if (objs.empty())
+        return 0;
+    double sum = 0;
+    for (const PointObj<FloatT, Dim, ObjData>& obj : objs)
+        sum += GaussianKernel((double)queryPoint.DistSquared(obj.point), bandwidth);
+    return sum * GaussianKernelNorm(Dim, bandwidth, (double)objs.size());
+}
+
+//! Gaussian kernel density estimation accelerated by BBD tree. Keeps live point count and centroid of each node of the tree.
+//! Kernel values of all points of a node are bounded by kernel values at the nearest and farthest point of the node box.
+//! Subtrees whose bounds are close enough are approximated by their count and centroid, so the estimate is within specified relative error,
+//! while the query visits only the cells whose kernel values change a lot (near the boundary of the bandwidth).
+//! The tree is fully expanded when lazy and must not be modified while the estimator is used. Trees without exact points (see BBDTree::HasExactPoints)
+//! aren't supported, the estimates are then 0.
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class KernelDensityEstimator
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    KernelDensityEstimator(const BBDTreeT& tree, double bandwidth)
+        : _tree(&tree), _bandwidth(bandwidth)
+    {
+        if (tree.GetObjCount() == 0 || !tree.HasExactPoints())
+            return;
+        std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+        ComputeNodeStatsR(0, tree.GetBBox(), lazyLock);
+    }
+
+    double GetBandwidth() const { return _bandwidth; }
+
+    //! Estimates density at query point, the result is within (1 +- relativeError) times the exact density
+    template<bool measureStats = false>
+    double Estimate(const Vec<FloatT, Dim>& queryPoint, double relativeError, TraversalStats<FloatT, Dim>& stats) const
+    {
+        if (_nodeStats.empty() || _nodeStats[0].count == 0)
+            return 0;
+        double pointCount = (double)_nodeStats[0].count;
+        const Box<FloatT, Dim>& bbox = _tree->GetBBox();
+        double minKernel = GaussianKernel((double)bbox.MaxSquaredDistance(queryPoint), _bandwidth);
+        double maxKernel = GaussianKernel((double)bbox.SquaredDistance(queryPoint), _bandwidth);
+        // lower bound of the kernel sum, refined as the nodes are visited
+        double lowerBound = pointCount * minKernel;
+        double sum = EstimateR<measureStats>(queryPoint, 0, bbox, minKernel, maxKernel, relativeError / pointCount, lowerBound, stats);
+        return sum * GaussianKernelNorm(Dim, _bandwidth, pointCount);
+    }
+    //! Estimates density at query point, the result is within (1 +- relativeError) times the exact density
+    double Estimate(const Vec<FloatT, Dim>& queryPoint, double relativeError = 0) const
+    {
+        TraversalStats<FloatT, Dim> dummyStats;
+        return Estimate<false>(queryPoint, relativeError, dummyStats);
+    }
+
+    //! Estimates density at each query point in parallel (all hardware threads when threadCount <= 0), the result buffer is resized and reused
+    void EstimateBatch(const std::vector<Vec<FloatT, Dim>>& queryPoints, double relativeError, std::vector<double>& result, int threadCount = 0) const
+    {
+        result.resize(queryPoints.size());
+        ParallelFor(queryPoints.size(), threadCount, [&](size_t i, int) { result[i] = Estimate(queryPoints[i], relativeError); });
+    }
+
+private:
+    //! Live point count and centroid of the subtree
+    struct NodeStats
+    {
+        index_t count = 0;
+        Vec<double, Dim> centroid;
+    };
+
+    void ComputeNodeStatsR(index_t nodeIdx, const Box<FloatT, Dim>& box, std::shared_lock<std::shared_mutex>& lazyLock)
+    {
+        const Node* node = _tree->GetNode(nodeIdx);
+        if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+            _tree->ExpandLazyLeaf(nodeIdx, box, lazyLock);
+            node = _tree->GetNode(nodeIdx);
+        }
+        NodeStats stats;
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                if (_tree->IsDeleted(i))
+                    continue;
+                for (int d = 0; d < Dim; ++d)
+                    stats.centroid[d] += (double)_tree->GetObj(i)->point[d];
+                ++stats.count;
+            }
+        } else {
+            ChildNodes<FloatT, Dim> childs = _tree->GetChildren(nodeIdx, box);
+            for (index_t childIdx : {childs.leftIdx, childs.rightIdx}) {
+                if (childIdx == 0)
+                    continue;
+                ComputeNodeStatsR(childIdx, childIdx == childs.leftIdx ? childs.leftBox : childs.rightBox, lazyLock);
+                const NodeStats& childStats = _nodeStats[childIdx];
+                for (int d = 0; d < Dim; ++d)
+                    stats.centroid[d] += childStats.centroid[d] * childStats.count;
+                stats.count += childStats.count;
+            }
+        }
+        if (stats.count != 0) {
+            for (int d = 0; d < Dim; ++d)
+                stats.centroid[d] /= stats.count;
+        }
+        if (nodeIdx >= (index_t)_nodeStats.size())
+            _nodeStats.resize(nodeIdx + 1);
+        _nodeStats[nodeIdx] = stats;
+    }
+
+    //! Returns (approximate) kernel sum of the subtree, minKernel and maxKernel bound kernel values of its points.
+    //! Subtree is approximated when its error is within tolerance (relative error divided by the point count) times lower bound of the total sum,
+    //! so the errors of all approximated subtrees sum to at most relative error times the total sum.
+    template<bool measureStats>
+    double EstimateR(const Vec<FloatT, Dim>& queryPoint, index_t nodeIdx, const Box<FloatT, Dim>& box, double minKernel, double maxKernel,
+                     double tolerance, double& lowerBound, TraversalStats<FloatT, Dim>& stats) const
+    {
+        if (measureStats)
+            ++stats.traversalSteps;
+        const NodeStats& nodeStats = _nodeStats[nodeIdx];
+        if (nodeStats.count == 0)
+            return 0;
+        if (maxKernel - minKernel <= tolerance * lowerBound) {
+            double centroidDist = 0;
+            for (int d = 0; d < Dim; ++d)
+                centroidDist += Square(nodeStats.centroid[d] - (double)queryPoint[d]);
+            return nodeStats.count * std::clamp(GaussianKernel(centroidDist, _bandwidth), minKernel, maxKernel);
+        }
+
+        const Node* node = _tree->GetNode(nodeIdx);
+        if (node->GetType() == NodeType::LEAF) {
+            if (measureStats)
+                ++stats.visitedLeafs;
+            const LeafNode* leafNode = (const LeafNode*)node;
+            double sum = 0;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                if (!_tree->IsDeleted(i))
+                    sum += GaussianKernel((double)queryPoint.DistSquared(_tree->GetObj(i)->point), _bandwidth);
+            }
+            lowerBound += sum - nodeStats.count * minKernel;
+            return sum;
+        }
+
+        ChildNodes<FloatT, Dim> childs = _tree->GetChildren(nodeIdx, box);
+        double leftMin = 0, leftMax = 0, rightMin = 0, rightMax = 0;
+        index_t leftCount = 0, rightCount = 0;
+        if (childs.leftIdx != 0) {
+            leftMin = GaussianKernel((double)childs.leftBox.MaxSquaredDistance(queryPoint), _bandwidth);
+            leftMax = GaussianKernel((double)childs.leftBox.SquaredDistance(queryPoint), _bandwidth);
+            leftCount = _nodeStats[childs.leftIdx].count;
+        }
+        if (childs.rightIdx != 0) {
+            rightMin = GaussianKernel((double)childs.rightBox.MaxSquaredDistance(queryPoint), _bandwidth);
+            rightMax = GaussianKernel((double)childs.rightBox.SquaredDistance(queryPoint), _bandwidth);
+            rightCount = _nodeStats[childs.rightIdx].count;
+        }
+        // child boxes are inside the node box, so their bounds are tighter
+        lowerBound += leftCount * leftMin + rightCount * rightMin - nodeStats.count * minKernel;
+
+        // closer child first, so the lower bound grows before the farther child is tested
+        double sum = 0;
+        if (leftMax >= rightMax) {
+            if (leftCount != 0)
+                sum += EstimateR<measureStats>(queryPoint, childs.leftIdx, childs.leftBox, leftMin, leftMax, tolerance, lowerBound, stats);
+            if (rightCount != 0)
+                sum += EstimateR<measureStats>(queryPoint, childs.rightIdx, childs.rightBox, rightMin, rightMax, tolerance, lowerBound, stats);
+        } else {
+            if (rightCount != 0)
+                sum += EstimateR<measureStats>(queryPoint, childs.rightIdx, childs.rightBox, rightMin, rightMax, tolerance, lowerBound, stats);
+            if (leftCount != 0)
+                sum += EstimateR<measureStats>(queryPoint, childs.leftIdx, childs.leftBox, leftMin, leftMax, tolerance, lowerBound, stats);
+        }
+        return sum;
+    }
+
+    const BBDTreeT* _tree;
+    double _bandwidth;
+    //! Statistics of the nodes indexed by node index
+    std::vector<NodeStats> _nodeStats;
+};
+
+#endif // AKNN_KDE_H
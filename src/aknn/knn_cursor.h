@@ -0,0 +1,141 @@
+#ifndef AKNN_KNN_CURSOR_H
+#define AKNN_KNN_CURSOR_H
+
+#include <vector>
+#include <algorithm>
+#include <shared_mutex>
+
+#include "search.h"
+
+//! Warm started kNN search for sequences of nearby query points (finger search). The cursor remembers the path of nodes from the root
+//! to the leaf containing the last query point and the last found neighbors. Next search starts from the deepest node of the path
+//! whose box contains the new query point, the subtrees hanging off the path above it are queued by their distance,
+//! so the nodes of the path aren't visited again. Distances of the last neighbors to the new query point bound the search,
+//! because the k-th nearest neighbor can't be farther than the k-th closest of them. The results are the same as of FindKAproximateNearestNeighbors.
+//! The tree has to outlive the cursor, Reset has to be called after the tree is modified (lazy trees are expanded as usual).
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class KNearestNeighborsCursor
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    explicit KNearestNeighborsCursor(const BBDTreeT& tree) : _tree(&tree) {}
+
+    //! Forgets the path and the last neighbors, next search starts from the root
+    void Reset()
+    {
+        _path.clear();
+        _lastPoints.clear();
+    }
+
+    //! Finds k aproximate nearest neighbors starting from the last path, metric is distance policy (see metric.h)
+    template<bool measureStats = false, typename MetricT = L2Metric>
+    std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue,
+                                                                                TraversalStats<FloatT, Dim>& stats, const MetricT& metric = MetricT())
+    {
+        aknnQueue.Init(k, DistObjCompare<FloatT, Dim, ObjData>());
+        if (_tree->GetObjCount() == 0)
+            return {};
+        std::shared_lock<std::shared_mutex> lazyLock = _tree->LockLazyLeafs();
+        if (_path.empty())
+            _path.push_back({0, _tree->GetBBox(), 0, Box<FloatT, Dim>()});
+        // the deepest node containing the query point, the root stays even if the query point is outside
+        while (_path.size() > 1 && !_path.back().box.Includes(queryPoint))
+            _path.pop_back();
+        Descend<measureStats>(queryPoint, lazyLock, stats);
+
+        // the last neighbors are real point objects, so the k-th nearest neighbor isn't farther than k-th closest of them
+        DistT<FloatT> maxDist = GetMaxValue<DistT<FloatT>>();
+        if ((int)_lastPoints.size() >= k && k > 0) {
+            _lastDists.clear();
+            for (const Vec<FloatT, Dim>& point : _lastPoints)
+                _lastDists.push_back(queryPoint.Distance(point, metric));
+            std::nth_element(_lastDists.begin(), _lastDists.begin() + (k - 1), _lastDists.end());
+            maxDist = _lastDists[k - 1];
+        }
+
+        DistNodePriQueue<FloatT, Dim> nodeQueue;
+        nodeQueue.push({_path.back().box.Distance(queryPoint, metric), _path.back().nodeIdx, _path.back().box});
+        for (size_t i = 1; i < _path.size(); ++i) {
+            const PathNode& pathNode = _path[i];
+            if (pathNode.siblingIdx == 0)
+                continue;
+            DistT<FloatT> siblingDist = pathNode.siblingBox.Distance(queryPoint, metric);
+            if (siblingDist <= maxDist)
+                nodeQueue.push({siblingDist, pathNode.siblingIdx, pathNode.siblingBox});
+        }
+        SearchNodeQueueKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(*_tree, queryPoint, epsilon, nodeQueue, lazyLock, aknnQueue, stats, metric, maxDist);
+
+        std::vector<PointObj<FloatT, Dim, ObjData>> result = DistObjsToPointObjs(aknnQueue.GetValues());
+        _lastPoints.clear();
+        for (const PointObj<FloatT, Dim, ObjData>& obj : result)
+            _lastPoints.push_back(obj.point);
+        return result;
+    }
+    //! Finds k aproximate nearest neighbors starting from the last path
+    std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue)
+    {
+        TraversalStats<FloatT, Dim> dummyStats;
+        return FindKAproximateNearestNeighbors<false>(queryPoint, k, epsilon, aknnQueue, dummyStats);
+    }
+    //! Finds k nearest neighbors starting from the last path
+    std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighbors(const Vec<FloatT, Dim>& queryPoint, int k, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue)
+    {
+        return FindKAproximateNearestNeighbors(queryPoint, k, 0, knnQueue);
+    }
+
+    //! Gets depth of the remembered leaf, 0 before the first search
+    int GetPathDepth() const { return _path.empty() ? 0 : (int)_path.size() - 1; }
+
+private:
+    //! Node of the path with its box and the other child of its parent, which isn't on the path (index 0 when there is none)
+    struct PathNode
+    {
+        index_t nodeIdx;
+        Box<FloatT, Dim> box;
+        index_t siblingIdx;
+        Box<FloatT, Dim> siblingBox;
+    };
+
+    //! Extends the path by the childs containing the query point until leaf is reached, the new nodes count as traversal steps
+    template<bool measureStats>
+    void Descend(const Vec<FloatT, Dim>& queryPoint, std::shared_lock<std::shared_mutex>& lazyLock, TraversalStats<FloatT, Dim>& stats)
+    {
+        while (true) {
+            index_t nodeIdx = _path.back().nodeIdx;
+            Box<FloatT, Dim> box = _path.back().box;
+            const Node* node = _tree->GetNode(nodeIdx);
+            if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+                _tree->ExpandLazyLeaf(nodeIdx, box, lazyLock);
+                node = _tree->GetNode(nodeIdx);
+            }
+            if (node->GetType() == NodeType::LEAF)
+                return;
+
+            ChildNodes<FloatT, Dim> childs = _tree->GetChildren(nodeIdx, box);
+            // the outer child of shrink node has the box of the node, so the inner child is preferred
+            if (childs.leftIdx != 0 && childs.leftBox.Includes(queryPoint))
+                _path.push_back({childs.leftIdx, childs.leftBox, childs.rightIdx, childs.rightBox});
+            else if (childs.rightIdx != 0 && childs.rightBox.Includes(queryPoint))
+                _path.push_back({childs.rightIdx, childs.rightBox, childs.leftIdx, childs.leftBox});
+            else
+                return;
+            if (measureStats)
+            {
+                ++stats.traversalSteps;
+                stats.visitedNodes.push_back(box);
+                RecordTouchedPages(*_tree, nodeIdx, stats);
+            }
+        }
+    }
+
+    const BBDTreeT* _tree;
+    //! Nodes from the root to the leaf containing the last query point
+    std::vector<PathNode> _path;
+    //! Points of the last found neighbors
+    std::vector<Vec<FloatT, Dim>> _lastPoints;
+    //! Buffer of distances of the last neighbors to the query point
+    std::vector<DistT<FloatT>> _lastDists;
+};
+
+#endif // AKNN_KNN_CURSOR_H
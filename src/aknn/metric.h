@@ -0,0 +1,89 @@
+#ifndef AKNN_METRIC_H
+#define AKNN_METRIC_H
+
+#include <array>
+#include <cmath>
+#include <algorithm>
+#include <type_traits>
+
+#include "vec.h"
+
+// Metric policies of the searches (see search.h), Vec::Distance and Box::Distance. Each metric compares reduced distances,
+// which are monotonic in the true distance and cheaper to compute (e.g. squared distance for L2). The reduced distance is a fold of per-axis differences by Accumulate,
+// which is shared by point distances and box lower bounds, so the box bound is never greater than the distance of any point inside the box.
+// Epsilon of aproximate searches is translated by RelaxFactor to the factor of the reduced distance, so for every metric the search returns points
+// within sqrt(1 + epsilon) times the distance of the exact result, same as (1 + epsilon) times the squared distance for the default L2 metric.
+
+//! Squared euclidean distance, the default metric of all searches
+struct L2Metric
+{
+    //! Adds difference at specified axis to the reduced distance
+    template<typename T>
+    T Accumulate(T dist, T diff, int) const { return dist + diff * diff; }
+    //! Converts distance (e.g. search radius) to the reduced distance
+    template<typename FloatT>
+    DistT<FloatT> Reduce(FloatT dist) const { return Square<DistT<FloatT>>(dist); }
+    //! Converts epsilon of aproximate searches to the allowed ratio of reduced distances
+    template<typename EpsT>
+    EpsT RelaxFactor(EpsT epsilon) const { return 1 + epsilon; }
+};
+
+//! Manhattan distance, sum of absolute differences
+struct L1Metric
+{
+    template<typename T>
+    T Accumulate(T dist, T diff, int) const { return dist + (diff < 0 ? -diff : diff); }
+    template<typename FloatT>
+    DistT<FloatT> Reduce(FloatT dist) const { return dist; }
+    template<typename EpsT>
+    EpsT RelaxFactor(EpsT epsilon) const { return (EpsT)std::sqrt(1 + epsilon); }
+};
+
+//! Chebyshev distance, maximum of absolute differences
+struct LInfMetric
+{
+    template<typename T>
+    T Accumulate(T dist, T diff, int) const { return std::max(dist, diff < 0 ? -diff : diff); }
+    template<typename FloatT>
+    DistT<FloatT> Reduce(FloatT dist) const { return dist; }
+    template<typename EpsT>
+    EpsT RelaxFactor(EpsT epsilon) const { return (EpsT)std::sqrt(1 + epsilon); }
+};
+
+//! Squared euclidean distance with per-axis weights, equal to L2 distance of points with coordinates scaled by sqrt(weights).
+//! Only for floating point coordinates.
+template<int Dim>
+struct WeightedL2Metric
+{
+    //! Non-negative weights of the axes
+    std::array<double, Dim> weights;
+
+    template<typename T>
+    T Accumulate(T dist, T diff, int d) const {
+        static_assert(std::is_floating_point_v<T>, "WeightedL2Metric requires floating point coordinates");
+        return dist + (T)weights[d] * diff * diff;
+    }
+    template<typename FloatT>
+    DistT<FloatT> Reduce(FloatT dist) const { return Square<DistT<FloatT>>(dist); }
+    template<typename EpsT>
+    EpsT RelaxFactor(EpsT epsilon) const { return 1 + epsilon; }
+};
+
+//! Minkowski distance of order p >= 1, the reduced distance is sum of absolute differences raised to p. Only for floating point coordinates.
+struct MinkowskiMetric
+{
+    //! Order of the metric
+    double p = 2;
+
+    template<typename T>
+    T Accumulate(T dist, T diff, int) const {
+        static_assert(std::is_floating_point_v<T>, "MinkowskiMetric requires floating point coordinates");
+        return dist + (T)std::pow(std::abs(diff), p);
+    }
+    template<typename FloatT>
+    DistT<FloatT> Reduce(FloatT dist) const { return (DistT<FloatT>)std::pow(std::abs(dist), p); }
+    template<typename EpsT>
+    EpsT RelaxFactor(EpsT epsilon) const { return (EpsT)std::pow(1 + epsilon, p / 2); }
+};
+
+#endif // AKNN_METRIC_H
@@ -0,0 +1,122 @@
+#ifndef AKNN_NN_ITERATOR_H
+#define AKNN_NN_ITERATOR_H
+
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <shared_mutex>
+
+#include "search.h"
+
+//! Incremental nearest neighbor search, each call of Next returns the next closest point object to the query point.
+//! Best first traversal of the nodes is merged with queue of points found inside visited leafs, so the state carries over between calls
+//! and the work done for first k neighbors matches single search for k nearest neighbors. Useful when k isn't known ahead,
+//! e.g. when neighbors are requested until some condition on ObjData holds.
+//! The tree has to outlive the iterator and must not be modified while it is used (lazy trees are expanded as usual).
+//! Metric is distance policy (see metric.h), returned distances are reduced distances of the metric.
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+class NearestNeighborIterator
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    //! Starts search of the tree. With epsilon > 0 the returned points may be out of order,
+    //! each point is at most sqrt(1 + epsilon) times farther than the closest point not returned yet (see metric.h).
+    NearestNeighborIterator(const BBDTreeT& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon = 0, const MetricT& metric = MetricT())
+        : _tree(&tree), _metric(metric)
+    {
+        Reset(queryPoint, epsilon);
+    }
+
+    //! Starts new search from specified query point, the allocated queues are reused
+    void Reset(const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon = 0)
+    {
+        _queryPoint = queryPoint;
+        _relaxFactor = _metric.RelaxFactor(epsilon);
+        _traversalSteps = 0;
+        while (!_nodeQueue.empty())
+            _nodeQueue.pop();
+        _pointQueue.clear();
+        _decodedObjs.clear();
+        _nodeQueue.push({_tree->GetBBox().Distance(queryPoint, _metric), 0, _tree->GetBBox()});
+    }
+
+    //! Finds next nearest point object together with its reduced distance, returns false when all point objects were returned
+    bool Next(DistObj<FloatT, Dim, ObjData>& next)
+    {
+        std::shared_lock<std::shared_mutex> lazyLock = _tree->LockLazyLeafs();
+        // visit nodes until the closest found point is closer than any unvisited node
+        while (!_nodeQueue.empty() && (_pointQueue.empty() || _pointQueue.front().dist > _nodeQueue.top().dist * _relaxFactor))
+        {
+            DistNode<FloatT, Dim> distNode = _nodeQueue.top();
+            _nodeQueue.pop();
+            ++_traversalSteps;
+
+            const Node* node = _tree->GetNode(distNode.nodeIdx);
+            if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+                _tree->ExpandLazyLeaf(distNode.nodeIdx, distNode.box, lazyLock);
+                node = _tree->GetNode(distNode.nodeIdx);
+            }
+            if (node->GetType() == NodeType::LEAF)
+            {
+                const LeafNode* leafNode = (const LeafNode*)node;
+                for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                    if (_tree->IsDeleted(i))
+                        continue;
+                    if (_tree->HasExactPoints()) {
+                        _pointQueue.push_back({_queryPoint.Distance(_tree->GetObj(i)->point, _metric), i});
+                    } else {
+                        // the leaf box is needed to decode the point, so decoded points are kept until they are returned
+                        _decodedObjs.push_back(_tree->GetDecodedObj(i, distNode.box));
+                        _pointQueue.push_back({_queryPoint.Distance(_decodedObjs.back().point, _metric), (index_t)_decodedObjs.size() - 1});
+                    }
+                    std::push_heap(_pointQueue.begin(), _pointQueue.end(), DistIndexCompare());
+                }
+            }
+            else
+            {
+                PushChildsToNodeQueue(*_tree, _queryPoint, distNode, _nodeQueue, _metric);
+            }
+        }
+        if (_pointQueue.empty())
+            return false;
+
+        std::pop_heap(_pointQueue.begin(), _pointQueue.end(), DistIndexCompare());
+        DistIndex distIndex = _pointQueue.back();
+        _pointQueue.pop_back();
+        next.dist = distIndex.dist;
+        next.obj = _tree->HasExactPoints() ? *_tree->GetObj(distIndex.index) : _decodedObjs[distIndex.index];
+        return true;
+    }
+
+    //! Gets number of nodes visited since the start of the search
+    int GetTraversalSteps() const { return _traversalSteps; }
+
+private:
+    //! Point object found inside visited leaf, referenced by its index (index into _decodedObjs when the tree doesn't keep the exact points)
+    struct DistIndex
+    {
+        DistT<FloatT> dist;
+        index_t index;
+    };
+    //! Comparator of min-heap of points
+    struct DistIndexCompare
+    {
+        bool operator()(const DistIndex& a, const DistIndex& b) const { return a.dist > b.dist; }
+    };
+
+    const BBDTreeT* _tree;
+    MetricT _metric;
+    Vec<FloatT, Dim> _queryPoint;
+    //! Allowed ratio of reduced distances of the returned point and the closest unvisited node (see MetricT::RelaxFactor)
+    EpsilonT<FloatT> _relaxFactor = 1;
+    //! Nodes which weren't visited yet
+    DistNodePriQueue<FloatT, Dim> _nodeQueue;
+    //! Points of visited leafs which weren't returned yet, min-heap by distance
+    std::vector<DistIndex> _pointQueue;
+    //! Decoded point objects of visited leafs of trees without exact points (see BBDTree::GetDecodedObj)
+    std::vector<PointObj<FloatT, Dim, ObjData>> _decodedObjs;
+    int _traversalSteps = 0;
+};
+
+#endif // AKNN_NN_ITERATOR_H
@@ -0,0 +1,135 @@
+#ifndef AKNN_NORMALS_H
+#define AKNN_NORMALS_H
+
+#include <cmath>
+#include <array>
+#include <vector>
+#include <algorithm>
+
+#include "search.h"
+#include "parallel.h"
+
+//! Finds unit eigenvector of the smallest eigenvalue of symmetric 3x3 matrix {a00, a01, a02, a11, a12, a22}.
+//! Eigenvalues are computed in closed form, the eigenvector is the largest cross product of rows of (A - smallest eigenvalue * I).
+inline std::array<double, 3> GetSmallestEigenVector(const std::array<double, 6>& a)
+{
+    double a00 = a[0], a01 = a[1], a02 = a[2], a11 = a[3], a12 = a[4], a22 = a[5];
+    double offDiagonal = a01 * a01 + a02 * a02 + a12 * a12;
+    double trace = (a00 + a11 + a22) / 3;
+    double p = std::sqrt(((a00 - trace) * (a00 - trace) + (a11 - trace) * (a11 - trace) + (a22 - trace) * (a22 - trace) + 2 * offDiagonal) / 6);
+    if (offDiagonal == 0 || p == 0) {
+        // diagonal matrix, the eigenvectors are the axes
+        int axis = a00 <= a11 ? (a00 <= a22 ? 0 : 2) : (a11 <= a22 ? 1 : 2);
+        std::array<double, 3> res = {0, 0, 0};
+        res[axis] = 1;
+        return res;
+    }
+    double b00 = (a00 - trace) / p, b11 = (a11 - trace) / p, b22 = (a22 - trace) / p;
+    double b01 = a01 / p, b02 = a02 / p, b12 = a12 / p;
+    double halfDet = (b00 * (b11 * b22 - b12 * b12) - b01 * (b01 * b22 - b12 * b02) + b02 * (b01 * b12 - b11 * b02)) / 2;
+    double phi = std::acos(std::clamp(halfDet, -1.0, 1.0)) / 3;
+    double smallest = trace + 2 * p * std::cos(phi + 2 * 3.14159265358979323846 / 3);
+
+    std::array<std::array<double, 3>, 3> rows = {{{a00 - smallest, a01, a02}, {a01, a11 - smallest, a12}, {a02, a12, a22 - smallest}}};
+    auto cross = [](const std::array<double, 3>& u, const std::array<double, 3>& v) {
+        return std::array<double, 3>{u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0]};
+    };
+    auto lengthSquared = [](const std::array<double, 3>& u) { return u[0] * u[0] + u[1] * u[1] + u[2] * u[2]; };
+    std::array<std::array<double, 3>, 3> crosses = {cross(rows[0], rows[1]), cross(rows[0], rows[2]), cross(rows[1], rows[2])};
+    std::array<double, 3> best = crosses[0];
+    for (int i = 1; i < 3; ++i) {
+        if (lengthSquared(crosses[i]) > lengthSquared(best))
+            best = crosses[i];
+    }
+    if (lengthSquared(best) <= 1e-24 * Square(p * p)) {
+        // the smallest eigenvalue is double (e.g. points on a line), any vector perpendicular to the largest row fits
+        std::array<double, 3> row = rows[0];
+        for (int i = 1; i < 3; ++i) {
+            if (lengthSquared(rows[i]) > lengthSquared(row))
+                row = rows[i];
+        }
+        int axis = std::abs(row[0]) <= std::abs(row[1]) ? (std::abs(row[0]) <= std::abs(row[2]) ? 0 : 2) : (std::abs(row[1]) <= std::abs(row[2]) ? 1 : 2);
+        std::array<double, 3> axisVec = {0, 0, 0};
+        axisVec[axis] = 1;
+        best = cross(row, axisVec);
+    }
+    double length = std::sqrt(lengthSquared(best));
+    return {best[0] / length, best[1] / length, best[2] / length};
+}
+
+//! Fits normal to the points of the neighborhood as eigenvector of the smallest eigenvalue of their covariance. The sign of the normal is arbitrary.
+template<typename FloatT, typename ObjData>
+Vec<FloatT, 3> FitNormal(const DistObj<FloatT, 3, ObjData>* beg, const DistObj<FloatT, 3, ObjData>* end)
+{
+    if (beg == end)
+        return Vec<FloatT, 3>(0);
+    std::array<double, 3> mean = {0, 0, 0};
+    for (const DistObj<FloatT, 3, ObjData>* it = beg; it != end; ++it) {
+        for (int d = 0; d < 3; ++d)
+            mean[d] += (double)it->obj.point[d];
+    }
+    for (int d = 0; d < 3; ++d)
+        mean[d] /= (double)(end - beg);
+    std::array<double, 6> covariance = {0, 0, 0, 0, 0, 0};
+    for (const DistObj<FloatT, 3, ObjData>* it = beg; it != end; ++it) {
+        double x = (double)it->obj.point[0] - mean[0];
+        double y = (double)it->obj.point[1] - mean[1];
+        double z = (double)it->obj.point[2] - mean[2];
+        covariance[0] += x * x;
+        covariance[1] += x * y;
+        covariance[2] += x * z;
+        covariance[3] += y * y;
+        covariance[4] += y * z;
+        covariance[5] += z * z;
+    }
+    std::array<double, 3> normal = GetSmallestEigenVector(covariance);
+    return Vec<FloatT, 3>({(FloatT)normal[0], (FloatT)normal[1], (FloatT)normal[2]});
+}
+
+//! Estimates normals of all point objects of the tree from their k aproximate nearest neighbors (including the point itself) and calls
+//! func(const PointObj&, const Vec<FloatT, 3>& normal) for each of them, concurrently from threadCount threads (all hardware threads when threadCount <= 0).
+//! Leafs are distributed to the threads in depth first order, so consecutive searches of one thread visit the same nodes.
+//! The normals are fitted directly from the search queues, the neighborhoods aren't stored.
+//! Returns false without calling func when the tree doesn't keep the exact points (see BBDTree::HasExactPoints).
+template<typename FloatT, typename ObjData, typename FuncT>
+bool EstimateTreeNormals(const BBDTree<FloatT, 3, ObjData>& tree, int k, FuncT func, int threadCount = 0, EpsilonT<FloatT> epsilon = 0)
+{
+    if (!tree.HasExactPoints())
+        return false;
+    std::vector<std::pair<index_t, index_t>> leafs;
+    ForEachLeaf(tree, [&leafs](const LeafNode* leafNode, const Box<FloatT, 3>&) {
+        leafs.push_back({leafNode->GetPointsBegIndex(), leafNode->GetPointsEndIndex()});
+    });
+    if (threadCount <= 0)
+        threadCount = GetDefaultThreadCount();
+    std::vector<HeapPriQueue<DistObj<FloatT, 3, ObjData>>> queues(threadCount);
+    ParallelFor(leafs.size(), threadCount, [&](size_t leafIdx, int thread) {
+        FixedPriQueue<DistObj<FloatT, 3, ObjData>>& queue = queues[thread];
+        TraversalStats<FloatT, 3> dummyStats;
+        for (index_t i = leafs[leafIdx].first; i < leafs[leafIdx].second; ++i) {
+            if (tree.IsDeleted(i))
+                continue;
+            const PointObj<FloatT, 3, ObjData>& obj = *tree.GetObj(i);
+            queue.Init(k, DistObjCompare<FloatT, 3, ObjData>());
+            SearchKAproximateNearestNeighbors<FloatT, 3, ObjData>(tree, obj.point, epsilon, queue, dummyStats);
+            func(obj, FitNormal(queue.GetData(), queue.GetData() + queue.GetSize()));
+        }
+    });
+    return true;
+}
+
+//! Estimates normal of each point of the cloud from its k nearest neighbors and stores it by setNormal(ObjData&, const Vec<FloatT, 3>& normal).
+//! Builds temporary tree of the points with their indices in the cloud, setNormal is called concurrently for different points.
+template<typename FloatT, typename ObjData, typename SetNormalFuncT>
+void EstimateNormals(std::vector<PointObj<FloatT, 3, ObjData>>& cloud, int k, SetNormalFuncT setNormal, int threadCount = 0, int leafSize = 10)
+{
+    std::vector<PointObj<FloatT, 3, index_t>> indexedPoints(cloud.size());
+    for (size_t i = 0; i < cloud.size(); ++i)
+        indexedPoints[i] = {cloud[i].point, (index_t)i};
+    BBDTree<FloatT, 3, index_t> tree = BBDTree<FloatT, 3, index_t>::BuildMidpointSplitTree(leafSize, indexedPoints);
+    EstimateTreeNormals(tree, k, [&](const PointObj<FloatT, 3, index_t>& obj, const Vec<FloatT, 3>& normal) {
+        setNormal(cloud[obj.data].data, normal);
+    }, threadCount);
+}
+
+#endif // AKNN_NORMALS_H
@@ -0,0 +1,47 @@
+#ifndef AKNN_PARALLEL_H
+#define AKNN_PARALLEL_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+//! Gets number of threads used when threadCount <= 0 is requested
+inline int GetDefaultThreadCount()
+{
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+//! Calls func(index, thread) for each index in [0, count) from threadCount threads (all hardware threads when threadCount <= 0).
+//! Indices are handed out in chunks of chunkSize consecutive indices, so threads with cheaper items take more chunks.
+//! The thread argument is in [0, threadCount), it can select per-thread buffers (e.g. priority queues of the searches).
+template<typename FuncT>
+void ParallelFor(size_t count, int threadCount, FuncT func, size_t chunkSize = 64)
+{
+    if (threadCount <= 0)
+        threadCount = GetDefaultThreadCount();
+    chunkSize = std::max(chunkSize, (size_t)1);
+    threadCount = (int)std::min((size_t)threadCount, (count + chunkSize - 1) / chunkSize);
+    if (threadCount <= 1) {
+        for (size_t i = 0; i < count; ++i)
+            func(i, 0);
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto worker = [&](int thread) {
+        for (size_t beg = next.fetch_add(chunkSize); beg < count; beg = next.fetch_add(chunkSize)) {
+            size_t end = std::min(beg + chunkSize, count);
+            for (size_t i = beg; i < end; ++i)
+                func(i, thread);
+        }
+    };
+    std::vector<std::thread> threads;
+    for (int thread = 1; thread < threadCount; ++thread)
+        threads.emplace_back(worker, thread);
+    worker(0);
+    for (std::thread& thread : threads)
+        thread.join();
+}
+
+#endif // AKNN_PARALLEL_H
@@ -29,8 +29,19 @@ public:
     virtual int GetSize() const = 0;
     //! Return unsorted array of the values currently stored in the queue
     virtual std::vector<T> GetValues() const = 0;
+    //! Gets unsorted array of GetSize() values currently stored in the queue, valid until next Push or Init.
+    //! The default implementation copies GetValues into buffer of the queue, the queues below override it.
+    virtual const T* GetData() const {
+        // the buffer is reused, so repeated calls without Push return the same pointer
+        std::vector<T> values = GetValues();
+        _dataCopy.assign(values.begin(), values.end());
+        return _dataCopy.data();
+    }
     //! Push specified element into the queue. If queue is full, it removes element with the lowest priority.
     virtual void Push(const T& value) = 0;
+private:
+    //! Values returned by the default GetData
+    mutable std::vector<T> _dataCopy;
 };
 
 template<typename T>
@@ -62,6 +73,8 @@ public:
     int GetSize() const override { return _values.size(); }
     //! Return unsorted array of the values currently stored in the queue
     std::vector<T> GetValues() const override { return _values; }
+    //! Gets unsorted array of the values currently stored in the queue without copying
+    const T* GetData() const override { return _values.data(); }
     //! Push specified element into the queue. If queue is full, it removes element with the lowest priority.
     void Push(const T& value) override {
         if (IsEmpty()) {
@@ -119,6 +132,8 @@ public:
     int GetSize() const override { return _heap.size(); }
     //! Return unsorted array of the values currently stored in the queue
     std::vector<T> GetValues() const override { return _heap; }
+    //! Gets unsorted array of the values currently stored in the queue without copying
+    const T* GetData() const override { return _heap.data(); }
     //! Push specified element into the queue. If queue is full, it removes element with the lowest priority.
     void Push(const T& value) override {
         if (IsEmpty()) {
@@ -192,6 +207,8 @@ public:
     int GetSize() const override { return _heap.size(); }
     //! Return unsorted array of the values currently stored in the queue
     std::vector<T> GetValues() const override { return _heap; }
+    //! Gets unsorted array of the values currently stored in the queue without copying
+    const T* GetData() const override { return _heap.data(); }
     //! Push specified element into the queue. If queue is full, it removes element with the lowest priority.
     void Push(const T& value) override {
         if (IsEmpty() || _isLeftSmaller(value, _first)) {
@@ -0,0 +1,249 @@
+#ifndef AKNN_QUERY_CACHE_H
+#define AKNN_QUERY_CACHE_H
+
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+
+#include "search.h"
+
+//! Counters of QueryCache, hits and misses of single searches are also added to TraversalStats
+struct QueryCacheStats
+{
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    //! Number of cached results and their estimated memory in bytes
+    size_t entryCount = 0;
+    size_t memoryBytes = 0;
+};
+
+//! Concurrent cache of kNN results keyed by (quantized query point, k, epsilon) with bounded memory and CLOCK eviction.
+//! With cellSize 0 the key is the exact query point, so hits return the same result as the search. With cellSize > 0
+//! query points in the same grid cell of size cellSize share the result of the first of them, which is an aproximation
+//! (neighbors of point up to cellSize * sqrt(Dim) away). The cache is split into shards with own locks to reduce contention.
+//! Results depend on the tree, Clear has to be called after the tree is modified. The key has no metric, the cache holds results
+//! of the default L2Metric searches only, searches with other metrics (see metric.h) must not use it.
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class QueryCache
+{
+public:
+    using PointObjT = PointObj<FloatT, Dim, ObjData>;
+
+    //! Initializes cache using at most maxMemoryBytes for the cached results, cellSize 0 caches exact query points only
+    QueryCache(size_t maxMemoryBytes = 64 << 20, double cellSize = 0, int shardCount = 16)
+        : _cellSize(cellSize), _shards(std::max(shardCount, 1))
+    {
+        for (Shard& shard : _shards)
+            shard.maxBytes = maxMemoryBytes / _shards.size();
+    }
+
+    //! Copies cached result of the query into result, returns false on miss
+    bool Find(const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, std::vector<PointObjT>& result)
+    {
+        Key key = MakeKey(queryPoint, k, epsilon);
+        Shard& shard = GetShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        auto it = shard.index.find(key);
+        if (it == shard.index.end()) {
+            ++shard.misses;
+            return false;
+        }
+        Entry& entry = shard.entries[it->second];
+        entry.referenced = true;
+        result = entry.result;
+        ++shard.hits;
+        return true;
+    }
+
+    //! Stores result of the query, evicts entries not used since the last pass of the clock hand when the memory runs out.
+    //! Results larger than the memory of a shard aren't stored.
+    void Insert(const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, const std::vector<PointObjT>& result)
+    {
+        Key key = MakeKey(queryPoint, k, epsilon);
+        Shard& shard = GetShard(key);
+        size_t bytes = GetEntryBytes(result.size());
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        if (bytes > shard.maxBytes || shard.index.count(key) != 0)
+            return;
+        while (shard.bytes + bytes > shard.maxBytes)
+            EvictOne(shard);
+
+        size_t slot;
+        if (!shard.freeSlots.empty()) {
+            slot = shard.freeSlots.back();
+            shard.freeSlots.pop_back();
+        } else {
+            slot = shard.entries.size();
+            shard.entries.emplace_back();
+        }
+        Entry& entry = shard.entries[slot];
+        entry.key = key;
+        entry.result = result;
+        entry.used = true;
+        entry.referenced = false;
+        shard.index.emplace(key, slot);
+        shard.bytes += bytes;
+    }
+
+    //! Removes all cached results, the counters are kept
+    void Clear()
+    {
+        for (Shard& shard : _shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            shard.index.clear();
+            shard.entries.clear();
+            shard.freeSlots.clear();
+            shard.hand = 0;
+            shard.bytes = 0;
+        }
+    }
+
+    //! Gets sum of the counters of all shards
+    QueryCacheStats GetStats() const
+    {
+        QueryCacheStats stats;
+        for (const Shard& shard : _shards) {
+            std::lock_guard<std::mutex> lock(shard.mutex);
+            stats.hits += shard.hits;
+            stats.misses += shard.misses;
+            stats.evictions += shard.evictions;
+            stats.entryCount += shard.index.size();
+            stats.memoryBytes += shard.bytes;
+        }
+        return stats;
+    }
+
+    double GetCellSize() const { return _cellSize; }
+
+private:
+    //! Grid cell (or exact coordinates) of the query point with k and epsilon
+    struct Key
+    {
+        std::array<int64_t, Dim> cell;
+        int k;
+        double epsilon;
+
+        bool operator==(const Key& other) const { return cell == other.cell && k == other.k && epsilon == other.epsilon; }
+    };
+    struct KeyHash
+    {
+        size_t operator()(const Key& key) const
+        {
+            uint64_t hash = 0x9E3779B97F4A7C15ull ^ (uint64_t)key.k;
+            for (int64_t value : key.cell)
+                hash = (hash ^ (uint64_t)value) * 0xBF58476D1CE4E5B9ull;
+            uint64_t epsBits;
+            std::memcpy(&epsBits, &key.epsilon, sizeof(epsBits));
+            hash = (hash ^ epsBits) * 0x94D049BB133111EBull;
+            return (size_t)(hash ^ (hash >> 31));
+        }
+    };
+    struct Entry
+    {
+        Key key;
+        std::vector<PointObjT> result;
+        bool used = false;
+        //! Set by hits, cleared by the clock hand
+        bool referenced = false;
+    };
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::unordered_map<Key, size_t, KeyHash> index;
+        //! Slots of the clock, unused slots are listed in freeSlots
+        std::vector<Entry> entries;
+        std::vector<size_t> freeSlots;
+        size_t hand = 0;
+        size_t bytes = 0;
+        size_t maxBytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    Key MakeKey(const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon) const
+    {
+        Key key;
+        for (int d = 0; d < Dim; ++d) {
+            if (_cellSize > 0) {
+                key.cell[d] = (int64_t)std::floor((double)queryPoint[d] / _cellSize);
+            } else if constexpr (std::is_floating_point_v<FloatT>) {
+                // bits of the coordinate, double holds float coordinates exactly
+                double coord = (double)queryPoint[d];
+                std::memcpy(&key.cell[d], &coord, sizeof(coord));
+            } else {
+                key.cell[d] = (int64_t)queryPoint[d];
+            }
+        }
+        key.k = k;
+        key.epsilon = (double)epsilon;
+        return key;
+    }
+
+    Shard& GetShard(const Key& key) { return _shards[KeyHash()(key) % _shards.size()]; }
+
+    //! Estimated memory of cached result including the index and the clock slot
+    static size_t GetEntryBytes(size_t resultSize)
+    {
+        return sizeof(Entry) + sizeof(std::pair<Key, size_t>) + 2 * sizeof(void*) + resultSize * sizeof(PointObjT);
+    }
+
+    //! Advances the clock hand to the first entry not referenced since the last pass and removes it
+    static void EvictOne(Shard& shard)
+    {
+        while (true) {
+            if (shard.hand >= shard.entries.size())
+                shard.hand = 0;
+            Entry& entry = shard.entries[shard.hand++];
+            if (!entry.used)
+                continue;
+            if (entry.referenced) {
+                entry.referenced = false;
+                continue;
+            }
+            shard.bytes -= GetEntryBytes(entry.result.size());
+            shard.index.erase(entry.key);
+            entry.used = false;
+            std::vector<PointObjT>().swap(entry.result);
+            shard.freeSlots.push_back(shard.hand - 1);
+            ++shard.evictions;
+            return;
+        }
+    }
+
+    double _cellSize;
+    std::vector<Shard> _shards;
+};
+
+//! Finds k aproximate nearest neighbors by L2Metric using the cache in front of BBD tree, the search runs only on cache miss.
+//! Hits and misses are counted in stats, traversal stats are measured only for the searches of misses.
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsCached(const BBDTree<FloatT, Dim, ObjData>& tree, QueryCache<FloatT, Dim, ObjData>& cache, const Vec<FloatT, Dim>& queryPoint, int k,
+                                                                                  EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats)
+{
+    std::vector<PointObj<FloatT, Dim, ObjData>> result;
+    if (cache.Find(queryPoint, k, epsilon, result)) {
+        ++stats.cacheHits;
+        return result;
+    }
+    ++stats.cacheMisses;
+    result = FindKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, k, epsilon, aknnQueue, stats);
+    cache.Insert(queryPoint, k, epsilon, result);
+    return result;
+}
+//! Finds k aproximate nearest neighbors by L2Metric using the cache in front of BBD tree
+template<typename FloatT, int Dim, typename ObjData = Empty>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsCached(const BBDTree<FloatT, Dim, ObjData>& tree, QueryCache<FloatT, Dim, ObjData>& cache, const Vec<FloatT, Dim>& queryPoint, int k,
+                                                                                  EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue)
+{
+    TraversalStats<FloatT, Dim> dummyStats;
+    return FindKAproximateNearestNeighborsCached<FloatT, Dim, ObjData, false>(tree, cache, queryPoint, k, epsilon, aknnQueue, dummyStats);
+}
+
+#endif // AKNN_QUERY_CACHE_H
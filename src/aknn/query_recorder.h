@@ -0,0 +1,67 @@
+#ifndef AKNN_QUERY_RECORDER_H
+#define AKNN_QUERY_RECORDER_H
+
+#include <vector>
+#include <mutex>
+#include <random>
+#include <stdint.h>
+
+#include "vec.h"
+
+//! Records uniform sample of fixed size from all the query points seen so far (reservoir sampling).
+//! The sample is used for building trees adapted to the query distribution (see BBDTree::BuildQueryAdaptiveTree).
+//! Recording is thread safe, so it can be called directly by query threads.
+template<typename FloatT, int Dim>
+class QueryRecorder
+{
+public:
+    //! Initializes recorder keeping at most sampleSize query points
+    QueryRecorder(size_t sampleSize = 10000, uint64_t seed = 0) : _sampleSize(sampleSize), _gen(seed) {}
+
+    //! Records query point, each of n recorded points stays in the sample with probability sampleSize / n
+    void Record(const Vec<FloatT, Dim>& queryPoint)
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        ++_recordedCount;
+        if (_sample.size() < _sampleSize) {
+            _sample.push_back(queryPoint);
+            return;
+        }
+        uint64_t index = std::uniform_int_distribution<uint64_t>(0, _recordedCount - 1)(_gen);
+        if (index < _sampleSize)
+            _sample[index] = queryPoint;
+    }
+
+    //! Gets copy of the current sample
+    std::vector<Vec<FloatT, Dim>> GetSample() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _sample;
+    }
+    //! Gets number of all recorded query points
+    uint64_t GetRecordedCount() const
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return _recordedCount;
+    }
+    //! Removes the sample, so that new workload can be recorded
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _sample.clear();
+        _recordedCount = 0;
+    }
+
+private:
+    //! Max size of the sample
+    size_t _sampleSize;
+    //! Sampled query points
+    std::vector<Vec<FloatT, Dim>> _sample;
+    //! Number of all recorded query points
+    uint64_t _recordedCount = 0;
+    //! Generator of replaced positions
+    std::mt19937_64 _gen;
+    mutable std::mutex _mutex;
+};
+
+#endif // AKNN_QUERY_RECORDER_H
@@ -0,0 +1,131 @@
+#ifndef AKNN_RKNN_H
+#define AKNN_RKNN_H
+
+#include <vector>
+#include <algorithm>
+
+#include "search.h"
+#include "parallel.h"
+
+//! Reverse k nearest neighbor queries on BBD tree: finds the points which would have the query point among their k nearest neighbors.
+//! Distance of each point to its k-th nearest neighbor (k-th neighbor radius) is precomputed by kNN searches of all points in parallel,
+//! each node keeps maximum radius of its points. The query visits only nodes whose box is within their maximum radius from the query point.
+//! The tree is fully expanded when lazy and must not be modified while the queries are used. Trees without exact points (see BBDTree::HasExactPoints)
+//! aren't supported, the queries then find nothing.
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class ReverseKNearestNeighbors
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+
+    //! Precomputes the radii of k-th nearest neighbors from threadCount threads (all hardware threads when threadCount <= 0).
+    //! Aproximate kNN searches with epsilon > 0 may overestimate the radii, so the queries may report some more points.
+    ReverseKNearestNeighbors(const BBDTreeT& tree, int k, EpsilonT<FloatT> epsilon = 0, int threadCount = 0)
+        : _tree(&tree), _k(k)
+    {
+        if (!tree.HasExactPoints())
+            return;
+        std::vector<std::pair<index_t, index_t>> leafs;
+        ForEachLeaf(tree, [&leafs](const LeafNode* leafNode, const Box<FloatT, Dim>&) {
+            leafs.push_back({leafNode->GetPointsBegIndex(), leafNode->GetPointsEndIndex()});
+        });
+        if (threadCount <= 0)
+            threadCount = GetDefaultThreadCount();
+        _radii.assign(tree.GetObjCount(), GetLowestValue<DistT<FloatT>>());
+        std::vector<HeapPriQueue<DistObj<FloatT, Dim, ObjData>>> queues(threadCount);
+        ParallelFor(leafs.size(), threadCount, [&](size_t leafIdx, int thread) {
+            FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& queue = queues[thread];
+            TraversalStats<FloatT, Dim> dummyStats;
+            for (index_t i = leafs[leafIdx].first; i < leafs[leafIdx].second; ++i) {
+                if (tree.IsDeleted(i))
+                    continue;
+                // the point itself is found too
+                queue.Init(k + 1, DistObjCompare<FloatT, Dim, ObjData>());
+                SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, tree.GetObj(i)->point, epsilon, queue, dummyStats);
+                // points with less than k neighbors have all query points among their k nearest neighbors
+                _radii[i] = queue.IsFull() ? queue.GetLast().dist : GetMaxValue<DistT<FloatT>>();
+            }
+        });
+        if (tree.GetObjCount() != 0)
+            ComputeNodeRadiiR(0);
+    }
+
+    int GetK() const { return _k; }
+    //! Gets squared distance of point object with specified index (see BBDTree::GetObj) to its k-th nearest neighbor
+    DistT<FloatT> GetRadius(index_t index) const { return _radii[index]; }
+
+    //! Calls func(const PointObj&) for each point object, which has the query point among its k nearest neighbors
+    //! (query point at the same distance as the k-th neighbor counts too)
+    template<typename FuncT>
+    void Search(const Vec<FloatT, Dim>& queryPoint, FuncT func) const
+    {
+        if (!_radii.empty())
+            SearchR(queryPoint, 0, _tree->GetBBox(), func);
+    }
+    //! Finds point objects, which have the query point among their k nearest neighbors. The result buffer is cleared and reused,
+    //! returns number of found objects.
+    size_t Find(const Vec<FloatT, Dim>& queryPoint, std::vector<PointObj<FloatT, Dim, ObjData>>& result) const
+    {
+        result.clear();
+        Search(queryPoint, [&result](const PointObj<FloatT, Dim, ObjData>& obj) { result.push_back(obj); });
+        return result.size();
+    }
+
+private:
+    //! Computes maximum radius of the subtree
+    DistT<FloatT> ComputeNodeRadiiR(index_t nodeIdx)
+    {
+        const Node* node = _tree->GetNode(nodeIdx);
+        DistT<FloatT> maxRadius = GetLowestValue<DistT<FloatT>>();
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                if (!_tree->IsDeleted(i))
+                    maxRadius = std::max(maxRadius, _radii[i]);
+            }
+        } else {
+            const InnerNode* innerNode = (const InnerNode*)node;
+            if (innerNode->HasLeftChild())
+                maxRadius = std::max(maxRadius, ComputeNodeRadiiR(_tree->GetLeftChildIndex(nodeIdx)));
+            if (innerNode->GetRightChildIndex() != 0)
+                maxRadius = std::max(maxRadius, ComputeNodeRadiiR(innerNode->GetRightChildIndex()));
+        }
+        if (nodeIdx >= (index_t)_nodeRadii.size())
+            _nodeRadii.resize(nodeIdx + 1, GetLowestValue<DistT<FloatT>>());
+        _nodeRadii[nodeIdx] = maxRadius;
+        return maxRadius;
+    }
+
+    template<typename FuncT>
+    void SearchR(const Vec<FloatT, Dim>& queryPoint, index_t nodeIdx, const Box<FloatT, Dim>& box, FuncT& func) const
+    {
+        // no point of the subtree has its k-th neighbor radius reaching the query point
+        if (box.SquaredDistance(queryPoint) > _nodeRadii[nodeIdx])
+            return;
+        const Node* node = _tree->GetNode(nodeIdx);
+        if (node->GetType() == NodeType::LEAF) {
+            const LeafNode* leafNode = (const LeafNode*)node;
+            for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                const PointObj<FloatT, Dim, ObjData>* obj = _tree->GetObj(i);
+                if (!_tree->IsDeleted(i) && queryPoint.DistSquared(obj->point) <= _radii[i])
+                    func(*obj);
+            }
+            return;
+        }
+
+        ChildNodes<FloatT, Dim> childs = _tree->GetChildren(nodeIdx, box);
+        if (childs.leftIdx != 0)
+            SearchR(queryPoint, childs.leftIdx, childs.leftBox, func);
+        if (childs.rightIdx != 0)
+            SearchR(queryPoint, childs.rightIdx, childs.rightBox, func);
+    }
+
+    const BBDTreeT* _tree;
+    int _k;
+    //! Squared distances of the point objects to their k-th nearest neighbors, indexed as the point objects of the tree
+    std::vector<DistT<FloatT>> _radii;
+    //! Maximum radii of the subtrees indexed by node index, lowest value for subtrees without points
+    std::vector<DistT<FloatT>> _nodeRadii;
+};
+
+#endif // AKNN_RKNN_H
@@ -4,17 +4,22 @@
 #include <vector>
 #include <queue>
 #include <limits>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <shared_mutex>
 
 #include "vec.h"
 #include "bbd_tree.h"
 #include "pri_queue.h"
+#include "metric.h"
 
 //! BBD tree node with additional information of distance to query point + bounding box 
 template<typename FloatT, int Dim>
 struct DistNode
 {
     //! Distance from query point to this node
-    FloatT dist;
+    DistT<FloatT> dist;
     //! Index of this node
     index_t nodeIdx;
     //! bounding box of this node
@@ -26,7 +31,7 @@ template<typename FloatT, int Dim, typename ObjData = Empty>
 struct DistObj
 {
     //! distance of this object from query point
-    FloatT dist;
+    DistT<FloatT> dist;
     //! point object
     PointObj<FloatT, Dim, ObjData> obj;
 };
@@ -58,13 +63,14 @@ struct DistObjCompare
 };
 
 //! Naive linear nearest neighbor in specified range with DistObj result
-template<typename FloatT, int Dim, typename ObjData = Empty>
-DistObj<FloatT, Dim, ObjData> LinearFindNearestNeighborInRangeWithDist(const PointObj<FloatT, Dim, ObjData>* objsBeg, const PointObj<FloatT, Dim, ObjData>* objsEnd, const Vec<FloatT, Dim>& queryPoint)
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+DistObj<FloatT, Dim, ObjData> LinearFindNearestNeighborInRangeWithDist(const PointObj<FloatT, Dim, ObjData>* objsBeg, const PointObj<FloatT, Dim, ObjData>* objsEnd, const Vec<FloatT, Dim>& queryPoint,
+                                                                       const MetricT& metric = MetricT())
 {
     PointObj<FloatT, Dim, ObjData> nnObj = *objsBeg;
-    FloatT minDist = queryPoint.DistSquared(nnObj.point);
+    DistT<FloatT> minDist = queryPoint.Distance(nnObj.point, metric);
     for (const PointObj<FloatT, Dim, ObjData>* objIt = objsBeg + 1; objIt != objsEnd; ++objIt) {
-        FloatT dist = queryPoint.DistSquared(objIt->point);
+        DistT<FloatT> dist = queryPoint.Distance(objIt->point, metric);
         if (dist < minDist) {
             minDist = dist;
             nnObj = *objIt;
@@ -84,17 +90,30 @@ PointObj<FloatT, Dim, ObjData> LinearFindNearestNeighbor(const std::vector<Point
 {
     return LinearFindNearestNeighborInRange<FloatT, Dim, ObjData>(objs.data(), objs.data() + objs.size(), queryPoint);
 }
-//! Naive linear k nearest neighbors
-template<typename FloatT, int Dim, typename ObjData = Empty>
-std::vector<PointObj<FloatT, Dim, ObjData>> LinearFindKNearestNeighbors(const std::vector<PointObj<FloatT, Dim, ObjData>>& objs, const Vec<FloatT, Dim>& queryPoint, int k)
+//! Naive linear k nearest neighbors by distance of specified metric (see metric.h)
+template<typename FloatT, int Dim, typename ObjData, typename MetricT>
+std::vector<PointObj<FloatT, Dim, ObjData>> LinearFindKNearestNeighborsByMetric(const std::vector<PointObj<FloatT, Dim, ObjData>>& objs, const Vec<FloatT, Dim>& queryPoint, int k, const MetricT& metric)
 {
     LinearPriQueue<DistObj<FloatT, Dim, ObjData>> priQueue;
     priQueue.Init(k, DistObjCompare<FloatT, Dim, ObjData>());
     for (int i = 0; i < (int)objs.size(); ++i) {
-        priQueue.Push({queryPoint.DistSquared(objs[i].point), objs[i]});
+        priQueue.Push({queryPoint.Distance(objs[i].point, metric), objs[i]});
     }
     return DistObjsToPointObjs(priQueue.GetValues());
 }
+//! Naive linear k nearest neighbors
+template<typename FloatT, int Dim, typename ObjData = Empty>
+std::vector<PointObj<FloatT, Dim, ObjData>> LinearFindKNearestNeighbors(const std::vector<PointObj<FloatT, Dim, ObjData>>& objs, const Vec<FloatT, Dim>& queryPoint, int k)
+{
+    return LinearFindKNearestNeighborsByMetric(objs, queryPoint, k, L2Metric());
+}
+
+//! Distinct pages of the nodes and points arrays touched by traversal
+struct TouchedPageSets
+{
+    std::unordered_set<size_t> nodePages;
+    std::unordered_set<size_t> objPages;
+};
 
 //! Statistics of FindAproximateNearestNeighbor and FindKAproximateNearestNeighbors
 template<typename FloatT, int Dim>
@@ -103,56 +122,186 @@ struct TraversalStats
     int traversalSteps = 0;
     int visitedLeafs = 0;
     std::vector<Box<FloatT, Dim>> visitedNodes;
+    //! Page size in bytes used for counting of touched pages, pages are given by the memory addresses of the nodes and points
+    int pageSize = 4096;
+    //! Number of distinct pages of the nodes and points arrays touched by the traversal
+    int touchedPages = 0;
+    //! Distinct touched pages, created by the first RecordTouchedPages, so that searches without measured stats don't build the sets
+    std::optional<TouchedPageSets> touchedPageSets;
+    //! Hits and misses of the result cache (see FindKAproximateNearestNeighborsCached)
+    int cacheHits = 0;
+    int cacheMisses = 0;
 };
 
+//! Records pages of the nodes and points arrays touched by visiting the node. Used inside FindAproximateNearestNeighbor and FindKAproximateNearestNeighbors.
+template<typename FloatT, int Dim, typename ObjData>
+void RecordTouchedPages(const BBDTree<FloatT, Dim, ObjData>& tree, index_t nodeIdx, TraversalStats<FloatT, Dim>& stats)
+{
+    if (!stats.touchedPageSets)
+        stats.touchedPageSets.emplace();
+    TouchedPageSets& pageSets = *stats.touchedPageSets;
+    const Node* node = tree.GetNode(nodeIdx);
+    uintptr_t nodeBeg = (uintptr_t)node;
+    uintptr_t nodeEnd = nodeBeg + GetNodeOffset<FloatT, Dim>(node) * sizeof(Node);
+    for (size_t page = nodeBeg / stats.pageSize; page <= (nodeEnd - 1) / stats.pageSize; ++page)
+        pageSets.nodePages.insert(page);
+    if (node->GetType() == NodeType::LEAF)
+    {
+        const LeafNode* leafNode = (const LeafNode*)node;
+        if (leafNode->GetPointsEndIndex() > leafNode->GetPointsBegIndex()) {
+            // trees without exact points store the quantized points only
+            index_t pointsBeg = leafNode->GetPointsBegIndex();
+            size_t objSize = tree.HasExactPoints() ? sizeof(PointObj<FloatT, Dim, ObjData>) : (size_t)Dim * tree.GetQuantBits() / 8;
+            uintptr_t objsBeg;
+            if (tree.HasExactPoints())
+                objsBeg = (uintptr_t)tree.GetObj(pointsBeg);
+            else if (tree.GetQuantBits() == 8)
+                objsBeg = (uintptr_t)tree.template GetQuantPoint<uint8_t>(pointsBeg);
+            else
+                objsBeg = (uintptr_t)tree.template GetQuantPoint<uint16_t>(pointsBeg);
+            uintptr_t objsEnd = objsBeg + (leafNode->GetPointsEndIndex() - pointsBeg) * objSize;
+            for (size_t page = objsBeg / stats.pageSize; page <= (objsEnd - 1) / stats.pageSize; ++page)
+                pageSets.objPages.insert(page);
+        }
+    }
+    stats.touchedPages = (int)(pageSets.nodePages.size() + pageSets.objPages.size());
+}
+
 //! Priority queue used for nodes inside FindAproximateNearestNeighbor and FindKAproximateNearestNeighbors
 template<typename FloatT, int Dim>
 using DistNodePriQueue = std::priority_queue<DistNode<FloatT, Dim>, std::vector<DistNode<FloatT, Dim>>, DistNodeCompare<FloatT, Dim>>;
 
 //! Push child nodes of some node to node priority queue. Used inside FindAproximateNearestNeighbor and FindKAproximateNearestNeighbors.
-template<typename FloatT, int Dim, typename ObjData>
-void PushChildsToNodeQueue(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, const DistNode<FloatT, Dim>& distNode, DistNodePriQueue<FloatT, Dim>& nodeQueue)
+template<typename FloatT, int Dim, typename ObjData, typename MetricT = L2Metric>
+void PushChildsToNodeQueue(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, const DistNode<FloatT, Dim>& distNode, DistNodePriQueue<FloatT, Dim>& nodeQueue,
+                           const MetricT& metric = MetricT())
 {
     const Node* node = tree.GetNode(distNode.nodeIdx);
-    const InnerNode* innerNode = (const InnerNode*)node;
-    Box leftBox = distNode.box;
-    Box rightBox = distNode.box;
-    FloatT distLeft;
-    FloatT distRight;
-    if (node->GetType() == NodeType::SPLIT)
-    {
-        const SplitNode* splitNode = (const SplitNode*)node;
-        int splitDim = splitNode->GetSplitDim();
-        FloatT half = (distNode.box.min[splitDim] + distNode.box.max[splitDim]) / 2;
-        leftBox.max[splitDim] = half;
-        rightBox.min[splitDim] = half;
-        
-        distLeft = leftBox.SquaredDistance(queryPoint);
-        distRight = rightBox.SquaredDistance(queryPoint);
+    ChildNodes<FloatT, Dim> childs = tree.GetChildren(distNode.nodeIdx, distNode.box);
+    if (childs.leftIdx != 0)
+        nodeQueue.push({childs.leftBox.Distance(queryPoint, metric), childs.leftIdx, childs.leftBox});
+    // outer child of shrink node has the box of the node
+    if (childs.rightIdx != 0)
+        nodeQueue.push({node->GetType() == NodeType::SHRINK ? distNode.dist : childs.rightBox.Distance(queryPoint, metric), childs.rightIdx, childs.rightBox});
+}
+
+//! Scans leaf with quantized points (see BBDTree::QuantizeLeafPoints). Lower bound of distance to each point is computed from its quantization interval,
+//! full precision point is read only if the lower bound isn't greater than bound. pushFunc is called with exact distance and point object of these candidates
+//! (decoded point, when the tree doesn't keep the exact points).
+//! Used inside FindAproximateNearestNeighbor and FindKAproximateNearestNeighbors.
+template<typename QuantT, typename FloatT, int Dim, typename ObjData, typename PushFuncT, typename MetricT = L2Metric>
+void ScanQuantizedLeaf(const BBDTree<FloatT, Dim, ObjData>& tree, const LeafNode* leafNode, const Box<FloatT, Dim>& box, const Vec<FloatT, Dim>& queryPoint, const DistT<FloatT>& bound, PushFuncT pushFunc,
+                       const MetricT& metric = MetricT())
+{
+    constexpr int levels = 1 << (8 * sizeof(QuantT));
+    Vec<FloatT, Dim> step;
+    for (int d = 0; d < Dim; ++d) {
+        step[d] = GetQuantStep(box.min[d], box.max[d], levels);
     }
-    else if (node->GetType() == NodeType::SHRINK)
-    {
-        const ShrinkNode<FloatT, Dim>* shrinkNode = (const ShrinkNode<FloatT, Dim>*)node;
-        leftBox = shrinkNode->GetShrinkBox();
-        
-        distLeft = leftBox.SquaredDistance(queryPoint);
-        distRight = distNode.dist;
+    for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+        if (tree.IsDeleted(i))
+            continue;
+        const std::array<QuantT, Dim>& quantPoint = *tree.template GetQuantPoint<QuantT>(i);
+        // same order of operations as in Vec::Distance, so the lower bound is never greater than the exact distance
+        DistT<FloatT> lowerBound = 0;
+        for (int d = 0; d < Dim; ++d) {
+            FloatT lo = GetQuantBound(box.min[d], box.max[d], step[d], quantPoint[d], levels);
+            FloatT hi = GetQuantBound(box.min[d], box.max[d], step[d], quantPoint[d] + 1, levels);
+            DistT<FloatT> diff = 0;
+            if (queryPoint[d] < lo)
+                diff = (DistT<FloatT>)lo - queryPoint[d];
+            else if (queryPoint[d] > hi)
+                diff = (DistT<FloatT>)queryPoint[d] - hi;
+            lowerBound = metric.Accumulate(lowerBound, diff, d);
+        }
+        if (lowerBound <= bound && tree.HasExactPoints()) {
+            const PointObj<FloatT, Dim, ObjData>* obj = tree.GetObj(i);
+            pushFunc(queryPoint.Distance(obj->point, metric), *obj);
+        } else if (lowerBound <= bound) {
+            PointObj<FloatT, Dim, ObjData> obj = tree.GetDecodedObj(i, box);
+            pushFunc(queryPoint.Distance(obj.point, metric), obj);
+        }
     }
-    if (innerNode->HasLeftChild())
-        nodeQueue.push({distLeft, distNode.nodeIdx + GetNodeOffset<FloatT, Dim>(node->GetType()), leftBox});
-    if (innerNode->GetRightChildIndex() != 0)
-        nodeQueue.push({distRight, innerNode->GetRightChildIndex(), rightBox});
 }
 
-//! Finds aproximate nearest neighbor using BBD tree
-template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false>
-PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT epsilon, TraversalStats<FloatT, Dim>& stats)
+//! Filter of the kNN searches which accepts everything. Filters provide IsNodeAccepted(tree, nodeIdx), false skips the whole subtree,
+//! and IsObjAccepted(obj), false skips the point object (see CategoryFilter).
+struct AcceptAllFilter
+{
+    template<typename TreeT>
+    bool IsNodeAccepted(const TreeT&, index_t) const { return true; }
+    template<typename PointObjT>
+    bool IsObjAccepted(const PointObjT&) const { return true; }
+};
+
+//! Filter of the kNN searches which accepts point objects whose category mask (see GetCategoryMask) intersects categoryFilter.
+//! Subtrees whose category mask doesn't intersect it are skipped.
+struct CategoryFilter
+{
+    uint64_t categoryFilter;
+
+    template<typename TreeT>
+    bool IsNodeAccepted(const TreeT& tree, index_t nodeIdx) const { return (tree.GetSubtreeCategoryMask(nodeIdx) & categoryFilter) != 0; }
+    template<typename PointObjT>
+    bool IsObjAccepted(const PointObjT& obj) const { return (GetCategoryMask(obj.data) & categoryFilter) != 0; }
+};
+
+//! Budget of the kNN searches without limits. Budgets provide IsVisitAllowed(tree, distNode), false stops the search before the node
+//! (lazy leafs are already expanded), and OnLeafVisited(leafNode) called after the leaf was scanned (see SearchBudgetTracker in anytime.h).
+struct UnlimitedBudget
+{
+    template<typename TreeT, typename DistNodeT>
+    bool IsVisitAllowed(const TreeT&, const DistNodeT&) const { return true; }
+    template<typename LeafNodeT>
+    void OnLeafVisited(const LeafNodeT*) const {}
+};
+
+//! Pushes live point objects of leaf accepted by filter into the kNN queue, quantized leafs are scanned by ScanQuantizedLeaf.
+//! Used inside SearchKAproximateNearestNeighbors.
+template<typename FloatT, int Dim, typename ObjData, typename MetricT = L2Metric, typename FilterT = AcceptAllFilter>
+void PushLeafObjsToQueue(const BBDTree<FloatT, Dim, ObjData>& tree, const LeafNode* leafNode, const Box<FloatT, Dim>& box, const Vec<FloatT, Dim>& queryPoint,
+                         FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, const MetricT& metric = MetricT(), const FilterT& filter = FilterT())
+{
+    if (tree.GetQuantBits() != 0) {
+        DistT<FloatT> bound = aknnQueue.IsFull() ? aknnQueue.GetLast().dist : GetMaxValue<DistT<FloatT>>();
+        auto pushFunc = [&](DistT<FloatT> dist, const PointObj<FloatT, Dim, ObjData>& obj) {
+            if (!filter.IsObjAccepted(obj))
+                return;
+            aknnQueue.Push(DistObj<FloatT, Dim, ObjData>({dist, obj}));
+            if (aknnQueue.IsFull())
+                bound = aknnQueue.GetLast().dist;
+        };
+        if (tree.GetQuantBits() == 8)
+            ScanQuantizedLeaf<uint8_t>(tree, leafNode, box, queryPoint, bound, pushFunc, metric);
+        else
+            ScanQuantizedLeaf<uint16_t>(tree, leafNode, box, queryPoint, bound, pushFunc, metric);
+    } else if (tree.GetDeletedCount() != 0) {
+        for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+            if (!tree.IsDeleted(i) && filter.IsObjAccepted(*tree.GetObj(i)))
+                aknnQueue.Push(DistObj<FloatT, Dim, ObjData>({queryPoint.Distance(tree.GetObj(i)->point, metric), *tree.GetObj(i)}));
+        }
+    } else {
+        const PointObj<FloatT, Dim, ObjData>* leafBeg = tree.GetObj(leafNode->GetPointsBegIndex());
+        const PointObj<FloatT, Dim, ObjData>* leafEnd = tree.GetObj(leafNode->GetPointsEndIndex());
+        for (const PointObj<FloatT, Dim, ObjData>* objPtr = leafBeg; objPtr != leafEnd; ++objPtr) {
+            if (filter.IsObjAccepted(*objPtr))
+                aknnQueue.Push(DistObj<FloatT, Dim, ObjData>({queryPoint.Distance(objPtr->point, metric), *objPtr}));
+        }
+    }
+}
+
+//! Finds aproximate nearest neighbor using BBD tree, metric is distance policy (see metric.h)
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false, typename MetricT = L2Metric>
+PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon, TraversalStats<FloatT, Dim>& stats,
+                                                             const MetricT& metric = MetricT())
 {
     PointObj<FloatT, Dim, ObjData> ann;
-    FloatT minDist = std::numeric_limits<FloatT>::infinity();
+    DistT<FloatT> minDist = GetMaxValue<DistT<FloatT>>();
+    std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
     DistNodePriQueue<FloatT, Dim> nodeQueue;
-    DistNode<FloatT, Dim> rootNode{tree.GetBBox().SquaredDistance(queryPoint), 0, tree.GetBBox()};
+    DistNode<FloatT, Dim> rootNode{tree.GetBBox().Distance(queryPoint, metric), 0, tree.GetBBox()};
     nodeQueue.push(rootNode);
+    EpsilonT<FloatT> relaxFactor = metric.RelaxFactor(epsilon);
     while (!nodeQueue.empty())
     {
         DistNode<FloatT, Dim> distNode = nodeQueue.top();
@@ -163,21 +312,39 @@ PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<Float
         {
             ++stats.traversalSteps;
             stats.visitedNodes.push_back(distNode.box);
+            RecordTouchedPages(tree, distNode.nodeIdx, stats);
         }
 
-        if (distNode.dist > minDist / (1 + epsilon)) {
+        if (distNode.dist > minDist / relaxFactor) {
             break;
         }
+        if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+            tree.ExpandLazyLeaf(distNode.nodeIdx, distNode.box, lazyLock);
+            node = tree.GetNode(distNode.nodeIdx);
+        }
         
         if (node->GetType() == NodeType::LEAF)
         {
             const LeafNode* leafNode = (const LeafNode*)node;
-            DistObj<FloatT, Dim, ObjData> localNN = LinearFindNearestNeighborInRangeWithDist<FloatT, Dim, ObjData>(
-                tree.GetObj(leafNode->GetPointsBegIndex()), tree.GetObj(leafNode->GetPointsEndIndex()), queryPoint);
-            if (localNN.dist < minDist)
-            {
-                minDist = localNN.dist;
-                ann = localNN.obj;
+            auto pushFunc = [&](DistT<FloatT> dist, const PointObj<FloatT, Dim, ObjData>& obj) {
+                if (dist < minDist) {
+                    minDist = dist;
+                    ann = obj;
+                }
+            };
+            if (tree.GetQuantBits() == 8) {
+                ScanQuantizedLeaf<uint8_t>(tree, leafNode, distNode.box, queryPoint, minDist, pushFunc, metric);
+            } else if (tree.GetQuantBits() == 16) {
+                ScanQuantizedLeaf<uint16_t>(tree, leafNode, distNode.box, queryPoint, minDist, pushFunc, metric);
+            } else if (tree.GetDeletedCount() != 0) {
+                for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+                    if (!tree.IsDeleted(i))
+                        pushFunc(queryPoint.Distance(tree.GetObj(i)->point, metric), *tree.GetObj(i));
+                }
+            } else if (leafNode->GetPointsEndIndex() > leafNode->GetPointsBegIndex()) {
+                DistObj<FloatT, Dim, ObjData> localNN = LinearFindNearestNeighborInRangeWithDist<FloatT, Dim, ObjData>(
+                    tree.GetObj(leafNode->GetPointsBegIndex()), tree.GetObj(leafNode->GetPointsEndIndex()), queryPoint, metric);
+                pushFunc(localNN.dist, localNN.obj);
             }
 
             if (measureStats)
@@ -185,87 +352,344 @@ PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<Float
         }
         else
         {
-            PushChildsToNodeQueue(tree, queryPoint, distNode, nodeQueue);
+            PushChildsToNodeQueue(tree, queryPoint, distNode, nodeQueue, metric);
         }
     }
     return ann;
 }
 //! Finds aproximate nearest neighbor using BBD tree
 template<typename FloatT, int Dim, typename ObjData = Empty>
-PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT epsilon)
+PointObj<FloatT, Dim, ObjData> FindAproximateNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon)
 {
     TraversalStats<FloatT, Dim> dummyStats;
     return FindAproximateNearestNeighbor<FloatT, Dim, ObjData>(tree, queryPoint, epsilon, dummyStats);
 }
 //! Finds nearest neighbor using BBD tree
-template<typename FloatT, int Dim, typename ObjData = Empty>
-PointObj<FloatT, Dim, ObjData> FindNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint)
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+PointObj<FloatT, Dim, ObjData> FindNearestNeighbor(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, const MetricT& metric = MetricT())
 {
-    return FindAproximateNearestNeighbor<FloatT, Dim, ObjData>(tree, queryPoint, 0);
+    TraversalStats<FloatT, Dim> dummyStats;
+    return FindAproximateNearestNeighbor<FloatT, Dim, ObjData, false>(tree, queryPoint, 0, dummyStats, metric);
 }
 
-//! Finds k aproximate nearest neighbors using BBD tree
-template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false>
-std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FloatT epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats)
+//! Best first traversal of the nodes already pushed into nodeQueue, pushes k aproximate nearest neighbors into initialized aknnQueue.
+//! The nodes have to cover all point objects which may be the neighbors, lazyLock is the lock from BBDTree::LockLazyLeafs.
+//! Only nodes and point objects accepted by filter are searched (see AcceptAllFilter), budget may stop the search early (see UnlimitedBudget).
+//! Returns distance of the node which stopped the search, all nodes which weren't visited are at least that far (maximum value when all were visited).
+//! Used inside SearchKAproximateNearestNeighbors and by searches which start from other nodes than the root.
+template<typename FloatT, int Dim, typename ObjData, bool measureStats = false, typename MetricT = L2Metric, typename FilterT = AcceptAllFilter, typename BudgetT = UnlimitedBudget>
+DistT<FloatT> SearchNodeQueueKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon, DistNodePriQueue<FloatT, Dim>& nodeQueue,
+                                                         std::shared_lock<std::shared_mutex>& lazyLock, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats,
+                                                         const MetricT& metric = MetricT(), DistT<FloatT> maxDist = GetMaxValue<DistT<FloatT>>(), const FilterT& filter = FilterT(),
+                                                         const BudgetT& budget = BudgetT())
 {
-    if (k == 1) {
-        return { FindAproximateNearestNeighbor<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, stats) };
-    }
-
-    DistObjCompare<FloatT, Dim, ObjData> distObjCompare;
-    aknnQueue.Init(k, distObjCompare);
-
-    DistNodePriQueue<FloatT, Dim> nodeQueue;
-    DistNode<FloatT, Dim> rootNode{tree.GetBBox().SquaredDistance(queryPoint), 0, tree.GetBBox()};
-    nodeQueue.push(rootNode);
+    EpsilonT<FloatT> relaxFactor = metric.RelaxFactor(epsilon);
     while (!nodeQueue.empty())
     {
         DistNode<FloatT, Dim> distNode = nodeQueue.top();
         const Node* node = tree.GetNode(distNode.nodeIdx);
         nodeQueue.pop();
+        if (!filter.IsNodeAccepted(tree, distNode.nodeIdx))
+            continue;
         
         if (measureStats)
         {
             ++stats.traversalSteps;
             stats.visitedNodes.push_back(distNode.box);
+            RecordTouchedPages(tree, distNode.nodeIdx, stats);
         }
 
-        if (aknnQueue.IsFull() && distNode.dist > aknnQueue.GetLast().dist / (1 + epsilon)) {
-            break;
+        if ((aknnQueue.IsFull() && distNode.dist > aknnQueue.GetLast().dist / relaxFactor) || distNode.dist > maxDist) {
+            return distNode.dist;
         }
+        if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+            tree.ExpandLazyLeaf(distNode.nodeIdx, distNode.box, lazyLock);
+            node = tree.GetNode(distNode.nodeIdx);
+        }
+        if (!budget.IsVisitAllowed(tree, distNode))
+            return distNode.dist;
         
         if (node->GetType() == NodeType::LEAF)
         {
-            const LeafNode* leafNode = (const LeafNode*)node;
-            const PointObj<FloatT, Dim, ObjData>* leafBeg = tree.GetObj(leafNode->GetPointsBegIndex());
-            const PointObj<FloatT, Dim, ObjData>* leafEnd = tree.GetObj(leafNode->GetPointsEndIndex());
-            for (const PointObj<FloatT, Dim, ObjData>* objPtr = leafBeg; objPtr != leafEnd; ++objPtr) {
-                aknnQueue.Push(DistObj<FloatT, Dim, ObjData>({queryPoint.DistSquared(objPtr->point), *objPtr}));
-            }
+            PushLeafObjsToQueue(tree, (const LeafNode*)node, distNode.box, queryPoint, aknnQueue, metric, filter);
+            budget.OnLeafVisited((const LeafNode*)node);
             
             if (measureStats)
                 ++stats.visitedLeafs;
         }
         else
         {
-            PushChildsToNodeQueue(tree, queryPoint, distNode, nodeQueue);
+            PushChildsToNodeQueue(tree, queryPoint, distNode, nodeQueue, metric);
         }
     }
+    return GetMaxValue<DistT<FloatT>>();
+}
+
+//! Searches BBD tree for k aproximate nearest neighbors and pushes them into already initialized aknnQueue.
+//! Objects already inside the queue bound the search, so the queue can be shared by searches of multiple trees.
+//! Nodes farther than maxDist (reduced distance of the metric) aren't visited, but objects of visited leafs may be pushed even if they are farther.
+//! Only nodes and point objects accepted by filter are searched (see AcceptAllFilter), budget may stop the search early (see UnlimitedBudget).
+//! Returns distance of the nearest node which wasn't visited (see SearchNodeQueueKAproximateNearestNeighbors).
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false, typename MetricT = L2Metric, typename FilterT = AcceptAllFilter, typename BudgetT = UnlimitedBudget>
+DistT<FloatT> SearchKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats,
+                                                const MetricT& metric = MetricT(), DistT<FloatT> maxDist = GetMaxValue<DistT<FloatT>>(), const FilterT& filter = FilterT(), const BudgetT& budget = BudgetT())
+{
+    std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+    DistNodePriQueue<FloatT, Dim> nodeQueue;
+    DistNode<FloatT, Dim> rootNode{tree.GetBBox().Distance(queryPoint, metric), 0, tree.GetBBox()};
+    nodeQueue.push(rootNode);
+    return SearchNodeQueueKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, nodeQueue, lazyLock, aknnQueue, stats, metric, maxDist, filter, budget);
+}
 
+//! Finds k aproximate nearest neighbors using BBD tree, metric is distance policy (see metric.h)
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats,
+                                                                            const MetricT& metric = MetricT())
+{
+    if (k == 1) {
+        return { FindAproximateNearestNeighbor<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, stats, metric) };
+    }
+
+    DistObjCompare<FloatT, Dim, ObjData> distObjCompare;
+    aknnQueue.Init(k, distObjCompare);
+    SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, aknnQueue, stats, metric);
     return DistObjsToPointObjs(aknnQueue.GetValues());
 }
 //! Finds k aproximate nearest neighbors using BBD tree
 template<typename FloatT, int Dim, typename ObjData = Empty>
-std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FloatT epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue)
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue)
 {
     TraversalStats<FloatT, Dim> dummyStats;
     return FindKAproximateNearestNeighbors<FloatT, Dim, ObjData, false>(tree, queryPoint, k, epsilon, aknnQueue, dummyStats);
 }
 //! Finds k nearest neighbors using BBD tree
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue,
+                                                                  const MetricT& metric = MetricT())
+{
+    TraversalStats<FloatT, Dim> dummyStats;
+    return FindKAproximateNearestNeighbors<FloatT, Dim, ObjData, false>(tree, queryPoint, k, 0, knnQueue, dummyStats, metric);
+}
+
+//! Reports point objects of the subtree within reduced distance radiusDist of query point to func. Subtrees whose box is within reportDist
+//! are reported without distance computations. Used inside SearchAproximateRange.
+template<typename FloatT, int Dim, typename ObjData, typename FuncT, typename MetricT>
+void SearchAproximateRangeR(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, index_t nodeIdx, const Box<FloatT, Dim>& box,
+                            DistT<FloatT> radiusDist, DistT<FloatT> reportDist, bool inside, std::shared_lock<std::shared_mutex>& lazyLock, FuncT& func, const MetricT& metric)
+{
+    const Node* node = tree.GetNode(nodeIdx);
+    if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+        tree.ExpandLazyLeaf(nodeIdx, box, lazyLock);
+        node = tree.GetNode(nodeIdx);
+    }
+    inside = inside || box.MaxDistance(queryPoint, metric) <= reportDist;
+
+    if (node->GetType() == NodeType::LEAF)
+    {
+        const LeafNode* leafNode = (const LeafNode*)node;
+        for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+            if (!tree.HasExactPoints()) {
+                PointObj<FloatT, Dim, ObjData> obj = tree.GetDecodedObj(i, box);
+                if (!tree.IsDeleted(i) && (inside || queryPoint.Distance(obj.point, metric) <= radiusDist))
+                    func(obj);
+                continue;
+            }
+            const PointObj<FloatT, Dim, ObjData>* obj = tree.GetObj(i);
+            if (!tree.IsDeleted(i) && (inside || queryPoint.Distance(obj->point, metric) <= radiusDist))
+                func(*obj);
+        }
+        return;
+    }
+
+    ChildNodes<FloatT, Dim> childs = tree.GetChildren(nodeIdx, box);
+    if (childs.leftIdx != 0 && (inside || childs.leftBox.Distance(queryPoint, metric) <= radiusDist))
+        SearchAproximateRangeR(tree, queryPoint, childs.leftIdx, childs.leftBox, radiusDist, reportDist, inside, lazyLock, func, metric);
+    if (childs.rightIdx != 0 && (inside || childs.rightBox.Distance(queryPoint, metric) <= radiusDist))
+        SearchAproximateRangeR(tree, queryPoint, childs.rightIdx, childs.rightBox, radiusDist, reportDist, inside, lazyLock, func, metric);
+}
+
+//! Calls func(const PointObj&) for each point object within radius of query point. Objects within distance (1 + epsilon) * radius
+//! may be reported too, unlike the nearest neighbor searches epsilon relaxes the radius itself (in any metric, see metric.h).
+//! Nothing is allocated, func can write the objects into caller buffer. func must not search the same lazy tree (see BuildLazyMidpointSplitTree).
+template<typename FloatT, int Dim, typename ObjData = Empty, typename FuncT, typename MetricT = L2Metric>
+void SearchAproximateRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, EpsilonT<FloatT> epsilon, FuncT func,
+                           const MetricT& metric = MetricT())
+{
+    if (tree.GetObjCount() == 0 || radius < 0)
+        return;
+    DistT<FloatT> radiusDist = metric.Reduce(radius);
+    DistT<FloatT> reportDist = std::max(radiusDist, (DistT<FloatT>)metric.Reduce(radius * (1 + epsilon)));
+    if (tree.GetBBox().Distance(queryPoint, metric) > radiusDist)
+        return;
+    std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+    SearchAproximateRangeR(tree, queryPoint, 0, tree.GetBBox(), radiusDist, reportDist, false, lazyLock, func, metric);
+}
+//! Calls func(const PointObj&) for each point object within radius of query point
+template<typename FloatT, int Dim, typename ObjData = Empty, typename FuncT, typename MetricT = L2Metric>
+void SearchRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, FuncT func, const MetricT& metric = MetricT())
+{
+    SearchAproximateRange<FloatT, Dim, ObjData>(tree, queryPoint, radius, 0, func, metric);
+}
+//! Finds point objects within radius of query point (and possibly some within distance (1 + epsilon) * radius).
+//! The result buffer is cleared and reused, so its capacity is allocated only when it grows. Returns number of found objects.
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+size_t FindAproximateRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, EpsilonT<FloatT> epsilon, std::vector<PointObj<FloatT, Dim, ObjData>>& result,
+                           const MetricT& metric = MetricT())
+{
+    result.clear();
+    SearchAproximateRange<FloatT, Dim, ObjData>(tree, queryPoint, radius, epsilon, [&result](const PointObj<FloatT, Dim, ObjData>& obj) { result.push_back(obj); }, metric);
+    return result.size();
+}
+//! Finds point objects within radius of query point, the result buffer is cleared and reused. Returns number of found objects.
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+size_t FindRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, std::vector<PointObj<FloatT, Dim, ObjData>>& result, const MetricT& metric = MetricT())
+{
+    return FindAproximateRange<FloatT, Dim, ObjData>(tree, queryPoint, radius, 0, result, metric);
+}
+
+//! Counts point objects of the subtree within reduced distance radiusDist of query point. Subtrees whose box is within reportDist are counted
+//! as whole from the subtree counts (or by their leafs, when the tree doesn't keep the counts). Used inside CountAproximateRange.
+template<typename FloatT, int Dim, typename ObjData, typename MetricT>
+index_t CountAproximateRangeR(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, index_t nodeIdx, const Box<FloatT, Dim>& box,
+                              DistT<FloatT> radiusDist, DistT<FloatT> reportDist, bool inside, std::shared_lock<std::shared_mutex>& lazyLock, const MetricT& metric)
+{
+    inside = inside || box.MaxDistance(queryPoint, metric) <= reportDist;
+    if (inside && tree.HasSubtreeCounts())
+        return tree.GetSubtreeLiveCount(nodeIdx);
+    const Node* node = tree.GetNode(nodeIdx);
+    if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+        tree.ExpandLazyLeaf(nodeIdx, box, lazyLock);
+        node = tree.GetNode(nodeIdx);
+    }
+
+    if (node->GetType() == NodeType::LEAF)
+    {
+        const LeafNode* leafNode = (const LeafNode*)node;
+        index_t count = 0;
+        for (index_t i = leafNode->GetPointsBegIndex(); i < leafNode->GetPointsEndIndex(); ++i) {
+            if (tree.IsDeleted(i))
+                continue;
+            if (inside || queryPoint.Distance(tree.HasExactPoints() ? tree.GetObj(i)->point : tree.GetDecodedObj(i, box).point, metric) <= radiusDist)
+                ++count;
+        }
+        return count;
+    }
+
+    ChildNodes<FloatT, Dim> childs = tree.GetChildren(nodeIdx, box);
+    index_t count = 0;
+    if (childs.leftIdx != 0 && (inside || childs.leftBox.Distance(queryPoint, metric) <= radiusDist))
+        count += CountAproximateRangeR(tree, queryPoint, childs.leftIdx, childs.leftBox, radiusDist, reportDist, inside, lazyLock, metric);
+    if (childs.rightIdx != 0 && (inside || childs.rightBox.Distance(queryPoint, metric) <= radiusDist))
+        count += CountAproximateRangeR(tree, queryPoint, childs.rightIdx, childs.rightBox, radiusDist, reportDist, inside, lazyLock, metric);
+    return count;
+}
+
+//! Counts point objects within radius of query point without enumerating them. The count includes all objects within radius
+//! and may include objects within distance (1 + epsilon) * radius, only cells crossing the boundary of the ball are visited.
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+index_t CountAproximateRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, EpsilonT<FloatT> epsilon, const MetricT& metric = MetricT())
+{
+    if (tree.GetObjCount() == 0 || radius < 0)
+        return 0;
+    DistT<FloatT> radiusDist = metric.Reduce(radius);
+    DistT<FloatT> reportDist = std::max(radiusDist, (DistT<FloatT>)metric.Reduce(radius * (1 + epsilon)));
+    if (tree.GetBBox().Distance(queryPoint, metric) > radiusDist)
+        return 0;
+    std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+    return CountAproximateRangeR(tree, queryPoint, 0, tree.GetBBox(), radiusDist, reportDist, false, lazyLock, metric);
+}
+//! Counts point objects within radius of query point
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+index_t CountRange(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, FloatT radius, const MetricT& metric = MetricT())
+{
+    return CountAproximateRange<FloatT, Dim, ObjData>(tree, queryPoint, radius, 0, metric);
+}
+
+//! Calls func(const LeafNode*, const Box&) for each leaf of the subtree. Used inside ForEachLeaf.
+template<typename FloatT, int Dim, typename ObjData, typename FuncT>
+void ForEachLeafR(const BBDTree<FloatT, Dim, ObjData>& tree, index_t nodeIdx, const Box<FloatT, Dim>& box, std::shared_lock<std::shared_mutex>& lazyLock, FuncT& func)
+{
+    const Node* node = tree.GetNode(nodeIdx);
+    if (node->GetType() == NodeType::LEAF && ((const LeafNode*)node)->IsLazy()) {
+        tree.ExpandLazyLeaf(nodeIdx, box, lazyLock);
+        node = tree.GetNode(nodeIdx);
+    }
+    if (node->GetType() == NodeType::LEAF) {
+        func((const LeafNode*)node, box);
+        return;
+    }
+
+    ChildNodes<FloatT, Dim> childs = tree.GetChildren(nodeIdx, box);
+    if (childs.leftIdx != 0)
+        ForEachLeafR(tree, childs.leftIdx, childs.leftBox, lazyLock, func);
+    if (childs.rightIdx != 0)
+        ForEachLeafR(tree, childs.rightIdx, childs.rightBox, lazyLock, func);
+}
+
+//! Calls func(const LeafNode*, const Box&) for each leaf of the tree in depth first order, so consecutive leafs are close in space.
+//! Lazy leafs are expanded, the leaf pointers are valid only inside func. func must not search the same lazy tree (see BuildLazyMidpointSplitTree).
+template<typename FloatT, int Dim, typename ObjData = Empty, typename FuncT>
+void ForEachLeaf(const BBDTree<FloatT, Dim, ObjData>& tree, FuncT func)
+{
+    if (tree.GetObjCount() == 0)
+        return;
+    std::shared_lock<std::shared_mutex> lazyLock = tree.LockLazyLeafs();
+    ForEachLeafR(tree, 0, tree.GetBBox(), lazyLock, func);
+}
+
+//! Finds at most k aproximate nearest neighbors within radius of query point using BBD tree
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsInRadius(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FloatT radius, EpsilonT<FloatT> epsilon, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue,
+                                                                                   const MetricT& metric = MetricT())
+{
+    if (radius < 0)
+        return {};
+    DistT<FloatT> radiusDist = metric.Reduce(radius);
+    DistObjCompare<FloatT, Dim, ObjData> distObjCompare;
+    aknnQueue.Init(k, distObjCompare);
+    TraversalStats<FloatT, Dim> dummyStats;
+    SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, queryPoint, epsilon, aknnQueue, dummyStats, metric, radiusDist);
+    std::vector<PointObj<FloatT, Dim, ObjData>> result;
+    for (const DistObj<FloatT, Dim, ObjData>& distObj : aknnQueue.GetValues()) {
+        if (distObj.dist <= radiusDist)
+            result.push_back(distObj.obj);
+    }
+    return result;
+}
+//! Finds at most k nearest neighbors within radius of query point using BBD tree
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighborsInRadius(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FloatT radius, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue,
+                                                                           const MetricT& metric = MetricT())
+{
+    return FindKAproximateNearestNeighborsInRadius<FloatT, Dim, ObjData>(tree, queryPoint, k, radius, 0, knnQueue, metric);
+}
+
+//! Finds k aproximate nearest neighbors whose category mask (see GetCategoryMask) intersects categoryFilter, metric is distance policy (see metric.h).
+//! Nodes whose subtree category mask doesn't intersect the filter are skipped, so rare categories don't need visiting of the whole neighborhood.
+template<typename FloatT, int Dim, typename ObjData = Empty, bool measureStats = false, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsFiltered(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, uint64_t categoryFilter,
+                                                                                   FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue, TraversalStats<FloatT, Dim>& stats, const MetricT& metric = MetricT())
+{
+    DistObjCompare<FloatT, Dim, ObjData> distObjCompare;
+    aknnQueue.Init(k, distObjCompare);
+    SearchKAproximateNearestNeighbors<FloatT, Dim, ObjData, measureStats>(tree, queryPoint, epsilon, aknnQueue, stats, metric, GetMaxValue<DistT<FloatT>>(), CategoryFilter{categoryFilter});
+    return DistObjsToPointObjs(aknnQueue.GetValues());
+}
+//! Finds k aproximate nearest neighbors whose category mask intersects categoryFilter
 template<typename FloatT, int Dim, typename ObjData = Empty>
-std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighbors(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue)
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKAproximateNearestNeighborsFiltered(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, EpsilonT<FloatT> epsilon, uint64_t categoryFilter,
+                                                                                   FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& aknnQueue)
 {
-    return FindKAproximateNearestNeighbors<FloatT, Dim, ObjData>(tree, queryPoint, k, 0, knnQueue);
+    TraversalStats<FloatT, Dim> dummyStats;
+    return FindKAproximateNearestNeighborsFiltered<FloatT, Dim, ObjData, false>(tree, queryPoint, k, epsilon, categoryFilter, aknnQueue, dummyStats);
+}
+//! Finds k nearest neighbors whose category mask intersects categoryFilter
+template<typename FloatT, int Dim, typename ObjData = Empty, typename MetricT = L2Metric>
+std::vector<PointObj<FloatT, Dim, ObjData>> FindKNearestNeighborsFiltered(const BBDTree<FloatT, Dim, ObjData>& tree, const Vec<FloatT, Dim>& queryPoint, int k, uint64_t categoryFilter,
+                                                                          FixedPriQueue<DistObj<FloatT, Dim, ObjData>>& knnQueue, const MetricT& metric = MetricT())
+{
+    TraversalStats<FloatT, Dim> dummyStats;
+    return FindKAproximateNearestNeighborsFiltered<FloatT, Dim, ObjData, false>(tree, queryPoint, k, 0, categoryFilter, knnQueue, dummyStats, metric);
 }
 
 #endif // AKNN_SEARCH_H
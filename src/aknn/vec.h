@@ -7,6 +7,51 @@
 #include <initializer_list>
 #include <limits>
 #include <iostream>
+#include <type_traits>
+#include <stdint.h>
+
+//! Type used for squared distances of points with coordinates of type T.
+//! Floating point coordinates use the same type, integer coordinates use type with double width, so that the squared distances are exact
+//! as long as Dim * (max coordinate difference)^2 fits into it (coordinates spanning the whole range of T would overflow).
+template<typename T>
+struct DistType { using type = T; };
+template<>
+struct DistType<int32_t> { using type = int64_t; };
+#ifdef __SIZEOF_INT128__
+template<>
+struct DistType<int64_t> { using type = __int128; };
+#else
+//! 128 bit integers aren't available, coordinates should have at most 31 bits
+template<>
+struct DistType<int64_t> { using type = int64_t; };
+#endif
+//! Type used for squared distances of points with coordinates of type T
+template<typename T>
+using DistT = typename DistType<T>::type;
+
+//! Type of the epsilon of aproximate searches for coordinates of type T (integer coordinates still use floating point epsilon)
+template<typename T>
+using EpsilonT = std::conditional_t<std::is_floating_point_v<T>, T, double>;
+
+//! Greatest value of type T, infinity for floating point types.
+//! Computed for signed integers, because std::numeric_limits isn't specialized for __int128 in strict standard mode.
+template<typename T>
+constexpr T GetMaxValue() {
+    if constexpr (std::numeric_limits<T>::has_infinity) {
+        return std::numeric_limits<T>::infinity();
+    } else {
+        T half = (T)1 << (8 * sizeof(T) - 2);
+        return half - 1 + half;
+    }
+}
+//! Lowest value of type T, -infinity for floating point types
+template<typename T>
+constexpr T GetLowestValue() {
+    if constexpr (std::numeric_limits<T>::has_infinity)
+        return -std::numeric_limits<T>::infinity();
+    else
+        return -GetMaxValue<T>() - 1;
+}
 
 //! Vector of values of specified type T with element count equal to Dim
 template<typename T, int Dim>
@@ -45,17 +90,31 @@ struct Vec
     }
 
     //! Squared euclidean norm of the vector
-    T LengthSquared() const {
-        T res = 0;
+    DistT<T> LengthSquared() const {
+        DistT<T> res = 0;
         for (int i = 0; i < Dim; ++i) {
-            res += v[i] * v[i];
+            res += (DistT<T>)v[i] * v[i];
         }
         return res;
     }
 
-    //! Squared euclidean distance between two vectors
-    T DistSquared(const Vec<T, Dim>& other) const {
-        return (other - *this).LengthSquared();
+    //! Squared euclidean distance between two vectors. Differences are computed in DistT, so that they don't overflow for integer coordinates.
+    DistT<T> DistSquared(const Vec<T, Dim>& other) const {
+        DistT<T> res = 0;
+        for (int i = 0; i < Dim; ++i) {
+            DistT<T> diff = (DistT<T>)other[i] - v[i];
+            res += diff * diff;
+        }
+        return res;
+    }
+    //! Reduced distance between two vectors by metric policy (see metric.h), DistSquared for L2Metric
+    template<typename MetricT>
+    DistT<T> Distance(const Vec<T, Dim>& other, const MetricT& metric) const {
+        DistT<T> res = 0;
+        for (int i = 0; i < Dim; ++i) {
+            res = metric.Accumulate(res, (DistT<T>)other[i] - v[i], i);
+        }
+        return res;
     }
 };
 
@@ -78,6 +137,22 @@ struct PointObj
     ObjData data;
 };
 
+//! True if ObjData exposes its categories by member function uint64_t GetCategoryMask() const
+template<typename ObjData, typename = void>
+struct HasCategoryMask : std::false_type {};
+template<typename ObjData>
+struct HasCategoryMask<ObjData, std::void_t<decltype(std::declval<const ObjData&>().GetCategoryMask())>> : std::true_type {};
+
+//! Gets bitmask of categories of point object data, used by filtered searches. Usually single bit 1 << category,
+//! data without GetCategoryMask belong to all categories.
+template<typename ObjData>
+uint64_t GetCategoryMask(const ObjData& data) {
+    if constexpr (HasCategoryMask<ObjData>::value)
+        return data.GetCategoryMask();
+    else
+        return ~(uint64_t)0;
+}
+
 //! Axis aligned bounding box
 template<typename FloatT, int Dim>
 struct Box;
@@ -106,7 +181,7 @@ struct Box
     Vec<FloatT, Dim> max;
 
     //! Initializes to invalid box, representing empty volume
-    Box() : min(std::numeric_limits<FloatT>::infinity()), max(-std::numeric_limits<FloatT>::infinity()) {}
+    Box() : min(GetMaxValue<FloatT>()), max(GetLowestValue<FloatT>()) {}
     //! Initializes to specified values
     Box(Vec<FloatT, Dim> min, Vec<FloatT, Dim> max) : min(min), max(max) {}
 
@@ -116,23 +191,95 @@ struct Box
     }
 
     //! Create tight bounding box from array of points
-    template<typename ObjData = Empty>
-    static Box GetBoundingBox(const std::vector<PointObj<FloatT, Dim, ObjData>>& objs) {
+    template<typename ObjData = Empty, typename AllocT = std::allocator<PointObj<FloatT, Dim, ObjData>>>
+    static Box GetBoundingBox(const std::vector<PointObj<FloatT, Dim, ObjData>, AllocT>& objs) {
         Box bbox;
         std::for_each(objs.begin(), objs.end(), [&bbox](const PointObj<FloatT, Dim, ObjData>& obj) { bbox.Include(obj.point); });
         return bbox;
     }
 
-    //! Size of the box in specified dimension
-    FloatT GetSize(int dim) const { return max[dim] - min[dim]; }
+    //! Size of the box in specified dimension. Computed in DistT, so that integer boxes spanning the whole range of FloatT don't overflow.
+    DistT<FloatT> GetSize(int dim) const { return (DistT<FloatT>)max[dim] - min[dim]; }
+    //! Position of the midpoint split in specified dimension. Used both when building and traversing the tree, so that the boxes are equal bit by bit.
+    //! Integer coordinates are halved exactly (rounded down).
+    FloatT GetSplitValue(int dim) const { return min[dim] + (FloatT)(GetSize(dim) / 2); }
+    //! Dimension of the greatest size, used for splitting
+    int GetSplitDim() const {
+        int splitDim = 0;
+        DistT<FloatT> maxSize = 0;
+        for (int d = 0; d < Dim; ++d) {
+            DistT<FloatT> dSize = GetSize(d);
+            if (dSize > maxSize) {
+                maxSize = dSize;
+                splitDim = d;
+            }
+        }
+        return splitDim;
+    }
+    //! True if Split creates 2 strictly smaller boxes. False for boxes of zero size, integer boxes of size 1 or floating point boxes with the size near precision.
+    bool CanSplit() const {
+        int splitDim = GetSplitDim();
+        FloatT value = GetSplitValue(splitDim);
+        return value > min[splitDim] && value < max[splitDim];
+    }
 
     //! Computes squared euclidean distnace of specified point to this box
-    FloatT SquaredDistance(const Vec<FloatT, Dim>& point) const
+    DistT<FloatT> SquaredDistance(const Vec<FloatT, Dim>& point) const
+    {
+        DistT<FloatT> dist = 0;
+        for (int d = 0; d < Dim; ++d) {
+            dist += Square<DistT<FloatT>>(std::max((DistT<FloatT>)0, (DistT<FloatT>)min[d] - point[d]));
+            dist += Square<DistT<FloatT>>(std::max((DistT<FloatT>)0, (DistT<FloatT>)point[d] - max[d]));
+        }
+        return dist;
+    }
+    //! Computes squared euclidean distance of specified point to the farthest corner of this box
+    DistT<FloatT> MaxSquaredDistance(const Vec<FloatT, Dim>& point) const
     {
-        FloatT dist = 0;
+        DistT<FloatT> dist = 0;
         for (int d = 0; d < Dim; ++d) {
-            dist += Square<FloatT>(std::max((FloatT)0, min[d] - point[d]));
-            dist += Square<FloatT>(std::max((FloatT)0, point[d] - max[d]));
+            dist += Square<DistT<FloatT>>(std::max((DistT<FloatT>)point[d] - min[d], (DistT<FloatT>)max[d] - point[d]));
+        }
+        return dist;
+    }
+
+    //! Computes reduced distance of specified point to this box by metric policy (see metric.h)
+    template<typename MetricT>
+    DistT<FloatT> Distance(const Vec<FloatT, Dim>& point, const MetricT& metric) const
+    {
+        DistT<FloatT> dist = 0;
+        for (int d = 0; d < Dim; ++d) {
+            dist = metric.Accumulate(dist, std::max({(DistT<FloatT>)0, (DistT<FloatT>)min[d] - point[d], (DistT<FloatT>)point[d] - max[d]}), d);
+        }
+        return dist;
+    }
+    //! Computes reduced distance of specified point to the farthest corner of this box by metric policy
+    template<typename MetricT>
+    DistT<FloatT> MaxDistance(const Vec<FloatT, Dim>& point, const MetricT& metric) const
+    {
+        DistT<FloatT> dist = 0;
+        for (int d = 0; d < Dim; ++d) {
+            dist = metric.Accumulate(dist, std::max((DistT<FloatT>)point[d] - min[d], (DistT<FloatT>)max[d] - point[d]), d);
+        }
+        return dist;
+    }
+    //! Computes reduced distance between the nearest points of this box and other box by metric policy, zero for overlapping boxes
+    template<typename MetricT>
+    DistT<FloatT> Distance(const Box<FloatT, Dim>& other, const MetricT& metric) const
+    {
+        DistT<FloatT> dist = 0;
+        for (int d = 0; d < Dim; ++d) {
+            dist = metric.Accumulate(dist, std::max({(DistT<FloatT>)0, (DistT<FloatT>)min[d] - other.max[d], (DistT<FloatT>)other.min[d] - max[d]}), d);
+        }
+        return dist;
+    }
+    //! Computes reduced distance between the farthest points of this box and other box by metric policy
+    template<typename MetricT>
+    DistT<FloatT> MaxDistance(const Box<FloatT, Dim>& other, const MetricT& metric) const
+    {
+        DistT<FloatT> dist = 0;
+        for (int d = 0; d < Dim; ++d) {
+            dist = metric.Accumulate(dist, std::max((DistT<FloatT>)other.max[d] - min[d], (DistT<FloatT>)max[d] - other.min[d]), d);
         }
         return dist;
     }
@@ -158,18 +305,10 @@ struct Box
 
     //! Splits the box in 2 halfs at dimension of the greatest size
     BoxSplit<FloatT, Dim> Split() const {
-        int splitDim = 0;
-        FloatT maxSize = 0;
-        for (int d = 0; d < Dim; ++d) {
-            FloatT dSize = GetSize(d);
-            if (dSize > maxSize) {
-                maxSize = dSize;
-                splitDim = d;
-            }
-        }
+        int splitDim = GetSplitDim();
         Box left = *this;
         Box right = *this;
-        FloatT value = min[splitDim] + maxSize / 2;
+        FloatT value = GetSplitValue(splitDim);
         left.max[splitDim] = value;
         right.min[splitDim] = value;
         return {splitDim, value, left, right};
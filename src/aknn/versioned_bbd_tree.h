@@ -0,0 +1,81 @@
+#ifndef AKNN_VERSIONED_BBD_TREE_H
+#define AKNN_VERSIONED_BBD_TREE_H
+
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <stdint.h>
+
+#include "bbd_tree.h"
+
+//! Handle of BBD tree which can be replaced while other threads search it (read-copy-update).
+//! Readers take a snapshot, which is reference counted pointer to immutable tree, and search it without any locks.
+//! Replacement tree is built by a background thread and swapped in atomically, the old tree is released together with its last snapshot.
+//! Snapshots may be taken by any thread, rebuilds and replacements should be started by one writer thread.
+template<typename FloatT, int Dim, typename ObjData = Empty>
+class VersionedBBDTree
+{
+public:
+    using BBDTreeT = BBDTree<FloatT, Dim, ObjData>;
+    using Snapshot = std::shared_ptr<const BBDTreeT>;
+    //! Builds replacement tree, gets snapshot of the current tree
+    using Builder = std::function<BBDTreeT(const BBDTreeT&)>;
+
+    //! Initializes the handle with specified tree
+    VersionedBBDTree(BBDTreeT tree = BBDTreeT()) : _current(std::make_shared<BBDTreeT>(std::move(tree))) {}
+    VersionedBBDTree(const VersionedBBDTree&) = delete;
+    VersionedBBDTree& operator=(const VersionedBBDTree&) = delete;
+    //! Waits for the running rebuild
+    ~VersionedBBDTree() { WaitForRebuild(); }
+
+    //! Gets snapshot of the current tree, the tree stays alive until the snapshot is released
+    Snapshot GetSnapshot() const { return std::atomic_load(&_current); }
+    //! Gets number of replacements of the tree
+    uint64_t GetVersion() const { return _version.load(); }
+
+    //! Replaces the current tree, searches running on older snapshots aren't affected
+    void Replace(BBDTreeT tree)
+    {
+        // non-const object, so that searches may expand lazy trees
+        Snapshot snapshot = std::make_shared<BBDTreeT>(std::move(tree));
+        std::atomic_store(&_current, snapshot);
+        ++_version;
+    }
+
+    //! Starts building the replacement tree in background thread, the tree is swapped in when the build finishes.
+    //! Returns false if the previous rebuild is still running.
+    bool StartRebuild(Builder builder)
+    {
+        if (_rebuilding.exchange(true))
+            return false;
+        if (_thread.joinable())
+            _thread.join();
+        _thread = std::thread([this, builder = std::move(builder)]() {
+            Snapshot snapshot = GetSnapshot();
+            Replace(builder(*snapshot));
+            _rebuilding = false;
+        });
+        return true;
+    }
+    //! True if background rebuild is running
+    bool IsRebuilding() const { return _rebuilding.load(); }
+    //! Waits until the running rebuild swaps in its tree
+    void WaitForRebuild()
+    {
+        if (_thread.joinable())
+            _thread.join();
+    }
+
+private:
+    //! Current tree, accessed only by atomic shared_ptr operations
+    Snapshot _current;
+    //! Number of replacements
+    std::atomic<uint64_t> _version{0};
+    //! Thread of the last rebuild
+    std::thread _thread;
+    //! True while background rebuild is running
+    std::atomic<bool> _rebuilding{false};
+};
+
+#endif // AKNN_VERSIONED_BBD_TREE_H
@@ -5,13 +5,36 @@
 #include <memory>
 #include <chrono>
 #include <sstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <numeric>
+#include <cmath>
 
 #include <aknn/vec.h>
 #include <aknn/bbd_tree.h>
 #include <aknn/search.h>
+#include <aknn/bbd_forest.h>
+#include <aknn/versioned_bbd_tree.h>
+#include <aknn/query_recorder.h>
+#include <aknn/kde.h>
+#include <aknn/dbscan.h>
+#include <aknn/normals.h>
+#include <aknn/closest_pair.h>
+#include <aknn/rknn.h>
+#include <aknn/anytime.h>
+#include <aknn/knn_cursor.h>
+#include <aknn/query_cache.h>
 
 #include <argumentum/argparse-h.h>
 
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 
 std::string GetMemoryString(int memory)
 {
@@ -42,22 +65,73 @@ void PrintTimeString(FILE* file, double microseconds)
    fprintf(file, "%.1f s", microseconds);
 }
 
-template<int Dim>
-std::vector<PointObj<float, Dim>> LoadPoints(const std::string& filename)
+//! Counts last level cache misses of the current thread. Available only on linux with perf events enabled.
+class LLCMissCounter
+{
+private:
+   int _fd = -1;
+public:
+   LLCMissCounter()
+   {
+#ifdef __linux__
+      perf_event_attr attr = {};
+      attr.type = PERF_TYPE_HARDWARE;
+      attr.size = sizeof(perf_event_attr);
+      attr.config = PERF_COUNT_HW_CACHE_MISSES;
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      _fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+   }
+   ~LLCMissCounter()
+   {
+#ifdef __linux__
+      if (_fd >= 0)
+         close(_fd);
+#endif
+   }
+   bool IsAvailable() const { return _fd >= 0; }
+   void Start()
+   {
+#ifdef __linux__
+      if (_fd >= 0) {
+         ioctl(_fd, PERF_EVENT_IOC_RESET, 0);
+         ioctl(_fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+#endif
+   }
+   //! Stops counting and returns number of misses since Start
+   long long Stop()
+   {
+      long long count = 0;
+#ifdef __linux__
+      if (_fd >= 0) {
+         ioctl(_fd, PERF_EVENT_IOC_DISABLE, 0);
+         if (read(_fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+      }
+#endif
+      return count;
+   }
+};
+
+template<int Dim, typename CoordT = float>
+std::vector<PointObj<CoordT, Dim>> LoadPoints(const std::string& filename)
 {
-   std::vector<PointObj<float, Dim>> res;
+   std::vector<PointObj<CoordT, Dim>> res;
    std::ifstream file(filename);
    if (!file) {
       std::cout << "failed to read file: " << filename << std::endl;
       return res;
    }
-   Vec<float, Dim> v;
+   Vec<CoordT, Dim> v;
    while (file.peek() != EOF)
    {
       for (int d = 0; d < Dim; ++d) {
          file >> v[d];
       }
-      res.push_back(PointObj<float, Dim>({v}));
+      res.push_back(PointObj<CoordT, Dim>({v}));
    }
    
    return res;
@@ -461,20 +535,19 @@ public:
                {
                   const SplitNode* splitNode = (const SplitNode*)node;
                   int splitDim = splitNode->GetSplitDim();
-                  float half = (distNode.box.min[splitDim] + distNode.box.max[splitDim]) / 2;
+                  float half = distNode.box.GetSplitValue(splitDim);
                   leftBox.max[splitDim] = half;
                   rightBox.min[splitDim] = half;
                   WriteSplit(file, distNode.box, half, splitDim, {t, 0, t});
                }
                else if (node->GetType() == NodeType::SHRINK)
                {
-                  const ShrinkNode<float, 3>* shrinkNode = (const ShrinkNode<float, 3>*)node;
-                  leftBox = shrinkNode->GetShrinkBox();
+                  leftBox = tree.GetShrinkBox(distNode.nodeIdx, distNode.box);
                   WriteBox(file, leftBox, {0, t, 0});
                }
                float depth = distNode.dist + 1;
                if (innerNode->HasLeftChild())
-                  nodeQueue.push({depth, distNode.nodeIdx + GetNodeOffset<float, 3>(node->GetType()), leftBox});
+                  nodeQueue.push({depth, tree.GetLeftChildIndex(distNode.nodeIdx), leftBox});
                if (innerNode->GetRightChildIndex() != 0)
                   nodeQueue.push({depth, innerNode->GetRightChildIndex(), rightBox});
             }
@@ -671,6 +744,1254 @@ protected:
    }
 };
 
+class LayoutBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 1;
+   float epsilon = 0;
+   int leafSize = 10;
+   int queryCount = 100000;
+   int blockSize = 4096;
+public:
+   LayoutBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(epsilon, "--eps").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(blockSize, "--block").nargs(1);
+   }
+
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < queryCount; ++i) {
+         Vec<float, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = ((float)rand()) / RAND_MAX;
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      BBDTree<float, Dim> blockTree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      blockTree.RelayoutToBlocks(blockSize);
+      BBDTree<float, Dim> vebTree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      vebTree.RelayoutVanEmdeBoas();
+      BBDTree<float, Dim> compactTree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      compactTree.CompactShrinkNodes();
+      compactTree.RelayoutToBlocks(blockSize);
+      BBDTree<float, Dim> quantTree = compactTree;
+      quantTree.QuantizeLeafPoints(8);
+      // aproximate results, only the quantized points are kept
+      BBDTree<float, Dim> quantOnlyTree = compactTree;
+      quantOnlyTree.QuantizeLeafPoints(8, false);
+
+      std::cout << "layout      memory    points    query time  LLC misses  cache lines  pages" << std::endl;
+      Measure<Dim>("preorder", tree, queryPoints);
+      Measure<Dim>("blocks", blockTree, queryPoints);
+      Measure<Dim>("vEB", vebTree, queryPoints);
+      Measure<Dim>("compact", compactTree, queryPoints);
+      Measure<Dim>("quant8", quantTree, queryPoints);
+      Measure<Dim>("quant8only", quantOnlyTree, queryPoints);
+   }
+
+   //! Prints average query time, LLC misses, touched cache lines and touched pages per query
+   template<int Dim>
+   void Measure(const std::string& layoutName, const BBDTree<float, Dim>& tree, const std::vector<Vec<float, Dim>>& queryPoints)
+   {
+      using namespace std::chrono;
+      HeapPriQueue<DistObj<float, Dim>> priQueue;
+      LLCMissCounter llcMissCounter;
+
+      llcMissCounter.Start();
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         FindKAproximateNearestNeighbors<float, Dim>(tree, queryPoint, k, epsilon, priQueue);
+      }
+      double totalTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+      long long llcMisses = llcMissCounter.Stop();
+
+      double cacheLines = 0;
+      double pages = 0;
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         TraversalStats<float, Dim> lineStats;
+         lineStats.pageSize = CACHE_LINE_SIZE;
+         FindKAproximateNearestNeighbors<float, Dim, Empty, true>(tree, queryPoint, k, epsilon, priQueue, lineStats);
+         cacheLines += lineStats.touchedPages;
+         TraversalStats<float, Dim> pageStats;
+         pageStats.pageSize = blockSize;
+         FindKAproximateNearestNeighbors<float, Dim, Empty, true>(tree, queryPoint, k, epsilon, priQueue, pageStats);
+         pages += pageStats.touchedPages;
+      }
+
+      int queryCount = (int)queryPoints.size();
+      BBDTreeStats treeStats = tree.GetStats();
+      printf("%-10s  %-8s  %-8s  %7.2f us  ", layoutName.c_str(), GetMemoryString(treeStats.memoryConsumption).c_str(), GetMemoryString((int)treeStats.objMemoryConsumption).c_str(),
+             totalTime / queryCount);
+      if (llcMissCounter.IsAvailable()) {
+         printf("%10.2f  ", (double)llcMisses / queryCount);
+      } else {
+         printf("%10s  ", "n/a");
+      }
+      printf("%11.2f  %5.2f\n", cacheLines / queryCount, pages / queryCount);
+   }
+};
+
+class CoordBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 2;
+   int k = 10;
+   int leafSize = 10;
+   int queryCount = 100000;
+public:
+   CoordBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+   }
+
+   //! Compares trees with float and integer coordinates built from integer grid points
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<int32_t, Dim>> points = LoadPoints<Dim, int32_t>(inputFile);
+      if (points.empty())
+         return;
+      Box<int32_t, Dim> bbox = Box<int32_t, Dim>::GetBoundingBox(points);
+
+      std::vector<Vec<int32_t, Dim>> queryPoints;
+      for (int i = 0; i < queryCount; ++i) {
+         Vec<int32_t, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+            queryPoint[d] = (int32_t)(bbox.min[d] + (DistT<int32_t>)(((double)rand()) / RAND_MAX * bbox.GetSize(d)));
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      std::cout << "coords    memory    build time  query time" << std::endl;
+      Measure<float, Dim>("float", LoadPoints<Dim, float>(inputFile), queryPoints);
+      Measure<int32_t, Dim>("int32", points, queryPoints);
+   }
+
+   //! Prints memory, build time and average query time of tree with CoordT coordinates
+   template<typename CoordT, int Dim>
+   void Measure(const std::string& coordsName, const std::vector<PointObj<CoordT, Dim>>& points, const std::vector<Vec<int32_t, Dim>>& queryPoints)
+   {
+      using namespace std::chrono;
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      BBDTree<CoordT, Dim> tree = BBDTree<CoordT, Dim>::BuildMidpointSplitTree(leafSize, points);
+      double buildTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      HeapPriQueue<DistObj<CoordT, Dim>> priQueue;
+      start = high_resolution_clock::now();
+      for (const Vec<int32_t, Dim>& queryPoint : queryPoints) {
+         Vec<CoordT, Dim> coordQueryPoint;
+         for (int d = 0; d < Dim; ++d) {
+            coordQueryPoint[d] = (CoordT)queryPoint[d];
+         }
+         FindKNearestNeighbors<CoordT, Dim>(tree, coordQueryPoint, k, priQueue);
+      }
+      double totalTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      printf("%-8s  %-8s  %7.2f ms  %7.2f us\n", coordsName.c_str(), GetMemoryString(tree.GetStats().memoryConsumption).c_str(), buildTime, totalTime / queryPoints.size());
+   }
+};
+
+class ForestBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   int leafSize = 10;
+   int bufferSize = 128;
+   int queryCount = 100000;
+public:
+   ForestBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(bufferSize, "--buffer").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+   }
+
+   //! Compares insertion into BBD forest with building static tree and their query times
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < queryCount; ++i) {
+         Vec<float, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = ((float)rand()) / RAND_MAX;
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      double buildTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      BBDForest<float, Dim> forest(leafSize, bufferSize);
+      start = high_resolution_clock::now();
+      for (const PointObj<float, Dim>& point : points) {
+         forest.Insert(point);
+      }
+      double insertTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      HeapPriQueue<DistObj<float, Dim>> priQueue;
+      start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         FindKNearestNeighbors<float, Dim>(tree, queryPoint, k, priQueue);
+      }
+      double treeQueryTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+      start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         FindKNearestNeighbors<float, Dim>(forest, queryPoint, k, priQueue);
+      }
+      double forestQueryTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      printf("index   trees  build time  inserts/s   query time\n");
+      printf("tree    %5d  %7.2f ms  %9s  %7.2f us\n", 1, buildTime, "-", treeQueryTime / queryCount);
+      printf("forest  %5d  %7.2f ms  %9.0f  %7.2f us\n", forest.GetTreeCount(), insertTime, points.size() / (insertTime / 1000), forestQueryTime / queryCount);
+   }
+};
+
+class RebuildBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   int leafSize = 10;
+   int threadCount = 4;
+   int rebuildCount = 10;
+public:
+   RebuildBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+      params.add_parameter(rebuildCount, "--rebuilds").nargs(1);
+   }
+
+   //! Runs queries in reader threads on snapshots of versioned tree, while the tree is rebuilt in background (or for 1 s without rebuilds).
+   //! Returns sorted query latencies in microseconds, buildTime is time of one rebuild in milliseconds
+   template<int Dim>
+   std::vector<double> RunReaders(VersionedBBDTree<float, Dim>& versionedTree, const std::vector<Vec<float, Dim>>& queryPoints, int rebuilds, double& buildTime)
+   {
+      using namespace std::chrono;
+      std::atomic<bool> stop{false};
+      std::vector<std::vector<double>> latencies(threadCount);
+      std::vector<std::thread> readers;
+      for (int thread = 0; thread < threadCount; ++thread) {
+         readers.emplace_back([&, thread]() {
+            HeapPriQueue<DistObj<float, Dim>> priQueue;
+            for (size_t query = thread; !stop; query += threadCount) {
+               const Vec<float, Dim>& queryPoint = queryPoints[query % queryPoints.size()];
+               high_resolution_clock::time_point start = high_resolution_clock::now();
+               typename VersionedBBDTree<float, Dim>::Snapshot snapshot = versionedTree.GetSnapshot();
+               FindKNearestNeighbors<float, Dim>(*snapshot, queryPoint, k, priQueue);
+               latencies[thread].push_back(duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count());
+            }
+         });
+      }
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      if (rebuilds == 0) {
+         std::this_thread::sleep_for(milliseconds(1000));
+      }
+      for (int i = 0; i < rebuilds; ++i) {
+         versionedTree.StartRebuild([this](const BBDTree<float, Dim>& tree) {
+            std::vector<PointObj<float, Dim>> points(tree.GetObj(0), tree.GetObj(0) + tree.GetObjCount());
+            return BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+         });
+         versionedTree.WaitForRebuild();
+      }
+      buildTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count() / std::max(1, rebuilds);
+      stop = true;
+      for (std::thread& reader : readers) {
+         reader.join();
+      }
+
+      std::vector<double> allLatencies;
+      for (const std::vector<double>& threadLatencies : latencies) {
+         allLatencies.insert(allLatencies.end(), threadLatencies.begin(), threadLatencies.end());
+      }
+      std::sort(allLatencies.begin(), allLatencies.end());
+      return allLatencies;
+   }
+
+   //! Prints latency percentiles of sorted latencies
+   void PrintLatencies(const char* name, const std::vector<double>& latencies)
+   {
+      auto percentile = [&latencies](double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+      printf("%-11s %9zu  %7.2f  %7.2f  %7.2f  %8.2f  %8.2f\n", name, latencies.size(),
+         percentile(0.5), percentile(0.9), percentile(0.99), percentile(0.999), latencies.back());
+   }
+
+   //! Compares latencies of queries on versioned tree with and without concurrent background rebuilds
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < 100000; ++i) {
+         Vec<float, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = ((float)rand()) / RAND_MAX;
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      VersionedBBDTree<float, Dim> versionedTree(BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points));
+      double buildTime;
+      std::vector<double> idleLatencies = RunReaders<Dim>(versionedTree, queryPoints, 0, buildTime);
+      std::vector<double> rebuildLatencies = RunReaders<Dim>(versionedTree, queryPoints, rebuildCount, buildTime);
+
+      printf("readers %d, rebuilds %d, rebuild time %.2f ms, version %llu\n", threadCount, rebuildCount, buildTime, (unsigned long long)versionedTree.GetVersion());
+      printf("phase         queries   p50 us   p90 us   p99 us  p99.9 us    max us\n");
+      PrintLatencies("idle", idleLatencies);
+      PrintLatencies("rebuilding", rebuildLatencies);
+   }
+};
+
+class LazyBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   int leafSize = 10;
+   int expandFactor = 16;
+   int queryCount = 500;
+public:
+   LazyBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(expandFactor, "--expand").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+   }
+
+   //! Builds the tree, runs the queries and prints build time, time to the first answer and time of all the queries
+   template<int Dim, typename BuildFuncT>
+   void Measure(const char* name, const std::vector<Vec<float, Dim>>& queryPoints, BuildFuncT buildFunc)
+   {
+      using namespace std::chrono;
+      HeapPriQueue<DistObj<float, Dim>> priQueue;
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      BBDTree<float, Dim> tree = buildFunc();
+      double buildTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+      FindKNearestNeighbors<float, Dim>(tree, queryPoints[0], k, priQueue);
+      double firstTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+      for (size_t i = 1; i < queryPoints.size(); ++i) {
+         FindKNearestNeighbors<float, Dim>(tree, queryPoints[i], k, priQueue);
+      }
+      double totalTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+      printf("%-6s %9.2f ms %12.2f ms %9.2f ms %7d\n", name, buildTime, firstTime, totalTime, tree.GetStats().leafNodeCount);
+   }
+
+   //! Compares complete and lazy build for workloads with few queries
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < std::max(1, queryCount); ++i) {
+         Vec<float, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = ((float)rand()) / RAND_MAX;
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      printf("build   build time  first answer  all queries   leafs\n");
+      Measure<Dim>("full", queryPoints, [&]() { return BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points); });
+      Measure<Dim>("lazy", queryPoints, [&]() { return BBDTree<float, Dim>::BuildLazyMidpointSplitTree(leafSize, points, expandFactor); });
+   }
+};
+
+class AdaptiveBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   std::string queryFile;
+   int dim = 3;
+   int k = 10;
+   int leafSize = 10;
+   int adaptFactor = 4;
+   int queryCount = 10000;
+   int hotSpotCount = 4;
+public:
+   AdaptiveBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(queryFile, "--query-file").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(adaptFactor, "--adapt").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(hotSpotCount, "--hot-spots").nargs(1);
+   }
+
+   //! Generates skewed workload, most of the queries are close to a few hot data points
+   template<int Dim>
+   std::vector<Vec<float, Dim>> GenerateQueries(const std::vector<PointObj<float, Dim>>& points, int count)
+   {
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < count; ++i) {
+         Vec<float, Dim> queryPoint;
+         if (i % 10 == 0) {
+            for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = ((float)rand()) / RAND_MAX;
+            }
+         } else {
+            // hot spots are the first data points, so both generated workloads share them
+            const Vec<float, Dim>& hotSpot = points[(i % std::max(1, hotSpotCount)) % points.size()].point;
+            for (int d = 0; d < Dim; ++d) {
+               queryPoint[d] = hotSpot[d] + 0.02f * (((float)rand()) / RAND_MAX - 0.5f);
+            }
+         }
+         queryPoints.push_back(queryPoint);
+      }
+      return queryPoints;
+   }
+
+   //! Runs the queries and prints average traversal steps and query time
+   template<int Dim>
+   void Measure(const char* name, const BBDTree<float, Dim>& tree, const std::vector<Vec<float, Dim>>& queryPoints)
+   {
+      using namespace std::chrono;
+      HeapPriQueue<DistObj<float, Dim>> priQueue;
+      // warm up caches, so that the order of measured trees doesn't matter
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         FindKNearestNeighbors<float, Dim>(tree, queryPoint, k, priQueue);
+      }
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         FindKNearestNeighbors<float, Dim>(tree, queryPoint, k, priQueue);
+      }
+      double avgTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count() / queryPoints.size();
+
+      TraversalStats<float, Dim> stats;
+      double totalSteps = 0;
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         stats.traversalSteps = 0;
+         stats.visitedLeafs = 0;
+         stats.visitedNodes.clear();
+         FindKAproximateNearestNeighbors<float, Dim, Empty, true>(tree, queryPoint, k, 0, priQueue, stats);
+         totalSteps += stats.traversalSteps;
+      }
+      printf("%-9s %10.1f %12.2f us %7d\n", name, totalSteps / queryPoints.size(), avgTime, tree.GetStats().leafNodeCount);
+   }
+
+   //! Compares midpoint split tree with the tree adapted to recorded sample of the workload
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+
+      std::vector<Vec<float, Dim>> workload;
+      if (queryFile.size() > 0) {
+         for (const PointObj<float, Dim>& queryObj : LoadPoints<Dim>(queryFile))
+            workload.push_back(queryObj.point);
+      } else {
+         workload = GenerateQueries<Dim>(points, queryCount);
+      }
+      if (workload.empty())
+         return;
+
+      // record the first half of the workload, measure on the second half
+      size_t recordedCount = std::max<size_t>(1, workload.size() / 2);
+      QueryRecorder<float, Dim> recorder(10000);
+      for (size_t i = 0; i < recordedCount; ++i)
+         recorder.Record(workload[i]);
+      std::vector<Vec<float, Dim>> queryPoints(workload.begin() + (workload.size() > 1 ? recordedCount : 0), workload.end());
+
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      BBDTree<float, Dim> adaptiveTree = BBDTree<float, Dim>::BuildQueryAdaptiveTree(leafSize, points, recorder.GetSample(), adaptFactor);
+
+      printf("tree      avg steps     avg time   leafs\n");
+      Measure<Dim>("midpoint", tree, queryPoints);
+      Measure<Dim>("adaptive", adaptiveTree, queryPoints);
+   }
+};
+
+class KdeBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 2;
+   int leafSize = 10;
+   double bandwidth = 0.01;
+   double relativeError = 0.01;
+   int queryCount = 1000;
+   int threadCount = 0;
+public:
+   KdeBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(bandwidth, "--bandwidth").nargs(1);
+      params.add_parameter(relativeError, "--error").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+   }
+
+   //! Compares linear kernel density estimation with the tree estimator on single thread and on all threads
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < std::max(1, queryCount); ++i) {
+         queryPoints.push_back(points[rand() % points.size()].point);
+      }
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      std::vector<double> expected;
+      for (const Vec<float, Dim>& queryPoint : queryPoints) {
+         expected.push_back(LinearKernelDensity(points, queryPoint, bandwidth));
+      }
+      double linearTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      start = high_resolution_clock::now();
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      KernelDensityEstimator<float, Dim> estimator(tree, bandwidth);
+      double buildTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      std::vector<double> result;
+      start = high_resolution_clock::now();
+      estimator.EstimateBatch(queryPoints, relativeError, result, 1);
+      double treeTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+      start = high_resolution_clock::now();
+      estimator.EstimateBatch(queryPoints, relativeError, result, threadCount);
+      double parallelTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      double maxError = 0;
+      for (size_t i = 0; i < queryPoints.size(); ++i) {
+         if (expected[i] > 0)
+            maxError = std::max(maxError, std::abs(result[i] - expected[i]) / expected[i]);
+      }
+      printf("linear %.2f ms, tree build %.2f ms, tree %.2f ms, tree on %d threads %.2f ms, max relative error %g\n",
+         linearTime, buildTime, treeTime, threadCount <= 0 ? GetDefaultThreadCount() : threadCount, parallelTime, maxError);
+   }
+};
+
+class DbscanOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 2;
+   int leafSize = 10;
+   double radius = 0.01;
+   int minPoints = 10;
+   double countEpsilon = 0;
+   int threadCount = 0;
+   int scalePoints = 0;
+public:
+   DbscanOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0 || scalePoints > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(radius, "--radius").nargs(1);
+      params.add_parameter(minPoints, "--min").nargs(1);
+      params.add_parameter(countEpsilon, "--count-eps").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+      params.add_parameter(scalePoints, "--scale").nargs(1);
+   }
+
+   //! Times of the phases in ms and the result of the clustering
+   struct ClusteringTimes
+   {
+      double build;
+      double leafs;
+      double core;
+      double cluster;
+      double border;
+      int leafCount;
+      int clusterCount;
+      int coreCount;
+      int noiseCount;
+
+      double GetTotal() const { return build + leafs + core + cluster + border; }
+   };
+
+   //! Clusters the points by DBSCAN with specified radius and measures each phase
+   template<int Dim>
+   ClusteringTimes Cluster(const std::vector<PointObj<float, Dim>>& points, float clusterRadius)
+   {
+      using namespace std::chrono;
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      auto lap = [&start]() {
+         high_resolution_clock::time_point now = high_resolution_clock::now();
+         double time = duration_cast<duration<double, std::milli>>(now - start).count();
+         start = now;
+         return time;
+      };
+      ClusteringTimes times;
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      times.build = lap();
+      DBSCAN<float, Dim> dbscan(tree, clusterRadius, minPoints, (float)countEpsilon, threadCount);
+      times.leafs = lap();
+      dbscan.FindCorePoints();
+      times.core = lap();
+      dbscan.ClusterCorePoints();
+      times.cluster = lap();
+      dbscan.AssignBorderPoints();
+      times.border = lap();
+
+      times.leafCount = (int)dbscan.GetLeafCount();
+      times.clusterCount = dbscan.GetClusterCount();
+      times.coreCount = 0;
+      times.noiseCount = 0;
+      for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+         times.coreCount += dbscan.IsCorePoint(i);
+         times.noiseCount += dbscan.GetLabels()[i] == DBSCAN<float, Dim>::NOISE;
+      }
+      return times;
+   }
+
+   //! Clusters the points by DBSCAN and prints time of each phase, then prints times of random datasets up to scalePoints points
+   template<int Dim>
+   void Execute()
+   {
+      if (inputFile.size() > 0) {
+         std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+         ClusteringTimes times = Cluster<Dim>(points, (float)radius);
+         printf("points %d, leafs %d, threads %d\n", (int)points.size(), times.leafCount, threadCount <= 0 ? GetDefaultThreadCount() : threadCount);
+         printf("phase        time\n");
+         printf("build   %9.2f ms\n", times.build);
+         printf("leafs   %9.2f ms\n", times.leafs);
+         printf("core    %9.2f ms\n", times.core);
+         printf("cluster %9.2f ms\n", times.cluster);
+         printf("border  %9.2f ms\n", times.border);
+         printf("total   %9.2f ms\n", times.GetTotal());
+         printf("clusters %d, core points %d, noise points %d\n", times.clusterCount, times.coreCount, times.noiseCount);
+      }
+      if (scalePoints > 0) {
+         PrintScaling<Dim>();
+      }
+   }
+
+   //! Clusters 20 dense clusters with 10 % of uniform noise inside unit cube, growing 10 times up to scalePoints points. Radius shrinks with the count,
+   //! so that the points spread uniformly would have minPoints neighbors in average, and time per point stays flat when the clustering scales linearly.
+   template<int Dim>
+   void PrintScaling()
+   {
+      const int clusterCount = 20;
+      const float clusterSize = 0.05f;
+      std::vector<Vec<float, Dim>> centers(clusterCount);
+      for (Vec<float, Dim>& center : centers) {
+         for (int d = 0; d < Dim; ++d)
+            center[d] = clusterSize + (1 - 2 * clusterSize) * ((float)rand()) / RAND_MAX;
+      }
+      double unitBallVolume = std::pow(M_PI, Dim / 2.0) / std::tgamma(Dim / 2.0 + 1);
+
+      printf("points      radius     build ms   core ms  cluster ms  border ms  total ms  us/point  clusters\n");
+      for (int count = std::min(100000, scalePoints); ; count = (int)std::min<int64_t>((int64_t)count * 10, scalePoints)) {
+         std::vector<PointObj<float, Dim>> points(count);
+         for (int i = 0; i < count; ++i) {
+            bool noise = i % 10 == 0;
+            const Vec<float, Dim>& center = centers[i % clusterCount];
+            for (int d = 0; d < Dim; ++d) {
+               float value = ((float)rand()) / RAND_MAX;
+               points[i].point[d] = noise ? value : center[d] + clusterSize * (value - 0.5f);
+            }
+         }
+         float clusterRadius = (float)std::pow(minPoints / (count * unitBallVolume), 1.0 / Dim);
+         ClusteringTimes times = Cluster<Dim>(points, clusterRadius);
+         printf("%-10d  %-9.6f  %8.0f  %8.0f  %10.0f  %9.0f  %8.0f  %8.3f  %8d\n", count, clusterRadius, times.build, times.core, times.cluster, times.border,
+                times.GetTotal(), 1000 * times.GetTotal() / count, times.clusterCount);
+         if (count >= scalePoints)
+            break;
+      }
+   }
+};
+
+class NormalsOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int k = 10;
+   int leafSize = 10;
+   int threadCount = 0;
+public:
+   NormalsOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+         Execute();
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+   }
+
+   //! Estimates normals of 3D point cloud and prints the time
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, 3>> points = LoadPoints<3>(inputFile);
+      std::vector<PointObj<float, 3, Vec<float, 3>>> cloud(points.size());
+      for (size_t i = 0; i < points.size(); ++i) {
+         cloud[i].point = points[i].point;
+      }
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      EstimateNormals(cloud, k, [](Vec<float, 3>& data, const Vec<float, 3>& normal) { data = normal; }, threadCount, leafSize);
+      double time = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+      printf("points %d, threads %d, time %.2f ms, %.2f Mpoints/s\n", (int)cloud.size(), threadCount <= 0 ? GetDefaultThreadCount() : threadCount,
+         time, cloud.size() / time / 1000);
+   }
+};
+
+class ClosestPairOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFileA;
+   std::string inputFileB;
+   int dim = 2;
+   int leafSize = 10;
+   int k = 1;
+   double epsilon = 0;
+   int threadCount = 0;
+public:
+   ClosestPairOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFileA.size() > 0 && inputFileB.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFileA, "--in").nargs(1);
+      params.add_parameter(inputFileB, "--in2").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(epsilon, "--eps").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+   }
+
+   //! Compares time of the dual tree closest pairs search with nearest neighbor search of each point of the first set
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> pointsA = LoadPoints<Dim>(inputFileA);
+      std::vector<PointObj<float, Dim>> pointsB = LoadPoints<Dim>(inputFileB);
+      BBDTree<float, Dim> treeA = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, pointsA);
+      BBDTree<float, Dim> treeB = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, pointsB);
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      DistT<float> nearestDist = GetMaxValue<DistT<float>>();
+      for (const PointObj<float, Dim>& obj : pointsA)
+         nearestDist = std::min(nearestDist, obj.point.DistSquared(FindNearestNeighbor(treeB, obj.point).point));
+      double loopTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      start = high_resolution_clock::now();
+      std::vector<ObjPair<float, Dim>> pairs = FindKAproximateClosestPairs(treeA, treeB, k, (float)epsilon, threadCount);
+      double dualTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      printf("points %d x %d, k %d, eps %g, threads %d\n", (int)pointsA.size(), (int)pointsB.size(), k, epsilon, threadCount <= 0 ? GetDefaultThreadCount() : threadCount);
+      printf("nearest neighbor loop %9.2f ms, closest distance %g\n", loopTime, std::sqrt((double)nearestDist));
+      printf("dual tree             %9.2f ms, closest distance %g\n", dualTime, pairs.empty() ? 0 : std::sqrt((double)pairs[0].dist));
+      if (!pairs.empty())
+         printf("k-th distance %g\n", std::sqrt((double)pairs.back().dist));
+   }
+};
+
+class RknnOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 2;
+   int leafSize = 10;
+   int k = 10;
+   int queryCount = 1000;
+   int threadCount = 0;
+public:
+   RknnOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(threadCount, "--threads").nargs(1);
+   }
+
+   //! Prints time of the radius precomputation and average time and result size of reverse kNN queries at data points
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      ReverseKNearestNeighbors<float, Dim> rknn(tree, k, 0, threadCount);
+      double precomputeTime = duration_cast<duration<double, std::milli>>(high_resolution_clock::now() - start).count();
+
+      std::vector<PointObj<float, Dim>> result;
+      size_t resultSize = 0;
+      start = high_resolution_clock::now();
+      for (int i = 0; i < queryCount; ++i)
+         resultSize += rknn.Find(points[rand() % points.size()].point, result);
+      double queryTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      printf("points %d, k %d, threads %d\n", (int)points.size(), k, threadCount <= 0 ? GetDefaultThreadCount() : threadCount);
+      printf("precompute %9.2f ms\n", precomputeTime);
+      printf("query      %9.2f us, avg reverse neighbors %.2f\n", queryTime / std::max(1, queryCount), (double)resultSize / std::max(1, queryCount));
+   }
+};
+
+class AnytimeBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   double epsilon = 0;
+   int leafSize = 10;
+   int queryCount = 10000;
+public:
+   AnytimeBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(epsilon, "--eps").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+   }
+
+   //! Prints average and p99.9 query time, incomplete queries, error bound and recall of the anytime search for several leaf budgets
+   template<int Dim>
+   void Execute()
+   {
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < queryCount; ++i) {
+         Vec<float, Dim> queryPoint;
+         for (int d = 0; d < Dim; ++d) {
+            queryPoint[d] = ((float)rand()) / RAND_MAX;
+         }
+         queryPoints.push_back(queryPoint);
+      }
+      HeapPriQueue<DistObj<float, Dim>> queue;
+      std::vector<DistT<float>> exactDists(queryCount);
+      for (int i = 0; i < queryCount; ++i) {
+         // unlimited budget with zero epsilon is the exact search
+         AnytimeSearchResult result;
+         FindKAproximateNearestNeighborsAnytime(tree, queryPoints[i], k, 0.0f, SearchBudget(), queue, result);
+         exactDists[i] = queue.IsEmpty() ? 0 : queue.GetLast().dist;
+      }
+
+      printf("leafs  avg time  p99.9 time  incomplete  avg bound  recall\n");
+      for (int maxLeafs : {0, 64, 16, 4, 1}) {
+         SearchBudget budget;
+         budget.maxLeafs = maxLeafs;
+         std::vector<double> times;
+         int incompleteCount = 0;
+         double boundSum = 0;
+         int boundCount = 0;
+         size_t hitCount = 0;
+         for (int i = 0; i < queryCount; ++i) {
+            AnytimeSearchResult result;
+            std::vector<PointObj<float, Dim>> knn = FindKAproximateNearestNeighborsAnytime(tree, queryPoints[i], k, (float)epsilon, budget, queue, result);
+            times.push_back(result.nanoseconds / 1000.0);
+            incompleteCount += !result.isComplete;
+            if (!std::isinf(result.errorBound)) {
+               boundSum += result.errorBound;
+               ++boundCount;
+            }
+            for (const PointObj<float, Dim>& obj : knn)
+               hitCount += queryPoints[i].DistSquared(obj.point) <= exactDists[i];
+         }
+         std::sort(times.begin(), times.end());
+         double avgTime = std::accumulate(times.begin(), times.end(), 0.0) / std::max(1, queryCount);
+         double p999Time = times.empty() ? 0 : times[std::min(times.size() - 1, times.size() * 999 / 1000)];
+         printf("%5d  %6.2f us   %6.2f us  %9.2f%%  %9.3f  %6.3f\n", maxLeafs, avgTime, p999Time, 100.0 * incompleteCount / std::max(1, queryCount),
+            boundCount > 0 ? boundSum / boundCount : 0.0, (double)hitCount / std::max(1, queryCount * k));
+      }
+   }
+};
+
+class CursorBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   double epsilon = 0;
+   int leafSize = 10;
+   int queryCount = 10000;
+   double stepSize = 0.001;
+public:
+   CursorBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(epsilon, "--eps").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(stepSize, "--step").nargs(1);
+   }
+
+   //! Compares traversal steps and time of searches from the root and of warm started cursor on smoothly moving query point
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      // random walk starting at a data point, relative step size to the bounding box
+      std::vector<Vec<float, Dim>> queryPoints;
+      Vec<float, Dim> queryPoint = points[rand() % points.size()].point;
+      const Box<float, Dim>& bbox = tree.GetBBox();
+      for (int i = 0; i < queryCount; ++i) {
+         for (int d = 0; d < Dim; ++d) {
+            float step = (float)stepSize * bbox.GetSize(d) * (((float)rand()) / RAND_MAX - 0.5f);
+            queryPoint[d] = std::clamp(queryPoint[d] + step, bbox.min[d], bbox.max[d]);
+         }
+         queryPoints.push_back(queryPoint);
+      }
+
+      HeapPriQueue<DistObj<float, Dim>> queue;
+      KNearestNeighborsCursor<float, Dim> cursor(tree);
+      long long rootSteps = 0;
+      long long cursorSteps = 0;
+      for (const Vec<float, Dim>& point : queryPoints) {
+         TraversalStats<float, Dim> rootStats;
+         FindKAproximateNearestNeighbors<float, Dim, Empty, true>(tree, point, k, (float)epsilon, queue, rootStats);
+         rootSteps += rootStats.traversalSteps;
+         TraversalStats<float, Dim> cursorStats;
+         cursor.template FindKAproximateNearestNeighbors<true>(point, k, (float)epsilon, queue, cursorStats);
+         cursorSteps += cursorStats.traversalSteps;
+      }
+
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& point : queryPoints)
+         FindKAproximateNearestNeighbors(tree, point, k, (float)epsilon, queue);
+      double rootTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+      cursor.Reset();
+      start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& point : queryPoints)
+         cursor.FindKAproximateNearestNeighbors(point, k, (float)epsilon, queue);
+      double cursorTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      int count = std::max(1, queryCount);
+      printf("points %d, k %d, eps %g, step %g\n", (int)points.size(), k, epsilon, stepSize);
+      printf("search  avg steps  avg time\n");
+      printf("root    %9.2f  %6.2f us\n", (double)rootSteps / count, rootTime / count);
+      printf("cursor  %9.2f  %6.2f us\n", (double)cursorSteps / count, cursorTime / count);
+   }
+};
+
+class CacheBenchOptions : public argumentum::CommandOptions
+{
+public:
+   std::string inputFile;
+   int dim = 3;
+   int k = 10;
+   double epsilon = 0;
+   int leafSize = 10;
+   int queryCount = 100000;
+   int locationCount = 2000;
+   double cellSize = 0;
+   int memoryKB = 1024;
+public:
+   CacheBenchOptions(std::string_view name) : CommandOptions(name) {}
+
+   void execute(const argumentum::ParseResult& res)
+   {
+      if (inputFile.size() > 0)
+      {
+         if (dim == 2) {
+            Execute<2>();
+         } else if (dim == 3) {
+            Execute<3>();
+         } else if (dim == 4) {
+            Execute<4>();
+         }
+      }
+   }
+protected:
+   void add_parameters(argumentum::ParameterConfig& params ) override
+   {
+      params.add_parameter(inputFile, "--in").nargs(1);
+      params.add_parameter(dim, "--dim").nargs(1);
+      params.add_parameter(k, "--k").nargs(1);
+      params.add_parameter(epsilon, "--eps").nargs(1);
+      params.add_parameter(leafSize, "--leaf").nargs(1);
+      params.add_parameter(queryCount, "--queries").nargs(1);
+      params.add_parameter(locationCount, "--locations").nargs(1);
+      params.add_parameter(cellSize, "--cell").nargs(1);
+      params.add_parameter(memoryKB, "--memory").nargs(1);
+   }
+
+   //! Compares searches with and without the result cache on queries repeating a few locations with skewed frequencies
+   template<int Dim>
+   void Execute()
+   {
+      using namespace std::chrono;
+      std::vector<PointObj<float, Dim>> points = LoadPoints<Dim>(inputFile);
+      BBDTree<float, Dim> tree = BBDTree<float, Dim>::BuildMidpointSplitTree(leafSize, points);
+      std::vector<Vec<float, Dim>> locations;
+      for (int i = 0; i < locationCount; ++i)
+         locations.push_back(points[rand() % points.size()].point);
+      // cubed uniform number prefers the first locations
+      std::vector<Vec<float, Dim>> queryPoints;
+      for (int i = 0; i < queryCount; ++i) {
+         double r = ((double)rand()) / RAND_MAX;
+         queryPoints.push_back(locations[std::min(locationCount - 1, (int)(r * r * r * locationCount))]);
+      }
+
+      HeapPriQueue<DistObj<float, Dim>> queue;
+      high_resolution_clock::time_point start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& point : queryPoints)
+         FindKAproximateNearestNeighbors(tree, point, k, (float)epsilon, queue);
+      double searchTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      QueryCache<float, Dim> cache((size_t)memoryKB * 1024, cellSize);
+      start = high_resolution_clock::now();
+      for (const Vec<float, Dim>& point : queryPoints)
+         FindKAproximateNearestNeighborsCached(tree, cache, point, k, (float)epsilon, queue);
+      double cachedTime = duration_cast<duration<double, std::micro>>(high_resolution_clock::now() - start).count();
+
+      QueryCacheStats stats = cache.GetStats();
+      int count = std::max(1, queryCount);
+      printf("points %d, locations %d, k %d, eps %g, cell %g\n", (int)points.size(), locationCount, k, epsilon, cellSize);
+      printf("search  %6.2f us\n", searchTime / count);
+      printf("cached  %6.2f us, hits %llu, misses %llu, evictions %llu, entries %zu, memory %zu KB\n", cachedTime / count,
+             (unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions, stats.entryCount, stats.memoryBytes / 1024);
+   }
+};
+
 int main(int argc, char** argv)
 {
    using namespace argumentum;
@@ -685,6 +2006,20 @@ int main(int argc, char** argv)
    std::shared_ptr<QueryVizOptions> queryVizOptions = std::make_shared<QueryVizOptions>("query_viz");
    std::shared_ptr<EpsGraphOptions> epsGraphOptions = std::make_shared<EpsGraphOptions>("eps_graph");
    std::shared_ptr<QueueGraphOptions> queueGraphOptions = std::make_shared<QueueGraphOptions>("queue_graph");
+   std::shared_ptr<LayoutBenchOptions> layoutBenchOptions = std::make_shared<LayoutBenchOptions>("layout_bench");
+   std::shared_ptr<CoordBenchOptions> coordBenchOptions = std::make_shared<CoordBenchOptions>("coord_bench");
+   std::shared_ptr<ForestBenchOptions> forestBenchOptions = std::make_shared<ForestBenchOptions>("forest_bench");
+   std::shared_ptr<RebuildBenchOptions> rebuildBenchOptions = std::make_shared<RebuildBenchOptions>("rebuild_bench");
+   std::shared_ptr<LazyBenchOptions> lazyBenchOptions = std::make_shared<LazyBenchOptions>("lazy_bench");
+   std::shared_ptr<AdaptiveBenchOptions> adaptiveBenchOptions = std::make_shared<AdaptiveBenchOptions>("adaptive_bench");
+   std::shared_ptr<KdeBenchOptions> kdeBenchOptions = std::make_shared<KdeBenchOptions>("kde_bench");
+   std::shared_ptr<DbscanOptions> dbscanOptions = std::make_shared<DbscanOptions>("dbscan");
+   std::shared_ptr<NormalsOptions> normalsOptions = std::make_shared<NormalsOptions>("normals");
+   std::shared_ptr<ClosestPairOptions> closestPairOptions = std::make_shared<ClosestPairOptions>("closest_pair");
+   std::shared_ptr<RknnOptions> rknnOptions = std::make_shared<RknnOptions>("rknn");
+   std::shared_ptr<AnytimeBenchOptions> anytimeBenchOptions = std::make_shared<AnytimeBenchOptions>("anytime_bench");
+   std::shared_ptr<CursorBenchOptions> cursorBenchOptions = std::make_shared<CursorBenchOptions>("cursor_bench");
+   std::shared_ptr<CacheBenchOptions> cacheBenchOptions = std::make_shared<CacheBenchOptions>("cache_bench");
 
    params.add_command(treeStatsOptions).help("Tree statistics.");
    params.add_command(queryStatsOptions).help("Query statistics.");
@@ -692,6 +2027,20 @@ int main(int argc, char** argv)
    params.add_command(queryVizOptions).help("Visualize specified query.");
    params.add_command(epsGraphOptions).help("Dependence of execution time on epsilon.");
    params.add_command(queueGraphOptions).help("Dependence of execution time on queue type and k.");
+   params.add_command(layoutBenchOptions).help("Query time and cache misses of different node layouts.");
+   params.add_command(coordBenchOptions).help("Query time of float and integer coordinates on integer grid data.");
+   params.add_command(forestBenchOptions).help("Insertion and query time of dynamic BBD forest.");
+   params.add_command(rebuildBenchOptions).help("Query latency percentiles during background rebuilds of versioned tree.");
+   params.add_command(lazyBenchOptions).help("Build time and time to the first answer of complete and lazy tree.");
+   params.add_command(adaptiveBenchOptions).help("Traversal steps and query time of midpoint split and query adaptive tree on skewed workload.");
+   params.add_command(kdeBenchOptions).help("Time and error of linear and tree accelerated kernel density estimation.");
+   params.add_command(dbscanOptions).help("DBSCAN clustering with time of each phase.");
+   params.add_command(normalsOptions).help("Time of parallel normal estimation of 3D point cloud.");
+   params.add_command(closestPairOptions).help("Dual tree closest pairs between two point sets compared to nearest neighbor loop.");
+   params.add_command(rknnOptions).help("Time of reverse kNN queries and of their precomputation.");
+   params.add_command(anytimeBenchOptions).help("Latency, error bound and recall of anytime kNN search with leaf budgets.");
+   params.add_command(cursorBenchOptions).help("Traversal steps and time of warm started kNN cursor on smoothly moving query point.");
+   params.add_command(cacheBenchOptions).help("Hit rate and time of kNN result cache on queries repeating a few locations.");
 
    ParseResult res = parser.parse_args( argc, argv, 1 );
    if ( !res )
@@ -0,0 +1,96 @@
+
+#include <gtest/gtest.h>
+#include <aknn/aggregate.h>
+
+#include "test_data.h"
+
+struct LabelData
+{
+    int label = 0;
+    double value = 0;
+};
+
+template<int Dim>
+using LabelObj = PointObj<double, Dim, LabelData>;
+
+template<int Dim>
+void RandomTestsAggregateKNN()
+{
+    std::vector<LabelObj<Dim>> dataset;
+    for (int i = 0; i < 1000; ++i) {
+        VecD<Dim> point = TestData::Get().GenRandVec<Dim>();
+        dataset.push_back(LabelObj<Dim>({point, {i % 4, point[0] * 10}}));
+    }
+    BBDTree<double, Dim, LabelData> tree = BBDTree<double, Dim, LabelData>::BuildMidpointSplitTree(5, dataset);
+    HeapPriQueue<DistObj<double, Dim, LabelData>> knnQueue;
+
+    auto label = [](const LabelData& data) { return data.label; };
+    auto value = [](const LabelData& data) { return data.value; };
+    MajorityVote<decltype(label)> vote(label);
+    InverseDistanceWeightedAverage<decltype(value)> average(value);
+
+    std::vector<VecD<Dim>> queryPoints;
+    for (int query = 0; query < 50; ++query)
+        queryPoints.push_back(TestData::Get().GenRandVec<Dim>());
+    for (int k : {1, 5, 10}) {
+        std::vector<int> labels;
+        std::vector<double> averages;
+        AggregateKAproximateNearestNeighborsBatch(tree, queryPoints, k, 0, knnQueue, vote, labels);
+        AggregateKAproximateNearestNeighborsBatch(tree, queryPoints, k, 0, knnQueue, average, averages);
+        ASSERT_EQ(queryPoints.size(), labels.size());
+        ASSERT_EQ(queryPoints.size(), averages.size());
+
+        for (size_t q = 0; q < queryPoints.size(); ++q) {
+            // reduce neighbors found by plain search
+            std::vector<DistObj<double, Dim, LabelData>> neighbors;
+            for (const LabelObj<Dim>& obj : FindKNearestNeighbors(tree, queryPoints[q], k, knnQueue))
+                neighbors.push_back({queryPoints[q].DistSquared(obj.point), obj});
+            std::sort(neighbors.begin(), neighbors.end(), DistObjCompare<double, Dim, LabelData>());
+
+            std::vector<int> votes(4);
+            double weightedSum = 0;
+            double weightSum = 0;
+            for (const DistObj<double, Dim, LabelData>& neighbor : neighbors) {
+                ++votes[neighbor.obj.data.label];
+                weightedSum += neighbor.obj.data.value / neighbor.dist;
+                weightSum += 1 / neighbor.dist;
+            }
+            int maxVotes = *std::max_element(votes.begin(), votes.end());
+            int expectedLabel = -1;
+            for (const DistObj<double, Dim, LabelData>& neighbor : neighbors) {
+                if (votes[neighbor.obj.data.label] == maxVotes) {
+                    expectedLabel = neighbor.obj.data.label;
+                    break;
+                }
+            }
+            EXPECT_EQ(expectedLabel, labels[q]) << "Incorrect vote: k" << k << ", p" << queryPoints[q];
+            EXPECT_NEAR(weightedSum / weightSum, averages[q], 1e-9) << "Incorrect average: k" << k << ", p" << queryPoints[q];
+            EXPECT_EQ(labels[q], AggregateKNearestNeighbors(tree, queryPoints[q], k, knnQueue, vote));
+        }
+    }
+}
+
+TEST(RandomTestAggregateKNN, dim2) {
+    RandomTestsAggregateKNN<2>();
+}
+TEST(RandomTestAggregateKNN, dim3) {
+    RandomTestsAggregateKNN<3>();
+}
+
+TEST(AggregateKNN, CoincidentPoints) {
+    std::vector<LabelObj<2>> dataset = {
+        {VecD2({0, 0}), {1, 2}},
+        {VecD2({0, 0}), {1, 4}},
+        {VecD2({1, 0}), {2, 100}},
+        {VecD2({0, 1}), {2, 100}},
+        {VecD2({1, 1}), {2, 100}},
+    };
+    BBDTree<double, 2, LabelData> tree = BBDTree<double, 2, LabelData>::BuildMidpointSplitTree(2, dataset);
+    HeapPriQueue<DistObj<double, 2, LabelData>> knnQueue;
+    auto value = [](const LabelData& data) { return data.value; };
+    EXPECT_EQ(3, AggregateKNearestNeighbors(tree, VecD2({0, 0}), 5, knnQueue, InverseDistanceWeightedAverage<decltype(value)>(value)));
+
+    // 2 votes for label 1 at the query point against 2 farther votes for label 2
+    auto label = [](const LabelData& data) { return data.label; };
+    EXPECT_EQ(1, AggregateKNearestNeighbors(tree, VecD2({0, 0}), 4, knnQueue, MajorityVote<decltype(label)>(label)));
+}
@@ -0,0 +1,80 @@
+
+#include <cmath>
+#include <gtest/gtest.h>
+#include <aknn/anytime.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void RandomTestsAnytimeSearch()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(3000);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(6, dataset);
+    HeapPriQueue<DistObj<double, Dim>> queue;
+    const int k = 8;
+    for (int q = 0; q < 50; ++q) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        std::vector<double> expected = GetSortedDistances(LinearFindKNearestNeighbors(dataset, queryPoint, k), queryPoint);
+
+        // unlimited budget is the exact search
+        AnytimeSearchResult result;
+        std::vector<double> found = GetSortedDistances(FindKAproximateNearestNeighborsAnytime(tree, queryPoint, k, 0, SearchBudget(), queue, result), queryPoint);
+        EXPECT_TRUE(result.isComplete);
+        EXPECT_EQ(1, result.errorBound);
+        EXPECT_EQ(expected, found);
+
+        // leaf budgets, the error bound holds for each neighbor and shrinks with the budget
+        double lastErrorBound = std::numeric_limits<double>::infinity();
+        for (int maxLeafs : {1, 2, 4, 8, 16, 64}) {
+            SearchBudget budget;
+            budget.maxLeafs = maxLeafs;
+            found = GetSortedDistances(FindKAproximateNearestNeighborsAnytime(tree, queryPoint, k, 0, budget, queue, result), queryPoint);
+            EXPECT_LE(result.visitedLeafs, maxLeafs);
+            EXPECT_LE(result.errorBound, lastErrorBound);
+            lastErrorBound = result.errorBound;
+            if (result.isComplete) {
+                EXPECT_EQ(expected, found);
+            }
+            if (found.size() == expected.size()) {
+                for (int i = 0; i < k; ++i)
+                    EXPECT_LE(found[i], expected[i] * result.errorBound * (1 + 1e-12)) << "Incorrect bound: leafs " << maxLeafs << ", i" << i;
+            } else {
+                EXPECT_FALSE(result.isComplete);
+                EXPECT_TRUE(std::isinf(result.errorBound));
+            }
+        }
+
+        // distance computation budget
+        for (int maxDistComputations : {5, 20, 100}) {
+            SearchBudget budget;
+            budget.maxDistComputations = maxDistComputations;
+            FindKAproximateNearestNeighborsAnytime(tree, queryPoint, k, 0.5, budget, queue, result);
+            EXPECT_LE(result.distComputations, maxDistComputations);
+        }
+    }
+}
+
+TEST(RandomTestAnytimeSearch, dim2) {
+    RandomTestsAnytimeSearch<2>();
+}
+TEST(RandomTestAnytimeSearch, dim3) {
+    RandomTestsAnytimeSearch<3>();
+}
+
+TEST(AnytimeSearch, Deadline) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(1000);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(4, dataset);
+    HeapPriQueue<DistObj<double, 2>> queue;
+    AnytimeSearchResult result;
+    // deadline passes before the first leaf
+    SearchBudget budget;
+    budget.maxNanoseconds = 1;
+    EXPECT_TRUE(FindKAproximateNearestNeighborsAnytime(tree, VecD2(0.5), 4, 0, budget, queue, result).empty());
+    EXPECT_FALSE(result.isComplete);
+    EXPECT_EQ(0, result.visitedLeafs);
+    EXPECT_TRUE(std::isinf(result.errorBound));
+
+    budget.maxNanoseconds = 1000000000;
+    EXPECT_EQ(4, (int)FindKAproximateNearestNeighborsAnytime(tree, VecD2(0.5), 4, 0, budget, queue, result).size());
+    EXPECT_TRUE(result.isComplete);
+}
@@ -0,0 +1,61 @@
+
+#include <gtest/gtest.h>
+#include <aknn/bbd_forest.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void TestBBDForestInsert(int bufferSize)
+{
+    BBDForest<double, Dim> forest(5, bufferSize);
+    std::vector<PointObjD<Dim>> insertedObjs = TestData::Get().GenRandDataset<Dim>(3000);
+    std::vector<PointObjD<Dim>> dataset;
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int count : {1, 10, 100, 1000, 3000}) {
+        while ((int)dataset.size() < count) {
+            dataset.push_back(insertedObjs[dataset.size()]);
+            forest.Insert(dataset.back());
+        }
+        EXPECT_EQ(dataset.size(), forest.GetObjCount());
+        EXPECT_LE(forest.GetTreeCount(), (int)std::log2(std::max(1, count / bufferSize)) + 1);
+        for (int k : {1, 5, 20}) {
+            for (int query = 0; query < 10; ++query) {
+                VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+                std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(dataset, queryPoint, k));
+                std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(forest, queryPoint, k, knnQueue));
+                SortByDistanceToPoint(expected, queryPoint);
+                SortByDistanceToPoint(result, queryPoint);
+                EXPECT_EQ(expected, result) << "Incorrect result: p" << queryPoint << ", k" << k << ", n" << count;
+            }
+        }
+    }
+}
+
+TEST(BBDForest_Insert, dim2) {
+    TestBBDForestInsert<2>(1);
+    TestBBDForestInsert<2>(64);
+}
+TEST(BBDForest_Insert, dim3) {
+    TestBBDForestInsert<3>(1);
+    TestBBDForestInsert<3>(64);
+}
+TEST(BBDForest_Insert, dim4) {
+    TestBBDForestInsert<4>(1);
+    TestBBDForestInsert<4>(64);
+}
+
+TEST(BBDForest_Insert, Metric) {
+    BBDForest<double, 3> forest(5, 64);
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(1000);
+    for (const PointObjD<3>& obj : dataset)
+        forest.Insert(obj);
+    HeapPriQueue<DistObj<double, 3>> knnQueue;
+    for (int query = 0; query < 10; ++query) {
+        VecD<3> queryPoint = TestData::Get().GenRandVec<3>();
+        std::vector<Vec<double, 3>> expected = ObjsToVec(LinearFindKNearestNeighborsByMetric(dataset, queryPoint, 10, L1Metric()));
+        std::vector<Vec<double, 3>> result = ObjsToVec(FindKNearestNeighbors(forest, queryPoint, 10, knnQueue, L1Metric()));
+        SortByDistanceToPoint(expected, queryPoint);
+        SortByDistanceToPoint(result, queryPoint);
+        EXPECT_EQ(expected, result) << "Incorrect result: p" << queryPoint;
+    }
+}
@@ -0,0 +1,568 @@
+
+#include <gtest/gtest.h>
+#include <thread>
+#include <aknn/bbd_tree.h>
+#include <aknn/search.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void TestRelayoutToBlocks(int blockSize)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(2000);
+    for (int leafSize : TestData::Get().leafSizes) {
+        BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        BBDTreeStats statsBefore = tree.GetStats();
+        tree.RelayoutToBlocks(blockSize);
+        BBDTreeStats statsAfter = tree.GetStats();
+        EXPECT_EQ(statsBefore.splitNodeCount, statsAfter.splitNodeCount);
+        EXPECT_EQ(statsBefore.shrinkNodeCount, statsAfter.shrinkNodeCount);
+        EXPECT_EQ(statsBefore.leafNodeCount, statsAfter.leafNodeCount);
+        EXPECT_EQ(statsBefore.maxDepth, statsAfter.maxDepth);
+        EXPECT_EQ(dataset.size(), tree.GetObjCount());
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+}
+
+TEST(BBDTree_RelayoutToBlocks, dim2) {
+    TestRelayoutToBlocks<2>(64);
+    TestRelayoutToBlocks<2>(4096);
+}
+TEST(BBDTree_RelayoutToBlocks, dim3) {
+    TestRelayoutToBlocks<3>(64);
+    TestRelayoutToBlocks<3>(4096);
+}
+TEST(BBDTree_RelayoutToBlocks, dim4) {
+    TestRelayoutToBlocks<4>(64);
+    TestRelayoutToBlocks<4>(4096);
+}
+
+TEST(BBDTree_RelayoutToBlocks, touchedPages) {
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(50000);
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildMidpointSplitTree(1, dataset);
+    BBDTree<double, 3> blockTree = BBDTree<double, 3>::BuildMidpointSplitTree(1, dataset);
+    blockTree.RelayoutToBlocks(4096);
+    EXPECT_EQ(0, (size_t)blockTree.GetRoot() % 4096);
+    EXPECT_EQ(0, (size_t)blockTree.GetObj(0) % 4096);
+    int touchedPages = 0;
+    int blockTouchedPages = 0;
+    for (int query = 0; query < 100; ++query) {
+        VecD3 queryPoint = TestData::Get().GenRandVec<3>();
+        TraversalStats<double, 3> stats;
+        TraversalStats<double, 3> blockStats;
+        FindAproximateNearestNeighbor<double, 3, Empty, true>(tree, queryPoint, 0, stats);
+        FindAproximateNearestNeighbor<double, 3, Empty, true>(blockTree, queryPoint, 0, blockStats);
+        EXPECT_GT(stats.touchedPages, 0);
+        EXPECT_GT(blockStats.touchedPages, 0);
+        touchedPages += stats.touchedPages;
+        blockTouchedPages += blockStats.touchedPages;
+        TraversalStats<double, 3> statsCopy = blockStats;
+        EXPECT_EQ(blockStats.touchedPageSets->nodePages, statsCopy.touchedPageSets->nodePages);
+    }
+    EXPECT_LT(blockTouchedPages, touchedPages);
+}
+
+template<int Dim>
+void TestRelayoutVanEmdeBoas()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(2000);
+    for (int leafSize : TestData::Get().leafSizes) {
+        BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        BBDTreeStats statsBefore = tree.GetStats();
+        tree.RelayoutVanEmdeBoas();
+        BBDTreeStats statsAfter = tree.GetStats();
+        EXPECT_EQ(statsBefore.splitNodeCount, statsAfter.splitNodeCount);
+        EXPECT_EQ(statsBefore.shrinkNodeCount, statsAfter.shrinkNodeCount);
+        EXPECT_EQ(statsBefore.leafNodeCount, statsAfter.leafNodeCount);
+        EXPECT_EQ(statsBefore.maxDepth, statsAfter.maxDepth);
+        EXPECT_EQ(0, (size_t)tree.GetRoot() % CACHE_LINE_SIZE);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+}
+
+TEST(BBDTree_RelayoutVanEmdeBoas, dim2) {
+    TestRelayoutVanEmdeBoas<2>();
+}
+TEST(BBDTree_RelayoutVanEmdeBoas, dim3) {
+    TestRelayoutVanEmdeBoas<3>();
+}
+TEST(BBDTree_RelayoutVanEmdeBoas, dim4) {
+    TestRelayoutVanEmdeBoas<4>();
+}
+
+template<int Dim>
+void TestCompactShrinkNodes()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(2000);
+    // clustered points, so that shrink nodes are created
+    for (int i = 0; i < 500; ++i) {
+        VecD<Dim> point = TestData::Get().GenRandVec<Dim>();
+        for (int d = 0; d < Dim; ++d) {
+            point[d] *= 0.001;
+        }
+        dataset.push_back(PointObjD<Dim>({point}));
+    }
+    for (int leafSize : TestData::Get().leafSizes) {
+        BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        BBDTreeStats statsBefore = tree.GetStats();
+        tree.CompactShrinkNodes();
+        BBDTreeStats statsAfter = tree.GetStats();
+        EXPECT_EQ(statsBefore.splitNodeCount, statsAfter.splitNodeCount);
+        EXPECT_EQ(statsBefore.shrinkNodeCount, statsAfter.shrinkNodeCount);
+        EXPECT_EQ(statsBefore.leafNodeCount, statsAfter.leafNodeCount);
+        EXPECT_EQ(statsBefore.maxDepth, statsAfter.maxDepth);
+        if (statsBefore.shrinkNodeCount > 0) {
+            EXPECT_LT(statsAfter.memoryConsumption, statsBefore.memoryConsumption);
+        }
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+        tree.RelayoutToBlocks(4096);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+}
+
+TEST(BBDTree_CompactShrinkNodes, dim2) {
+    TestCompactShrinkNodes<2>();
+}
+TEST(BBDTree_CompactShrinkNodes, dim3) {
+    TestCompactShrinkNodes<3>();
+}
+TEST(BBDTree_CompactShrinkNodes, dim4) {
+    TestCompactShrinkNodes<4>();
+}
+
+template<int Dim>
+void TestQuantizeLeafPoints(int bits)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(2000);
+    for (int leafSize : TestData::Get().leafSizes) {
+        BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        tree.QuantizeLeafPoints(bits);
+        EXPECT_EQ(bits, tree.GetQuantBits());
+        ExpectSameKNN<Dim>(tree, dataset, 10, 1);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+        tree.CompactShrinkNodes();
+        tree.RelayoutToBlocks(4096);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+}
+
+TEST(BBDTree_QuantizeLeafPoints, dim2) {
+    TestQuantizeLeafPoints<2>(8);
+    TestQuantizeLeafPoints<2>(16);
+}
+TEST(BBDTree_QuantizeLeafPoints, dim3) {
+    TestQuantizeLeafPoints<3>(8);
+    TestQuantizeLeafPoints<3>(16);
+}
+TEST(BBDTree_QuantizeLeafPoints, dim4) {
+    TestQuantizeLeafPoints<4>(8);
+    TestQuantizeLeafPoints<4>(16);
+}
+
+template<int Dim>
+void TestQuantizeWithoutExactPoints(int bits)
+{
+    std::mt19937 gen(Dim);
+    std::uniform_real_distribution<double> distr(0, 1);
+    std::vector<PointObjD<Dim>> dataset;
+    for (int i = 0; i < 2000; ++i) {
+        VecD<Dim> point;
+        for (int d = 0; d < Dim; ++d)
+            point[d] = distr(gen);
+        dataset.push_back({point});
+    }
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(6, dataset);
+    size_t exactMemory = tree.GetStats().objMemoryConsumption;
+    tree.QuantizeLeafPoints(bits, false);
+    EXPECT_FALSE(tree.HasExactPoints());
+    EXPECT_EQ((index_t)dataset.size(), tree.GetObjCount());
+    EXPECT_EQ(dataset.size() * Dim * bits / 8, tree.GetStats().objMemoryConsumption);
+    EXPECT_LT(tree.GetStats().objMemoryConsumption, exactMemory);
+    // modifications are ignored
+    EXPECT_FALSE(tree.Remove(0));
+    EXPECT_FALSE(tree.Refit(std::vector<VecD<Dim>>(dataset.size())));
+    EXPECT_FALSE(tree.RelayoutToBlocks(4096));
+    EXPECT_FALSE(tree.RelayoutVanEmdeBoas());
+    EXPECT_FALSE(tree.CompactShrinkNodes());
+    tree.QuantizeLeafPoints(0);
+    EXPECT_EQ(bits, tree.GetQuantBits());
+
+    // decoded points are off by at most half of the quantization interval in each coordinate, so are the sorted distances
+    double maxError = std::sqrt((double)Dim) / (1 << bits);
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int query = 0; query < 20; ++query) {
+        VecD<Dim> queryPoint;
+        for (int d = 0; d < Dim; ++d)
+            queryPoint[d] = distr(gen);
+        std::vector<PointObjD<Dim>> expected = LinearFindKNearestNeighbors<double, Dim>(dataset, queryPoint, 5);
+        std::vector<PointObjD<Dim>> result = FindKNearestNeighbors(tree, queryPoint, 5, knnQueue);
+        ASSERT_EQ(expected.size(), result.size());
+        std::vector<double> expectedDists, resultDists;
+        for (size_t i = 0; i < expected.size(); ++i) {
+            expectedDists.push_back(std::sqrt(queryPoint.DistSquared(expected[i].point)));
+            resultDists.push_back(std::sqrt(queryPoint.DistSquared(result[i].point)));
+        }
+        std::sort(expectedDists.begin(), expectedDists.end());
+        std::sort(resultDists.begin(), resultDists.end());
+        for (size_t i = 0; i < expected.size(); ++i)
+            EXPECT_NEAR(expectedDists[i], resultDists[i], maxError);
+
+        index_t rangeCount = 0;
+        SearchAproximateRange(tree, queryPoint, 0.1, 0.0, [&](const PointObjD<Dim>&) { ++rangeCount; });
+        EXPECT_EQ(rangeCount, CountAproximateRange(tree, queryPoint, 0.1, 0.0));
+    }
+}
+
+TEST(BBDTree_QuantizeLeafPoints, WithoutExactPoints) {
+    TestQuantizeWithoutExactPoints<2>(8);
+    TestQuantizeWithoutExactPoints<3>(16);
+}
+
+template<typename CoordT, int Dim>
+void TestIntegerCoords(CoordT gridSize, CoordT scale)
+{
+    std::mt19937 gen(Dim);
+    std::uniform_int_distribution<CoordT> distr(0, gridSize);
+    std::vector<PointObj<CoordT, Dim>> dataset;
+    for (int i = 0; i < 2000; ++i) {
+        Vec<CoordT, Dim> point;
+        for (int d = 0; d < Dim; ++d) {
+            point[d] = distr(gen) * scale;
+        }
+        dataset.push_back({point});
+    }
+    // duplicate points, more than leaf size
+    for (int i = 0; i < 50; ++i) {
+        dataset.push_back(dataset[0]);
+    }
+    HeapPriQueue<DistObj<CoordT, Dim>> knnQueue;
+    for (int leafSize : TestData::Get().leafSizes) {
+        BBDTree<CoordT, Dim> tree = BBDTree<CoordT, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        BBDTree<CoordT, Dim> quantTree = tree;
+        quantTree.QuantizeLeafPoints(8);
+        for (int query = 0; query < 20; ++query) {
+            Vec<CoordT, Dim> queryPoint;
+            for (int d = 0; d < Dim; ++d) {
+                queryPoint[d] = distr(gen) * scale;
+            }
+            for (int k : {1, 5}) {
+                // compare only distances, because integer grid contains many equidistant points
+                std::vector<DistT<CoordT>> expected;
+                for (const PointObj<CoordT, Dim>& obj : LinearFindKNearestNeighbors<CoordT, Dim>(dataset, queryPoint, k))
+                    expected.push_back(queryPoint.DistSquared(obj.point));
+                std::vector<DistT<CoordT>> result;
+                for (const PointObj<CoordT, Dim>& obj : FindKNearestNeighbors<CoordT, Dim>(tree, queryPoint, k, knnQueue))
+                    result.push_back(queryPoint.DistSquared(obj.point));
+                // integer quantization steps are rounded up and the duplicate points make leafs with zero extent
+                std::vector<DistT<CoordT>> quantResult;
+                for (const PointObj<CoordT, Dim>& obj : FindKNearestNeighbors<CoordT, Dim>(quantTree, queryPoint, k, knnQueue))
+                    quantResult.push_back(queryPoint.DistSquared(obj.point));
+                std::sort(expected.begin(), expected.end());
+                std::sort(result.begin(), result.end());
+                std::sort(quantResult.begin(), quantResult.end());
+                EXPECT_TRUE(expected == result) << "Incorrect result: p" << queryPoint << ", k" << k;
+                EXPECT_TRUE(expected == quantResult) << "Incorrect quantized result: p" << queryPoint << ", k" << k;
+            }
+        }
+    }
+}
+
+TEST(BBDTree_IntegerCoords, int32) {
+    TestIntegerCoords<int32_t, 2>(1000, 1);
+    TestIntegerCoords<int32_t, 3>(20, 1);
+    TestIntegerCoords<int32_t, 4>(10, 1);
+}
+TEST(BBDTree_IntegerCoords, int64) {
+    TestIntegerCoords<int64_t, 2>(1000, 1000000000);
+    TestIntegerCoords<int64_t, 3>(100, 1000000000);
+}
+
+template<int Dim>
+void TestRemove(bool relayout)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(3000);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset);
+    if (relayout) {
+        tree.CompactShrinkNodes();
+        tree.RelayoutToBlocks(256);
+    }
+    std::mt19937 gen(Dim);
+    while (dataset.size() > 200) {
+        for (int i = 0; i < 200; ++i) {
+            index_t index = std::uniform_int_distribution<index_t>(0, tree.GetObjCount() - 1)(gen);
+            while (tree.IsDeleted(index))
+                index = (index + 1) % tree.GetObjCount();
+            VecD<Dim> point = tree.GetObj(index)->point;
+            EXPECT_TRUE(tree.Remove(index));
+            EXPECT_FALSE(tree.Remove(tree.GetObjCount()));
+            dataset.erase(std::find_if(dataset.begin(), dataset.end(), [&point](const PointObjD<Dim>& obj) { return obj.point == point; }));
+        }
+        EXPECT_EQ(dataset.size(), tree.GetLiveObjCount());
+        // deleted points are dropped by rebuilds
+        EXPECT_LE(tree.GetDeletedCount(), tree.GetLiveObjCount());
+        ExpectSameKNN<Dim>(tree, dataset, 10, 1);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+    tree.RelayoutToBlocks(4096);
+    EXPECT_EQ(0, tree.GetDeletedCount());
+    EXPECT_EQ(dataset.size(), tree.GetObjCount());
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+}
+
+TEST(BBDTree_Remove, dim2) {
+    TestRemove<2>(false);
+    TestRemove<2>(true);
+}
+TEST(BBDTree_Remove, dim3) {
+    TestRemove<3>(false);
+    TestRemove<3>(true);
+}
+TEST(BBDTree_Remove, dim4) {
+    TestRemove<4>(false);
+    TestRemove<4>(true);
+}
+
+template<int Dim>
+void TestRefit(bool relayout)
+{
+    // own generator, the bound of rebuilt fraction below is statistical, so the dataset shouldn't depend on the other tests
+    std::mt19937 gen(Dim);
+    std::vector<PointObjD<Dim>> dataset;
+    for (int i = 0; i < 3000; ++i) {
+        VecD<Dim> point;
+        for (int d = 0; d < Dim; ++d)
+            point[d] = std::uniform_real_distribution<double>(0, 1)(gen);
+        dataset.push_back({point});
+    }
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset);
+    if (relayout) {
+        tree.CompactShrinkNodes();
+        tree.RelayoutToBlocks(256);
+        tree.QuantizeLeafPoints(8);
+    }
+    for (int i = 0; i < 100; ++i)
+        tree.Remove(std::uniform_int_distribution<index_t>(0, tree.GetObjCount() - 1)(gen));
+    BBDTree<double, Dim> emptyTree;
+    RefitStats emptyStats;
+    EXPECT_TRUE(emptyTree.Refit({}, emptyStats));
+    EXPECT_EQ(0, emptyStats.rebuiltSubtreeCount);
+    EXPECT_FALSE(tree.Refit({}));
+
+    // small moves of a few points touch only small part of the tree
+    VecD<Dim> bboxSize = tree.GetBBox().max - tree.GetBBox().min;
+    int escapedCount = 0;
+    double rebuiltFractionSum = 0;
+    for (int step = 0; step < 20; ++step) {
+        std::vector<VecD<Dim>> points;
+        for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+            points.push_back(tree.GetObj(i)->point);
+            if (!tree.IsDeleted(i) && std::uniform_int_distribution<int>(0, 49)(gen) == 0) {
+                for (int d = 0; d < Dim; ++d) {
+                    points.back()[d] += std::uniform_real_distribution<double>(-0.005, 0.005)(gen) * bboxSize[d];
+                    points.back()[d] = std::clamp(points.back()[d], tree.GetBBox().min[d], tree.GetBBox().max[d]);
+                }
+            }
+        }
+        RefitStats stats;
+        EXPECT_TRUE(tree.Refit(points, stats));
+        escapedCount += stats.escapedCount;
+        rebuiltFractionSum += stats.rebuiltFraction;
+        dataset.clear();
+        for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+            if (!tree.IsDeleted(i))
+                dataset.push_back(*tree.GetObj(i));
+        }
+        ExpectSameKNN<Dim>(tree, dataset, 10, 1);
+        ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    }
+    EXPECT_GT(escapedCount, 0);
+    EXPECT_LT(rebuiltFractionSum, 10);
+
+    // leaving the bounding box rebuilds the whole tree
+    std::vector<VecD<Dim>> points;
+    for (index_t i = 0; i < tree.GetObjCount(); ++i)
+        points.push_back(tree.GetObj(i)->point);
+    index_t moved = 0;
+    while (tree.IsDeleted(moved))
+        ++moved;
+    for (int d = 0; d < Dim; ++d)
+        points[moved][d] = tree.GetBBox().max[d] + bboxSize[d];
+    RefitStats stats;
+    EXPECT_TRUE(tree.Refit(points, stats));
+    EXPECT_TRUE(stats.fullRebuild);
+    EXPECT_EQ(1, stats.rebuiltSubtreeCount);
+    EXPECT_EQ(tree.GetObjCount(), (index_t)dataset.size());
+    dataset.clear();
+    for (index_t i = 0; i < tree.GetObjCount(); ++i)
+        dataset.push_back(*tree.GetObj(i));
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+
+    // refitted tree keeps the conditions of tree building, so removal finds all the points
+    for (int i = 0; i < 100; ++i) {
+        index_t index = std::uniform_int_distribution<index_t>(0, tree.GetObjCount() - 1)(gen);
+        while (tree.IsDeleted(index))
+            index = (index + 1) % tree.GetObjCount();
+        EXPECT_TRUE(tree.Remove(index));
+    }
+}
+
+TEST(BBDTree_Refit, dim2) {
+    TestRefit<2>(false);
+    TestRefit<2>(true);
+}
+TEST(BBDTree_Refit, dim3) {
+    TestRefit<3>(false);
+    TestRefit<3>(true);
+}
+TEST(BBDTree_Refit, dim4) {
+    TestRefit<4>(false);
+    TestRefit<4>(true);
+}
+
+template<int Dim>
+void TestLazyBuild(int expandFactor)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(5000);
+    BBDTree<double, Dim> fullTree = BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(5, dataset, expandFactor);
+    EXPECT_TRUE(tree.IsLazy());
+    EXPECT_EQ(1, tree.GetStats().leafNodeCount);
+
+    // the first queries expand only the lazy leafs they reach
+    ExpectSameKNN<Dim>(tree, dataset, 3, 5);
+    EXPECT_LT(tree.GetStats().leafNodeCount, fullTree.GetStats().leafNodeCount);
+
+    std::vector<std::thread> threads;
+    for (int thread = 0; thread < 4; ++thread) {
+        threads.emplace_back([&tree, &dataset, thread]() {
+            HeapPriQueue<DistObj<double, Dim>> knnQueue;
+            for (int query = 0; query < 20; ++query) {
+                const VecD<Dim>& queryPoint = dataset[(thread * 20 + query) * 7].point;
+                std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(dataset, queryPoint, 5));
+                std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(tree, queryPoint, 5, knnQueue));
+                SortByDistanceToPoint(expected, queryPoint);
+                SortByDistanceToPoint(result, queryPoint);
+                EXPECT_EQ(expected, result);
+                EXPECT_EQ(expected[0], FindNearestNeighbor(tree, queryPoint).point);
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+
+    tree.ExpandLazyLeafs();
+    EXPECT_FALSE(tree.IsLazy());
+    EXPECT_EQ(dataset.size(), tree.GetObjCount());
+    ExpectSameKNN<Dim>(tree, dataset, 10, 1);
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    tree.RelayoutToBlocks(256);
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+
+    // searches expand lazy leafs also of trees declared const
+    const BBDTree<double, Dim> constTree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(5, dataset, expandFactor);
+    ExpectSameKNN<Dim>(constTree, dataset, 10, 5);
+    EXPECT_GT(constTree.GetStats().leafNodeCount, 1);
+}
+
+//! Gets the biggest leaf size of the tree
+template<int Dim>
+int GetMaxLeafSize(const BBDTree<double, Dim>& tree)
+{
+    int maxLeafSize = 0;
+    ForEachLeaf(tree, [&](const LeafNode* leafNode, const Box<double, Dim>&) { maxLeafSize = std::max(maxLeafSize, tree.GetLeafSize(leafNode)); });
+    return maxLeafSize;
+}
+
+template<int Dim>
+void TestLazyBuildTightCluster()
+{
+    // shrink box of the cluster is too deep for compact shrink node
+    std::mt19937 gen(Dim);
+    std::uniform_real_distribution<double> distr(0, 1);
+    std::vector<PointObjD<Dim>> dataset;
+    for (int i = 0; i < 2000; ++i) {
+        VecD<Dim> point;
+        for (int d = 0; d < Dim; ++d)
+            point[d] = i < 500 ? distr(gen) : 0.3 + 1e-9 * distr(gen);
+        dataset.push_back({point});
+    }
+    BBDTree<double, Dim> fullTree = BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(5, dataset);
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int query = 0; query < 10; ++query) {
+        const VecD<Dim>& queryPoint = dataset[500 + query * 100].point;
+        std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(dataset, queryPoint, 5));
+        std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(tree, queryPoint, 5, knnQueue));
+        SortByDistanceToPoint(expected, queryPoint);
+        SortByDistanceToPoint(result, queryPoint);
+        EXPECT_EQ(expected, result);
+    }
+    // the expanded points are split as in the full tree, no big leaf is left behind
+    EXPECT_EQ(GetMaxLeafSize(fullTree), GetMaxLeafSize(tree));
+    tree.ExpandLazyLeafs();
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+    tree.CompactShrinkNodes();
+    tree.RelayoutToBlocks(256);
+    ExpectSameKNN<Dim>(tree, dataset, 10, 5);
+}
+
+TEST(BBDTree_LazyBuild, TightCluster) {
+    TestLazyBuildTightCluster<2>();
+    TestLazyBuildTightCluster<3>();
+}
+
+TEST(BBDTree_LazyBuild, dim2) {
+    TestLazyBuild<2>(2);
+    TestLazyBuild<2>(16);
+}
+TEST(BBDTree_LazyBuild, dim3) {
+    TestLazyBuild<3>(2);
+    TestLazyBuild<3>(16);
+}
+TEST(BBDTree_LazyBuild, dim4) {
+    TestLazyBuild<4>(2);
+    TestLazyBuild<4>(16);
+}
+
+template<int Dim>
+void TestQueryAdaptiveTree()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(5000);
+    Box<double, Dim> bbox = Box<double, Dim>::GetBoundingBox(dataset);
+    // queries concentrated into corner of the bounding box
+    std::vector<VecD<Dim>> queries;
+    for (int i = 0; i < 500; ++i) {
+        VecD<Dim> query = TestData::Get().GenRandVec<Dim>();
+        for (int d = 0; d < Dim; ++d)
+            query[d] = bbox.min[d] + (query[d] - bbox.min[d]) * 0.1;
+        queries.push_back(query);
+    }
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(8, dataset);
+    BBDTree<double, Dim> adaptiveTree = BBDTree<double, Dim>::BuildQueryAdaptiveTree(8, dataset, queries, 4);
+    BBDTreeStats stats = tree.GetStats();
+    BBDTreeStats adaptiveStats = adaptiveTree.GetStats();
+    EXPECT_EQ(dataset.size(), adaptiveTree.GetObjCount());
+    // cold regions are coarser
+    EXPECT_LT(adaptiveStats.leafNodeCount, stats.leafNodeCount);
+    EXPECT_GT(adaptiveStats.avgLeafSize, stats.avgLeafSize);
+    ExpectSameKNN<Dim>(adaptiveTree, dataset, 10, 1);
+    ExpectSameKNN<Dim>(adaptiveTree, dataset, 10, 5);
+
+    // queries inside the hot region
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int i = 0; i < 50; ++i) {
+        const VecD<Dim>& query = queries[i];
+        std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(dataset, query, 5));
+        std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(adaptiveTree, query, 5, knnQueue));
+        SortByDistanceToPoint(expected, query);
+        SortByDistanceToPoint(result, query);
+        EXPECT_EQ(expected, result);
+    }
+}
+
+TEST(BBDTree_QueryAdaptiveTree, dim2) {
+    TestQueryAdaptiveTree<2>();
+}
+TEST(BBDTree_QueryAdaptiveTree, dim3) {
+    TestQueryAdaptiveTree<3>();
+}
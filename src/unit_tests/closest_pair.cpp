@@ -0,0 +1,96 @@
+
+#include <random>
+#include <gtest/gtest.h>
+#include <aknn/closest_pair.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void RandomTestsClosestPairs()
+{
+    // clustered first set and uniform second set, so that close pairs are rare
+    std::vector<PointObjD<Dim>> datasetA;
+    for (int i = 0; i < 1500; ++i) {
+        VecD<Dim> point = TestData::Get().GenRandVec<Dim>();
+        for (int d = 0; d < Dim; ++d)
+            point[d] = (i % 3) * 0.3 + point[d] * 0.1;
+        datasetA.push_back(PointObjD<Dim>({point}));
+    }
+    std::vector<PointObjD<Dim>> datasetB = TestData::Get().GenRandDataset<Dim>(1000);
+
+    BBDTree<double, Dim> treeA = BBDTree<double, Dim>::BuildMidpointSplitTree(8, datasetA);
+    BBDTree<double, Dim> treeB = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(4, datasetB);
+    for (int k : {1, 7, 50}) {
+        std::vector<ObjPair<double, Dim>> expected = LinearFindKClosestPairs(datasetA, datasetB, k);
+        for (int threadCount : {1, 4}) {
+            std::vector<ObjPair<double, Dim>> pairs = FindKClosestPairs(treeA, treeB, k, threadCount);
+            ASSERT_EQ(expected.size(), pairs.size());
+            for (size_t i = 0; i < pairs.size(); ++i) {
+                EXPECT_EQ(expected[i].dist, pairs[i].dist) << "Incorrect pair: k" << k << ", i" << i;
+                EXPECT_EQ(pairs[i].dist, pairs[i].a.point.DistSquared(pairs[i].b.point));
+            }
+
+            for (double epsilon : {0.5, 2.0}) {
+                pairs = FindKAproximateClosestPairs(treeA, treeB, k, epsilon, threadCount);
+                ASSERT_EQ(expected.size(), pairs.size());
+                for (size_t i = 0; i < pairs.size(); ++i)
+                    EXPECT_LE(pairs[i].dist, expected[i].dist * (1 + epsilon) * (1 + 1e-12)) << "Incorrect aproximate pair: k" << k << ", i" << i;
+            }
+        }
+    }
+}
+
+TEST(RandomTestClosestPairs, dim2) {
+    RandomTestsClosestPairs<2>();
+}
+TEST(RandomTestClosestPairs, dim3) {
+    RandomTestsClosestPairs<3>();
+}
+
+TEST(ClosestPairs, MetricAndEmpty) {
+    std::vector<PointObjD<2>> datasetA = TestData::Get().GenRandDataset<2>(500);
+    std::vector<PointObjD<2>> datasetB = TestData::Get().GenRandDataset<2>(500);
+    BBDTree<double, 2> treeA = BBDTree<double, 2>::BuildMidpointSplitTree(6, datasetA);
+    BBDTree<double, 2> treeB = BBDTree<double, 2>::BuildMidpointSplitTree(6, datasetB);
+    std::vector<ObjPair<double, 2>> expected = LinearFindKClosestPairs(datasetA, datasetB, 10, L1Metric());
+    std::vector<ObjPair<double, 2>> pairs = FindKClosestPairs(treeA, treeB, 10, 2, L1Metric());
+    ASSERT_EQ(expected.size(), pairs.size());
+    for (size_t i = 0; i < pairs.size(); ++i)
+        EXPECT_EQ(expected[i].dist, pairs[i].dist);
+
+    // the closest pair of the same tree is a point with itself
+    EXPECT_EQ(0, FindClosestPair(treeA, treeA, 4).dist);
+
+    BBDTree<double, 2> emptyTree;
+    EXPECT_EQ(GetMaxValue<double>(), FindClosestPair(treeA, emptyTree).dist);
+    EXPECT_TRUE(FindKClosestPairs(emptyTree, treeB, 5).empty());
+}
+
+TEST(ClosestPairs, Int64Coords) {
+    // squared distances of int64_t coordinates don't fit into 64 bits
+    std::mt19937 gen(0);
+    std::uniform_int_distribution<int64_t> distr(0, 1000);
+    std::vector<PointObj<int64_t, 2>> datasetA, datasetB;
+    for (int i = 0; i < 500; ++i) {
+        datasetA.push_back({Vec<int64_t, 2>({distr(gen) * 1000000000, distr(gen) * 1000000000})});
+        datasetB.push_back({Vec<int64_t, 2>({distr(gen) * 1000000000, distr(gen) * 1000000000})});
+    }
+    BBDTree<int64_t, 2> treeA = BBDTree<int64_t, 2>::BuildMidpointSplitTree(6, datasetA);
+    BBDTree<int64_t, 2> treeB = BBDTree<int64_t, 2>::BuildMidpointSplitTree(6, datasetB);
+    std::vector<ObjPair<int64_t, 2>> expected = LinearFindKClosestPairs(datasetA, datasetB, 20);
+    for (int threadCount : {1, 4}) {
+        std::vector<ObjPair<int64_t, 2>> pairs = FindKClosestPairs(treeA, treeB, 20, threadCount);
+        ASSERT_EQ(expected.size(), pairs.size());
+        for (size_t i = 0; i < pairs.size(); ++i)
+            EXPECT_TRUE(expected[i].dist == pairs[i].dist) << "Incorrect pair: i" << i;
+    }
+}
+
+TEST(ClosestPairs, WithoutExactPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(200);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(6, dataset);
+    BBDTree<double, 2> quantizedTree = BBDTree<double, 2>::BuildMidpointSplitTree(6, dataset);
+    quantizedTree.QuantizeLeafPoints(8, false);
+    EXPECT_TRUE(FindKClosestPairs(tree, quantizedTree, 5).empty());
+    EXPECT_EQ(GetMaxValue<double>(), FindClosestPair(quantizedTree, tree).dist);
+}
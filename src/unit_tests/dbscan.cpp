@@ -0,0 +1,156 @@
+
+#include <map>
+#include <set>
+#include <gtest/gtest.h>
+#include <aknn/dbscan.h>
+
+#include "test_data.h"
+
+TEST(ConcurrentUnionFind, Unite) {
+    ConcurrentUnionFind unionFind(10);
+    EXPECT_TRUE(unionFind.Unite(3, 7));
+    EXPECT_TRUE(unionFind.Unite(7, 9));
+    EXPECT_FALSE(unionFind.Unite(9, 3));
+    EXPECT_TRUE(unionFind.Unite(1, 2));
+    EXPECT_EQ(3, unionFind.Find(9));
+    EXPECT_EQ(1, unionFind.Find(2));
+    EXPECT_EQ(5, unionFind.Find(5));
+    EXPECT_TRUE(unionFind.Unite(9, 2));
+    EXPECT_EQ(1, unionFind.Find(7));
+}
+
+//! Naive DBSCAN, cluster labels of core points are smallest index of their cluster, border points have -2 - index of their nearest core point
+template<int Dim>
+std::vector<int> LinearDBSCAN(const BBDTree<double, Dim>& tree, double radius, int minPoints)
+{
+    index_t count = tree.GetObjCount();
+    auto isNeighbor = [&](index_t i, index_t j) { return tree.GetObj(i)->point.DistSquared(tree.GetObj(j)->point) <= radius * radius; };
+    std::vector<bool> isCore(count);
+    for (index_t i = 0; i < count; ++i) {
+        int neighbors = 0;
+        for (index_t j = 0; j < count; ++j)
+            neighbors += isNeighbor(i, j);
+        isCore[i] = neighbors >= minPoints;
+    }
+    std::vector<int> labels(count, -1);
+    for (index_t i = 0; i < count; ++i) {
+        if (!isCore[i] || labels[i] != -1)
+            continue;
+        std::vector<index_t> stack = {i};
+        labels[i] = i;
+        while (!stack.empty()) {
+            index_t p = stack.back();
+            stack.pop_back();
+            for (index_t j = 0; j < count; ++j) {
+                if (isCore[j] && labels[j] == -1 && isNeighbor(p, j)) {
+                    labels[j] = i;
+                    stack.push_back(j);
+                }
+            }
+        }
+    }
+    for (index_t i = 0; i < count; ++i) {
+        if (isCore[i])
+            continue;
+        double nearestDist = radius * radius;
+        for (index_t j = 0; j < count; ++j) {
+            double dist = tree.GetObj(i)->point.DistSquared(tree.GetObj(j)->point);
+            if (isCore[j] && dist <= nearestDist) {
+                nearestDist = dist;
+                labels[i] = -2 - (int)j;
+            }
+        }
+    }
+    return labels;
+}
+
+template<int Dim>
+void RandomTestsDBSCAN()
+{
+    // clusters of different density with uniform noise
+    std::vector<PointObjD<Dim>> dataset;
+    for (int c = 0; c < 5; ++c) {
+        VecD<Dim> center = TestData::Get().GenRandVec<Dim>();
+        double size = 0.02 + 0.03 * c;
+        for (int i = 0; i < 200; ++i) {
+            VecD<Dim> point = TestData::Get().GenRandVec<Dim>();
+            for (int d = 0; d < Dim; ++d)
+                point[d] = center[d] + point[d] * size;
+            dataset.push_back(PointObjD<Dim>({point}));
+        }
+    }
+    std::vector<PointObjD<Dim>> noisePoints = TestData::Get().GenRandDataset<Dim>(300);
+    dataset.insert(dataset.end(), noisePoints.begin(), noisePoints.end());
+
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(8, dataset);
+    const int noise = DBSCAN<double, Dim>::NOISE;
+    for (double radius : {0.01, 0.03, 0.1}) {
+        for (int minPoints : {1, 5, 20}) {
+            std::vector<int> expected = LinearDBSCAN(tree, radius, minPoints);
+            for (int threadCount : {1, 4}) {
+                DBSCAN<double, Dim> dbscan(tree, radius, minPoints, 0, threadCount);
+                dbscan.Run();
+                const std::vector<int>& labels = dbscan.GetLabels();
+                ASSERT_EQ(expected.size(), labels.size());
+
+                // clusters of core points are same up to numbering
+                std::map<int, int> clusterMap;
+                std::set<int> clusters;
+                for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                    if (expected[i] < 0)
+                        continue;
+                    EXPECT_TRUE(dbscan.IsCorePoint(i));
+                    ASSERT_NE(noise, labels[i]);
+                    auto it = clusterMap.insert({expected[i], labels[i]}).first;
+                    EXPECT_EQ(it->second, labels[i]) << "Incorrect cluster: r" << radius << ", m" << minPoints << ", i" << i;
+                    clusters.insert(labels[i]);
+                }
+                EXPECT_EQ(clusterMap.size(), clusters.size());
+                EXPECT_EQ((int)clusters.size(), dbscan.GetClusterCount());
+
+                // border points join cluster of the nearest core point
+                for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                    if (expected[i] == -1) {
+                        EXPECT_EQ(noise, labels[i]);
+                    } else if (expected[i] < -1) {
+                        EXPECT_FALSE(dbscan.IsCorePoint(i));
+                        EXPECT_EQ(labels[-2 - expected[i]], labels[i]) << "Incorrect border: r" << radius << ", m" << minPoints << ", i" << i;
+                    }
+                }
+            }
+        }
+    }
+}
+
+TEST(RandomTestDBSCAN, dim2) {
+    RandomTestsDBSCAN<2>();
+}
+TEST(RandomTestDBSCAN, dim3) {
+    RandomTestsDBSCAN<3>();
+}
+
+TEST(DBSCAN, ApproximateCount) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(2000);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildLazyMidpointSplitTree(8, dataset);
+    DBSCAN<double, 2> exact(tree, 0.03, 6);
+    exact.Run();
+    DBSCAN<double, 2> aproximate(tree, 0.03, 6, 0.5);
+    aproximate.Run();
+    // the aproximate core points are superset of the exact ones
+    for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+        if (exact.IsCorePoint(i)) {
+            EXPECT_TRUE(aproximate.IsCorePoint(i));
+        }
+    }
+}
+
+TEST(DBSCAN, WithoutExactPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(500);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(8, dataset);
+    tree.QuantizeLeafPoints(8, false);
+    DBSCAN<double, 2> dbscan(tree, 0.1, 3);
+    EXPECT_FALSE(dbscan.Run());
+    EXPECT_EQ(0, dbscan.GetClusterCount());
+    for (int label : dbscan.GetLabels())
+        EXPECT_EQ((DBSCAN<double, 2>::NOISE), label);
+}
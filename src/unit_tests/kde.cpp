@@ -0,0 +1,83 @@
+
+#include <gtest/gtest.h>
+#include <aknn/kde.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void RandomTestsKernelDensity()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(5000);
+
+    std::vector<BBDTree<double, Dim>> trees;
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(8, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildLazyMidpointSplitTree(8, dataset));
+    std::vector<VecD<Dim>> queryPoints;
+    for (int query = 0; query < 50; ++query)
+        queryPoints.push_back(TestData::Get().GenRandVec<Dim>());
+
+    for (double bandwidth : {0.01, 0.05, 0.3}) {
+        std::vector<double> expected;
+        for (const VecD<Dim>& queryPoint : queryPoints)
+            expected.push_back(LinearKernelDensity(dataset, queryPoint, bandwidth));
+        for (int t = 0; t < (int)trees.size(); ++t) {
+            KernelDensityEstimator<double, Dim> estimator(trees[t], bandwidth);
+            for (double relativeError : {0.0, 0.01, 0.1}) {
+                std::vector<double> result;
+                estimator.EstimateBatch(queryPoints, relativeError, result, 4);
+                ASSERT_EQ(queryPoints.size(), result.size());
+                for (size_t q = 0; q < queryPoints.size(); ++q) {
+                    EXPECT_NEAR(expected[q], result[q], expected[q] * relativeError + 1e-9 * expected[q] + 1e-300)
+                        << "Incorrect density: t" << t << ", h" << bandwidth << ", e" << relativeError << ", p" << queryPoints[q];
+                    EXPECT_EQ(result[q], estimator.Estimate(queryPoints[q], relativeError));
+                }
+            }
+        }
+    }
+
+    // the approximation visits small part of the leafs
+    KernelDensityEstimator<double, Dim> estimator(trees[0], 0.02);
+    TraversalStats<double, Dim> stats;
+    for (const VecD<Dim>& queryPoint : queryPoints)
+        estimator.template Estimate<true>(queryPoint, 0.01, stats);
+    EXPECT_LT(stats.visitedLeafs * 8, (int)(queryPoints.size() * dataset.size() / 10));
+}
+
+TEST(RandomTestKernelDensity, dim2) {
+    RandomTestsKernelDensity<2>();
+}
+TEST(RandomTestKernelDensity, dim3) {
+    RandomTestsKernelDensity<3>();
+}
+
+TEST(KernelDensity, RemovedPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(1000);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(5, dataset);
+    tree.SetRebuildThreshold(1);
+    std::vector<PointObjD<2>> liveObjs;
+    for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+        if (i % 2 == 0)
+            tree.Remove(i);
+        else
+            liveObjs.push_back(*tree.GetObj(i));
+    }
+
+    KernelDensityEstimator<double, 2> estimator(tree, 0.1);
+    VecD<2> queryPoint = TestData::Get().GenRandVec<2>();
+    double expected = LinearKernelDensity(liveObjs, queryPoint, 0.1);
+    EXPECT_NEAR(expected, estimator.Estimate(queryPoint), expected * 1e-9);
+}
+
+TEST(KernelDensity, Empty) {
+    BBDTree<double, 2> tree;
+    KernelDensityEstimator<double, 2> estimator(tree, 0.1);
+    EXPECT_EQ(0, estimator.Estimate(VecD2({0.5, 0.5})));
+}
+
+TEST(KernelDensity, WithoutExactPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(200);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(8, dataset);
+    tree.QuantizeLeafPoints(8, false);
+    KernelDensityEstimator<double, 2> estimator(tree, 0.1);
+    EXPECT_EQ(0, estimator.Estimate(VecD2({0.5, 0.5})));
+}
@@ -0,0 +1,76 @@
+
+#include <gtest/gtest.h>
+#include <aknn/knn_cursor.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void RandomTestsKNearestNeighborsCursor(bool lazy)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(5000);
+    BBDTree<double, Dim> tree = lazy ? BBDTree<double, Dim>::BuildLazyMidpointSplitTree(6, dataset) : BBDTree<double, Dim>::BuildMidpointSplitTree(6, dataset);
+    HeapPriQueue<DistObj<double, Dim>> queue;
+    const int k = 5;
+    for (double epsilon : {0.0, 1.0}) {
+        KNearestNeighborsCursor<double, Dim> cursor(tree);
+        int cursorSteps = 0;
+        int rootSteps = 0;
+        // smoothly moving query point, with a jump and a point outside the tree
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        for (int q = 0; q < 300; ++q) {
+            VecD<Dim> step = TestData::Get().GenRandVec<Dim>();
+            for (int d = 0; d < Dim; ++d)
+                queryPoint[d] = std::clamp(queryPoint[d] + (step[d] - 0.5) * 0.01, 0.0, 1.0);
+            if (q == 100)
+                queryPoint = TestData::Get().GenRandVec<Dim>();
+            if (q == 200)
+                queryPoint[0] = 1.5;
+
+            TraversalStats<double, Dim> stats;
+            std::vector<PointObjD<Dim>> knn = cursor.template FindKAproximateNearestNeighbors<true>(queryPoint, k, epsilon, queue, stats);
+            cursorSteps += stats.traversalSteps;
+            TraversalStats<double, Dim> rootStats;
+            std::vector<PointObjD<Dim>> rootKnn = FindKAproximateNearestNeighbors<double, Dim, Empty, true>(tree, queryPoint, k, epsilon, queue, rootStats);
+            rootSteps += rootStats.traversalSteps;
+
+            std::vector<double> expected = GetSortedDistances(LinearFindKNearestNeighbors(dataset, queryPoint, k), queryPoint);
+            std::vector<double> found = GetSortedDistances(knn, queryPoint);
+            ASSERT_EQ(expected.size(), found.size());
+            for (int i = 0; i < k; ++i) {
+                if (epsilon == 0) {
+                    EXPECT_EQ(expected[i], found[i]) << "Incorrect neighbor: q" << q << ", i" << i;
+                } else {
+                    EXPECT_LE(found[i], expected[i] * (1 + epsilon) * (1 + 1e-12)) << "Incorrect aproximate neighbor: q" << q << ", i" << i;
+                }
+            }
+        }
+        EXPECT_LT(cursorSteps, rootSteps);
+    }
+}
+
+TEST(RandomTestKNearestNeighborsCursor, dim2) {
+    RandomTestsKNearestNeighborsCursor<2>(false);
+    RandomTestsKNearestNeighborsCursor<2>(true);
+}
+TEST(RandomTestKNearestNeighborsCursor, dim3) {
+    RandomTestsKNearestNeighborsCursor<3>(false);
+    RandomTestsKNearestNeighborsCursor<3>(true);
+}
+
+TEST(KNearestNeighborsCursor, ResetAndEmpty) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(100);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(4, dataset);
+    HeapPriQueue<DistObj<double, 2>> queue;
+    KNearestNeighborsCursor<double, 2> cursor(tree);
+    EXPECT_EQ(0, cursor.GetPathDepth());
+    EXPECT_EQ(3, (int)cursor.FindKNearestNeighbors(VecD2(0.5), 3, queue).size());
+    EXPECT_LT(0, cursor.GetPathDepth());
+    // more neighbors than the last search found
+    EXPECT_EQ(10, (int)cursor.FindKNearestNeighbors(VecD2(0.5), 10, queue).size());
+    cursor.Reset();
+    EXPECT_EQ(0, cursor.GetPathDepth());
+
+    BBDTree<double, 2> emptyTree;
+    KNearestNeighborsCursor<double, 2> emptyCursor(emptyTree);
+    EXPECT_TRUE(emptyCursor.FindKNearestNeighbors(VecD2(0.5), 3, queue).empty());
+}
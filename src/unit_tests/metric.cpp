@@ -0,0 +1,112 @@
+
+#include <gtest/gtest.h>
+#include <aknn/metric.h>
+#include <aknn/search.h>
+
+#include "test_data.h"
+
+TEST(Metric, VecDistance) {
+    VecD2 a({1, 2});
+    VecD2 b({4, -2});
+    EXPECT_EQ(25, a.Distance(b, L2Metric()));
+    EXPECT_EQ(a.DistSquared(b), a.Distance(b, L2Metric()));
+    EXPECT_EQ(7, a.Distance(b, L1Metric()));
+    EXPECT_EQ(4, a.Distance(b, LInfMetric()));
+    EXPECT_EQ(2 * 9 + 0.5 * 16, a.Distance(b, WeightedL2Metric<2>{{2, 0.5}}));
+    EXPECT_NEAR(27 + 64, a.Distance(b, MinkowskiMetric{3}), 1e-9);
+}
+
+TEST(Metric, RelaxFactor) {
+    // all metrics allow the same ratio sqrt(1 + epsilon) of true distances
+    EXPECT_EQ(4.0, L2Metric().RelaxFactor(3.0));
+    EXPECT_EQ(4.0, (WeightedL2Metric<2>{{2, 0.5}}).RelaxFactor(3.0));
+    EXPECT_EQ(2.0, L1Metric().RelaxFactor(3.0));
+    EXPECT_EQ(2.0, LInfMetric().RelaxFactor(3.0));
+    EXPECT_NEAR(8.0, MinkowskiMetric{3}.RelaxFactor(3.0), 1e-9);
+}
+
+TEST(Metric, BoxDistance) {
+    BoxD2 box(VecD2({0, 0}), VecD2({2, 2}));
+    VecD2 inside({1, 1});
+    VecD2 outside({5, -1});
+    EXPECT_EQ(0, box.Distance(inside, L1Metric()));
+    EXPECT_EQ(0, box.Distance(inside, LInfMetric()));
+    EXPECT_EQ(3 + 1, box.Distance(outside, L1Metric()));
+    EXPECT_EQ(3, box.Distance(outside, LInfMetric()));
+    EXPECT_EQ(box.SquaredDistance(outside), box.Distance(outside, L2Metric()));
+    EXPECT_EQ(5 + 3, box.MaxDistance(outside, L1Metric()));
+    EXPECT_EQ(1 + 1, box.MaxDistance(inside, L1Metric()));
+    EXPECT_EQ(box.MaxSquaredDistance(outside), box.MaxDistance(outside, L2Metric()));
+    BoxD2 other(VecD2({3, -1}), VecD2({4, 0}));
+    EXPECT_EQ(1 + 0, box.Distance(other, L1Metric()));
+    EXPECT_EQ(4 + 3, box.MaxDistance(other, L1Metric()));
+    EXPECT_EQ(16 + 9, box.MaxDistance(other, L2Metric()));
+}
+
+template<int Dim, typename MetricT>
+void RandomTestsSearchWithMetric(const MetricT& metric)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(1000);
+
+    std::vector<BBDTree<double, Dim>> trees;
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildLazyMidpointSplitTree(5, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset));
+    trees[2].QuantizeLeafPoints(8);
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    std::vector<PointObjD<Dim>> rangeResult;
+    for (int query = 0; query < 20; ++query) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        for (int t = 0; t < (int)trees.size(); ++t) {
+            for (int k : {1, 5, 20}) {
+                std::vector<PointObjD<Dim>> expected = LinearFindKNearestNeighborsByMetric(dataset, queryPoint, k, metric);
+                std::vector<PointObjD<Dim>> result = FindKNearestNeighbors(trees[t], queryPoint, k, knnQueue, metric);
+                ASSERT_EQ(expected.size(), result.size());
+                std::vector<double> expectedDists;
+                std::vector<double> resultDists;
+                for (int i = 0; i < k; ++i) {
+                    expectedDists.push_back(queryPoint.Distance(expected[i].point, metric));
+                    resultDists.push_back(queryPoint.Distance(result[i].point, metric));
+                }
+                std::sort(expectedDists.begin(), expectedDists.end());
+                std::sort(resultDists.begin(), resultDists.end());
+                EXPECT_EQ(expectedDists, resultDists) << "Incorrect kNN: t" << t << ", k" << k << ", p" << queryPoint;
+
+                TraversalStats<double, Dim> stats;
+                std::vector<PointObjD<Dim>> aknn = FindKAproximateNearestNeighbors<double, Dim, Empty, false>(trees[t], queryPoint, k, 1, knnQueue, stats, metric);
+                ASSERT_EQ(expected.size(), aknn.size());
+                for (const PointObjD<Dim>& obj : aknn)
+                    EXPECT_LE(queryPoint.Distance(obj.point, metric), metric.RelaxFactor(1.0) * expectedDists.back());
+            }
+
+            for (double radius : {0.05, 0.3}) {
+                size_t expected = 0;
+                for (const PointObjD<Dim>& obj : dataset) {
+                    if (queryPoint.Distance(obj.point, metric) <= metric.Reduce(radius))
+                        ++expected;
+                }
+                EXPECT_EQ(expected, FindRange(trees[t], queryPoint, radius, rangeResult, metric));
+                for (const PointObjD<Dim>& obj : rangeResult)
+                    EXPECT_LE(queryPoint.Distance(obj.point, metric), metric.Reduce(radius));
+                EXPECT_EQ((index_t)expected, CountRange(trees[t], queryPoint, radius, metric));
+            }
+        }
+    }
+}
+
+TEST(RandomTestSearchWithMetric, L1) {
+    RandomTestsSearchWithMetric<2>(L1Metric());
+    RandomTestsSearchWithMetric<3>(L1Metric());
+}
+TEST(RandomTestSearchWithMetric, LInf) {
+    RandomTestsSearchWithMetric<2>(LInfMetric());
+    RandomTestsSearchWithMetric<3>(LInfMetric());
+}
+TEST(RandomTestSearchWithMetric, WeightedL2) {
+    RandomTestsSearchWithMetric<2>(WeightedL2Metric<2>{{1, 9}});
+    RandomTestsSearchWithMetric<3>(WeightedL2Metric<3>{{0.25, 1, 4}});
+}
+TEST(RandomTestSearchWithMetric, Minkowski) {
+    RandomTestsSearchWithMetric<2>(MinkowskiMetric{3});
+    RandomTestsSearchWithMetric<3>(MinkowskiMetric{1.5});
+}
@@ -0,0 +1,138 @@
+
+#include <gtest/gtest.h>
+#include <aknn/nn_iterator.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void TestNearestNeighborIterator()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(1000);
+
+    std::vector<BBDTree<double, Dim>> trees;
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildLazyMidpointSplitTree(5, dataset));
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int query = 0; query < 20; ++query) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        std::vector<Vec<double, Dim>> expected = ObjsToVec(dataset);
+        SortByDistanceToPoint(expected, queryPoint);
+        for (int t = 0; t < (int)trees.size(); ++t) {
+            // whole dataset is returned in distance order
+            NearestNeighborIterator<double, Dim> iterator(trees[t], queryPoint);
+            DistObj<double, Dim> next;
+            std::vector<Vec<double, Dim>> result;
+            DistT<double> lastDist = 0;
+            while (iterator.Next(next)) {
+                EXPECT_GE(next.dist, lastDist);
+                EXPECT_EQ(next.dist, queryPoint.DistSquared(next.obj.point));
+                lastDist = next.dist;
+                result.push_back(next.obj.point);
+            }
+            EXPECT_EQ(expected.size(), result.size());
+            SortByDistanceToPoint(result, queryPoint);
+            EXPECT_EQ(expected, result);
+            EXPECT_FALSE(iterator.Next(next));
+        }
+
+        // first k neighbors visit at most as many nodes as the search for k nearest neighbors
+        for (int k : {1, 10, 50}) {
+            NearestNeighborIterator<double, Dim> iterator(trees[0], queryPoint);
+            DistObj<double, Dim> next;
+            std::vector<Vec<double, Dim>> result;
+            for (int i = 0; i < k && iterator.Next(next); ++i)
+                result.push_back(next.obj.point);
+            std::vector<Vec<double, Dim>> expectedKnn(expected.begin(), expected.begin() + k);
+            EXPECT_EQ(expectedKnn, result);
+            TraversalStats<double, Dim> stats;
+            FindKAproximateNearestNeighbors<double, Dim, Empty, true>(trees[0], queryPoint, k, 0, knnQueue, stats);
+            EXPECT_LE(iterator.GetTraversalSteps(), stats.traversalSteps);
+        }
+
+        // aproximate iterator returns all points within the epsilon bound
+        NearestNeighborIterator<double, Dim> iterator(trees[0], queryPoint, 1);
+        DistObj<double, Dim> next;
+        size_t count = 0;
+        while (iterator.Next(next)) {
+            EXPECT_LE(next.dist, 2 * queryPoint.DistSquared(expected[count]));
+            ++count;
+        }
+        EXPECT_EQ(dataset.size(), count);
+    }
+}
+
+TEST(NearestNeighborIterator, dim2) {
+    TestNearestNeighborIterator<2>();
+}
+TEST(NearestNeighborIterator, dim3) {
+    TestNearestNeighborIterator<3>();
+}
+TEST(NearestNeighborIterator, dim4) {
+    TestNearestNeighborIterator<4>();
+}
+
+TEST(NearestNeighborIterator, Metric) {
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(1000);
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildMidpointSplitTree(5, dataset);
+    for (int query = 0; query < 10; ++query) {
+        VecD<3> queryPoint = TestData::Get().GenRandVec<3>();
+        std::vector<Vec<double, 3>> expected = ObjsToVec(LinearFindKNearestNeighborsByMetric(dataset, queryPoint, 20, L1Metric()));
+        NearestNeighborIterator<double, 3, Empty, L1Metric> iterator(tree, queryPoint);
+        DistObj<double, 3> next;
+        std::vector<Vec<double, 3>> result;
+        DistT<double> lastDist = 0;
+        while ((int)result.size() < 20 && iterator.Next(next)) {
+            EXPECT_GE(next.dist, lastDist);
+            EXPECT_EQ(next.dist, queryPoint.Distance(next.obj.point, L1Metric()));
+            lastDist = next.dist;
+            result.push_back(next.obj.point);
+        }
+        SortByDistanceToPoint(expected, queryPoint);
+        SortByDistanceToPoint(result, queryPoint);
+        EXPECT_EQ(expected, result);
+    }
+}
+
+TEST(NearestNeighborIterator, QuantizedWithoutExactPoints) {
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(1000);
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildMidpointSplitTree(5, dataset);
+    tree.QuantizeLeafPoints(8, false);
+    HeapPriQueue<DistObj<double, 3>> knnQueue;
+    for (int query = 0; query < 10; ++query) {
+        VecD<3> queryPoint = TestData::Get().GenRandVec<3>();
+        // iterator returns the same decoded points as the kNN search
+        std::vector<Vec<double, 3>> expected = ObjsToVec(FindKNearestNeighbors(tree, queryPoint, 20, knnQueue));
+        NearestNeighborIterator<double, 3> iterator(tree, queryPoint);
+        DistObj<double, 3> next;
+        std::vector<Vec<double, 3>> result;
+        DistT<double> lastDist = 0;
+        size_t count = 0;
+        while (iterator.Next(next)) {
+            EXPECT_GE(next.dist, lastDist);
+            lastDist = next.dist;
+            if (result.size() < expected.size())
+                result.push_back(next.obj.point);
+            ++count;
+        }
+        EXPECT_EQ(dataset.size(), count);
+        SortByDistanceToPoint(expected, queryPoint);
+        SortByDistanceToPoint(result, queryPoint);
+        EXPECT_EQ(expected, result);
+    }
+}
+
+TEST(NearestNeighborIterator, RemovedPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(1000);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(5, dataset);
+    tree.SetRebuildThreshold(1);
+    for (index_t i = 0; i < tree.GetObjCount(); i += 2)
+        tree.Remove(i);
+
+    VecD<2> queryPoint = TestData::Get().GenRandVec<2>();
+    NearestNeighborIterator<double, 2> iterator(tree, queryPoint);
+    DistObj<double, 2> next;
+    index_t count = 0;
+    while (iterator.Next(next))
+        ++count;
+    EXPECT_EQ(tree.GetLiveObjCount(), count);
+}
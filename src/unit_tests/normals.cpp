@@ -0,0 +1,92 @@
+
+#include <gtest/gtest.h>
+#include <aknn/normals.h>
+
+#include "test_data.h"
+
+struct NormalData
+{
+    VecD3 normal;
+};
+
+TEST(Normals, SmallestEigenVector) {
+    // diagonal and general symmetric matrices with known smallest eigenvector
+    std::array<double, 3> res = GetSmallestEigenVector({3, 0, 0, 1, 0, 2});
+    EXPECT_NEAR(1, std::abs(res[1]), 1e-12);
+
+    // covariance of points on plane z = x + y
+    std::array<double, 6> covariance = {0, 0, 0, 0, 0, 0};
+    for (int i = 0; i < 100; ++i) {
+        VecD3 point = TestData::Get().GenRandVec<3>();
+        double x = point[0] - 0.5, y = point[1] - 0.5, z = x + y;
+        covariance[0] += x * x;
+        covariance[1] += x * y;
+        covariance[2] += x * z;
+        covariance[3] += y * y;
+        covariance[4] += y * z;
+        covariance[5] += z * z;
+    }
+    res = GetSmallestEigenVector(covariance);
+    double norm = std::sqrt(3.0);
+    EXPECT_NEAR(1, std::abs(res[0] / norm + res[1] / norm - res[2] / norm), 1e-9);
+
+    // points on line have any perpendicular normal
+    res = GetSmallestEigenVector({1, 1, 1, 1, 1, 1});
+    EXPECT_NEAR(1, res[0] * res[0] + res[1] * res[1] + res[2] * res[2], 1e-12);
+    EXPECT_NEAR(0, res[0] + res[1] + res[2], 1e-9);
+}
+
+TEST(Normals, Sphere) {
+    // points on unit sphere have radial normals
+    std::vector<PointObj<double, 3, NormalData>> cloud;
+    for (int i = 0; i < 20000; ++i) {
+        VecD3 point = TestData::Get().GenRandVec<3>();
+        double length = 0;
+        for (int d = 0; d < 3; ++d) {
+            point[d] = point[d] * 2 - 1;
+            length += point[d] * point[d];
+        }
+        if (length < 0.01 || length > 1)
+            continue;
+        for (int d = 0; d < 3; ++d)
+            point[d] /= std::sqrt(length);
+        cloud.push_back({point, {}});
+    }
+
+    for (int threadCount : {1, 4}) {
+        EstimateNormals(cloud, 10, [](NormalData& data, const VecD3& normal) { data.normal = normal; }, threadCount);
+        for (const PointObj<double, 3, NormalData>& obj : cloud) {
+            double dot = 0;
+            for (int d = 0; d < 3; ++d)
+                dot += obj.point[d] * obj.data.normal[d];
+            EXPECT_GT(std::abs(dot), 0.98) << "Incorrect normal " << obj.data.normal << " of point " << obj.point;
+        }
+    }
+}
+
+TEST(Normals, TreeNormals) {
+    // points of tree on two planes, each point gets its normal once
+    std::vector<PointObjD<3>> dataset;
+    for (int i = 0; i < 2000; ++i) {
+        VecD3 point = TestData::Get().GenRandVec<3>();
+        point[2] = i % 2 == 0 ? 0 : 5;
+        dataset.push_back(PointObjD<3>({point}));
+    }
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildLazyMidpointSplitTree(10, dataset);
+    std::vector<std::atomic<int>> visits(tree.GetObjCount());
+    EstimateTreeNormals(tree, 8, [&](const PointObjD<3>& obj, const VecD3& normal) {
+        ++visits[&obj - tree.GetObj(0)];
+        EXPECT_NEAR(1, std::abs(normal[2]), 1e-9);
+    }, 4);
+    for (index_t i = 0; i < tree.GetObjCount(); ++i)
+        EXPECT_EQ(1, visits[i]);
+}
+
+TEST(Normals, WithoutExactPoints) {
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(200);
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildMidpointSplitTree(10, dataset);
+    tree.QuantizeLeafPoints(8, false);
+    int visits = 0;
+    EXPECT_FALSE(EstimateTreeNormals(tree, 8, [&](const PointObjD<3>&, const VecD3&) { ++visits; }));
+    EXPECT_EQ(0, visits);
+}
@@ -0,0 +1,20 @@
+
+#include <gtest/gtest.h>
+#include <aknn/parallel.h>
+
+TEST(ParallelFor, VisitsEachIndexOnce) {
+    for (int threadCount : {0, 1, 3, 8}) {
+        for (size_t count : {0, 1, 10, 1000}) {
+            std::vector<std::atomic<int>> visits(count);
+            std::atomic<int> maxThread(0);
+            ParallelFor(count, threadCount, [&](size_t i, int thread) {
+                ++visits[i];
+                int current = maxThread;
+                while (thread > current && !maxThread.compare_exchange_weak(current, thread)) {}
+            }, 7);
+            for (size_t i = 0; i < count; ++i)
+                EXPECT_EQ(1, visits[i]) << "threads " << threadCount << ", count " << count << ", index " << i;
+            EXPECT_LT(maxThread, threadCount <= 0 ? GetDefaultThreadCount() : threadCount);
+        }
+    }
+}
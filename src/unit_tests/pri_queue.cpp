@@ -91,8 +91,19 @@ void TestPriQueue()
     std::vector<int> result = queue.GetValues();
     std::sort(result.begin(), result.end());
     EXPECT_EQ(expected, result);
+    std::vector<int> data(queue.GetData(), queue.GetData() + queue.GetSize());
+    std::sort(data.begin(), data.end());
+    EXPECT_EQ(expected, data);
 }
 
+//! Queue using the default GetData of FixedPriQueue, like queues which don't implement it
+template<typename T>
+class CopyingPriQueue : public HeapPriQueue<T>
+{
+public:
+    const T* GetData() const override { return FixedPriQueue<T>::GetData(); }
+};
+
 TEST(LinearPriQueueInt, basicInts) {
     TestPriQueue<LinearPriQueue<int>>();
 }
@@ -104,3 +115,7 @@ TEST(HeapPriQueueInt, basicInts) {
 TEST(StdPriQueueInt, basicInts) {
     TestPriQueue<StdPriQueue<int>>();
 }
+
+TEST(CopyingPriQueueInt, basicInts) {
+    TestPriQueue<CopyingPriQueue<int>>();
+}
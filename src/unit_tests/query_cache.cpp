@@ -0,0 +1,144 @@
+
+#include <thread>
+#include <gtest/gtest.h>
+#include <aknn/query_cache.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void ExpectSameNeighbors(const std::vector<PointObjD<Dim>>& expected, const std::vector<PointObjD<Dim>>& found)
+{
+    ASSERT_EQ(expected.size(), found.size());
+    for (size_t i = 0; i < expected.size(); ++i)
+        EXPECT_EQ(expected[i].point, found[i].point);
+}
+
+template<int Dim>
+void RandomTestsQueryCacheExact()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(2000);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(6, dataset);
+    HeapPriQueue<DistObj<double, Dim>> queue;
+    QueryCache<double, Dim> cache;
+    std::vector<VecD<Dim>> queryPoints;
+    for (int i = 0; i < 20; ++i)
+        queryPoints.push_back(TestData::Get().GenRandVec<Dim>());
+
+    TraversalStats<double, Dim> stats;
+    for (int round = 0; round < 3; ++round) {
+        for (const VecD<Dim>& queryPoint : queryPoints) {
+            for (int k : {1, 5}) {
+                std::vector<PointObjD<Dim>> expected = FindKAproximateNearestNeighbors(tree, queryPoint, k, 0.0, queue);
+                ExpectSameNeighbors(expected, FindKAproximateNearestNeighborsCached<double, Dim, Empty, true>(tree, cache, queryPoint, k, 0.0, queue, stats));
+                // epsilon is part of the key
+                FindKAproximateNearestNeighborsCached<double, Dim, Empty, true>(tree, cache, queryPoint, k, 0.5, queue, stats);
+            }
+        }
+    }
+    EXPECT_EQ(80, stats.cacheMisses);
+    EXPECT_EQ(160, stats.cacheHits);
+    QueryCacheStats cacheStats = cache.GetStats();
+    EXPECT_EQ(80u, cacheStats.misses);
+    EXPECT_EQ(160u, cacheStats.hits);
+    EXPECT_EQ(80u, cacheStats.entryCount);
+    EXPECT_EQ(0u, cacheStats.evictions);
+
+    // nearby point isn't exact match
+    VecD<Dim> nearbyPoint = queryPoints[0];
+    nearbyPoint[0] += 1e-9;
+    std::vector<PointObjD<Dim>> result;
+    EXPECT_FALSE(cache.Find(nearbyPoint, 5, 0.0, result));
+
+    cache.Clear();
+    EXPECT_EQ(0u, cache.GetStats().entryCount);
+    EXPECT_FALSE(cache.Find(queryPoints[0], 5, 0.0, result));
+}
+
+TEST(RandomTestQueryCache, dim2) {
+    RandomTestsQueryCacheExact<2>();
+}
+TEST(RandomTestQueryCache, dim3) {
+    RandomTestsQueryCacheExact<3>();
+}
+
+TEST(QueryCache, Quantized) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(500);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(4, dataset);
+    HeapPriQueue<DistObj<double, 2>> queue;
+    QueryCache<double, 2> cache(1 << 20, 0.1);
+    std::vector<PointObjD<2>> first = FindKAproximateNearestNeighborsCached(tree, cache, VecD2({0.51, 0.52}), 3, 0.0, queue);
+    ExpectSameNeighbors(FindKNearestNeighbors(tree, VecD2({0.51, 0.52}), 3, queue), first);
+
+    // the same cell shares the result, the neighboring cell doesn't
+    std::vector<PointObjD<2>> result;
+    EXPECT_TRUE(cache.Find(VecD2({0.59, 0.5}), 3, 0.0, result));
+    ExpectSameNeighbors(first, result);
+    EXPECT_FALSE(cache.Find(VecD2({0.61, 0.5}), 3, 0.0, result));
+    EXPECT_FALSE(cache.Find(VecD2({0.49, 0.5}), 3, 0.0, result));
+    EXPECT_FALSE(cache.Find(VecD2({0.51, 0.52}), 4, 0.0, result));
+}
+
+TEST(QueryCache, Eviction) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(500);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(4, dataset);
+    HeapPriQueue<DistObj<double, 2>> queue;
+    const size_t maxBytes = 4096;
+    QueryCache<double, 2> cache(maxBytes, 0, 1);
+    VecD2 hotPoint({0.5, 0.5});
+    std::vector<PointObjD<2>> result;
+    for (int i = 0; i < 200; ++i) {
+        FindKAproximateNearestNeighborsCached(tree, cache, TestData::Get().GenRandVec<2>(), 4, 0.0, queue);
+        FindKAproximateNearestNeighborsCached(tree, cache, hotPoint, 4, 0.0, queue);
+        EXPECT_LE(cache.GetStats().memoryBytes, maxBytes);
+    }
+    QueryCacheStats stats = cache.GetStats();
+    EXPECT_GT(stats.evictions, 0u);
+    EXPECT_GT(stats.entryCount, 1u);
+    // the hot point is referenced between the passes of the clock hand, so it stays cached
+    EXPECT_EQ(199u, stats.hits);
+    EXPECT_TRUE(cache.Find(hotPoint, 4, 0.0, result));
+
+    // results larger than the memory aren't cached
+    QueryCache<double, 2> tinyCache(16, 0, 1);
+    FindKAproximateNearestNeighborsCached(tree, tinyCache, hotPoint, 4, 0.0, queue);
+    EXPECT_FALSE(tinyCache.Find(hotPoint, 4, 0.0, result));
+}
+
+TEST(QueryCache, Concurrent) {
+    std::vector<PointObjD<3>> dataset = TestData::Get().GenRandDataset<3>(2000);
+    BBDTree<double, 3> tree = BBDTree<double, 3>::BuildLazyMidpointSplitTree(6, dataset);
+    std::vector<VecD<3>> queryPoints;
+    for (int i = 0; i < 50; ++i)
+        queryPoints.push_back(TestData::Get().GenRandVec<3>());
+    std::vector<std::vector<PointObjD<3>>> expected;
+    HeapPriQueue<DistObj<double, 3>> queue;
+    for (const VecD<3>& queryPoint : queryPoints)
+        expected.push_back(FindKNearestNeighbors(tree, queryPoint, 6, queue));
+
+    // small cache with heavy repeats, so that the threads hit, miss and evict concurrently
+    QueryCache<double, 3> cache(16 * 1024, 0, 4);
+    const int threadCount = 4;
+    const int queryCount = 2000;
+    std::vector<std::thread> threads;
+    std::vector<int> errors(threadCount, 0);
+    for (int t = 0; t < threadCount; ++t) {
+        threads.emplace_back([&, t]() {
+            HeapPriQueue<DistObj<double, 3>> threadQueue;
+            for (int i = 0; i < queryCount; ++i) {
+                int q = (i * 7 + t * 13) % (int)queryPoints.size();
+                std::vector<PointObjD<3>> found = FindKAproximateNearestNeighborsCached(tree, cache, queryPoints[q], 6, 0.0, threadQueue);
+                for (size_t j = 0; j < found.size(); ++j)
+                    errors[t] += !(found[j].point == expected[q][j].point);
+                errors[t] += found.size() != expected[q].size();
+            }
+        });
+    }
+    for (std::thread& thread : threads)
+        thread.join();
+    for (int t = 0; t < threadCount; ++t)
+        EXPECT_EQ(0, errors[t]);
+    QueryCacheStats stats = cache.GetStats();
+    EXPECT_EQ((uint64_t)threadCount * queryCount, stats.hits + stats.misses);
+    EXPECT_GT(stats.hits, 0u);
+    EXPECT_LE(stats.memoryBytes, 16u * 1024);
+}
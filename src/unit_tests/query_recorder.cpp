@@ -0,0 +1,26 @@
+
+#include <gtest/gtest.h>
+#include <aknn/query_recorder.h>
+
+#include "test_data.h"
+
+TEST(QueryRecorder, Sample) {
+    QueryRecorder<double, 2> recorder(100, 1);
+    for (int i = 0; i < 50; ++i)
+        recorder.Record(VecD<2>({(double)i, 0}));
+    EXPECT_EQ(50u, recorder.GetSample().size());
+
+    // second half of the queries should take about half of the sample
+    for (int i = 50; i < 20000; ++i)
+        recorder.Record(VecD<2>({(double)i, 0}));
+    std::vector<VecD<2>> sample = recorder.GetSample();
+    EXPECT_EQ(100u, sample.size());
+    EXPECT_EQ(20000u, recorder.GetRecordedCount());
+    int secondHalfCount = (int)std::count_if(sample.begin(), sample.end(), [](const VecD<2>& query) { return query[0] >= 10000; });
+    EXPECT_GT(secondHalfCount, 30);
+    EXPECT_LT(secondHalfCount, 70);
+
+    recorder.Clear();
+    EXPECT_EQ(0u, recorder.GetSample().size());
+    EXPECT_EQ(0u, recorder.GetRecordedCount());
+}
@@ -0,0 +1,92 @@
+
+#include <gtest/gtest.h>
+#include <aknn/rknn.h>
+
+#include "test_data.h"
+
+//! Naive squared distances of the point objects of the tree to their k-th nearest neighbors, max value for points with less than k neighbors
+template<int Dim>
+std::vector<double> LinearKNeighborRadii(const BBDTree<double, Dim>& tree, int k)
+{
+    std::vector<double> radii(tree.GetObjCount(), -1);
+    for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+        if (tree.IsDeleted(i))
+            continue;
+        std::vector<double> dists;
+        for (index_t j = 0; j < tree.GetObjCount(); ++j) {
+            if (j != i && !tree.IsDeleted(j))
+                dists.push_back(tree.GetObj(i)->point.DistSquared(tree.GetObj(j)->point));
+        }
+        std::sort(dists.begin(), dists.end());
+        radii[i] = (int)dists.size() < k ? GetMaxValue<double>() : dists[k - 1];
+    }
+    return radii;
+}
+
+template<int Dim>
+void RandomTestsReverseKNearestNeighbors()
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(800);
+    BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(6, dataset);
+    for (index_t i = 0; i < tree.GetObjCount(); i += 7)
+        tree.Remove(i);
+
+    for (int k : {1, 5, 20}) {
+        std::vector<double> radii = LinearKNeighborRadii(tree, k);
+        for (int threadCount : {1, 4}) {
+            ReverseKNearestNeighbors<double, Dim> rknn(tree, k, 0, threadCount);
+            for (index_t i = 0; i < tree.GetObjCount(); ++i)
+                EXPECT_EQ(radii[i] < 0 ? GetLowestValue<double>() : radii[i], rknn.GetRadius(i));
+            for (int q = 0; q < 30; ++q) {
+                VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+                std::vector<index_t> expected;
+                for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                    if (radii[i] >= 0 && queryPoint.DistSquared(tree.GetObj(i)->point) <= radii[i])
+                        expected.push_back(i);
+                }
+                std::vector<index_t> found;
+                // the objects are stored in the tree, so their index is their offset
+                rknn.Search(queryPoint, [&](const PointObjD<Dim>& obj) { found.push_back((index_t)(&obj - tree.GetObj(0))); });
+                std::sort(found.begin(), found.end());
+                EXPECT_EQ(expected, found) << "Incorrect reverse neighbors: k" << k << ", q" << q;
+            }
+        }
+    }
+}
+
+TEST(RandomTestReverseKNearestNeighbors, dim2) {
+    RandomTestsReverseKNearestNeighbors<2>();
+}
+TEST(RandomTestReverseKNearestNeighbors, dim3) {
+    RandomTestsReverseKNearestNeighbors<3>();
+}
+
+TEST(ReverseKNearestNeighbors, AproximateRadii) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(1000);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(8, dataset);
+    ReverseKNearestNeighbors<double, 2> exact(tree, 4);
+    ReverseKNearestNeighbors<double, 2> aproximate(tree, 4, 0.5);
+    // aproximate radii are overestimated at most (1 + epsilon) times, so the aproximate result is superset of the exact one
+    for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+        EXPECT_GE(aproximate.GetRadius(i), exact.GetRadius(i));
+        EXPECT_LE(aproximate.GetRadius(i), exact.GetRadius(i) * 1.5 * (1 + 1e-12));
+    }
+    std::vector<PointObjD<2>> exactResult, aproximateResult;
+    for (int q = 0; q < 50; ++q) {
+        VecD2 queryPoint = TestData::Get().GenRandVec<2>();
+        EXPECT_LE(exact.Find(queryPoint, exactResult), aproximate.Find(queryPoint, aproximateResult));
+    }
+
+    BBDTree<double, 2> emptyTree;
+    ReverseKNearestNeighbors<double, 2> empty(emptyTree, 4);
+    EXPECT_EQ(0, empty.Find(VecD2(0.5), exactResult));
+}
+
+TEST(ReverseKNearestNeighbors, WithoutExactPoints) {
+    std::vector<PointObjD<2>> dataset = TestData::Get().GenRandDataset<2>(200);
+    BBDTree<double, 2> tree = BBDTree<double, 2>::BuildMidpointSplitTree(8, dataset);
+    tree.QuantizeLeafPoints(8, false);
+    ReverseKNearestNeighbors<double, 2> rknn(tree, 4);
+    std::vector<PointObjD<2>> result;
+    EXPECT_EQ(0, rknn.Find(VecD2(0.5), result));
+}
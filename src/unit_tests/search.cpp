@@ -254,3 +254,210 @@ TEST(RandomTestFindAKNN, dim3) {
 TEST(RandomTestFindAKNN, dim4) {
     RandomTestsFindAKNNWithBBDTree<4>();
 }
+
+template<int Dim>
+void RandomTestsFindRangeWithBBDTree()
+{
+    int queryCount = 20;
+    int datasetSize = 1000;
+    std::vector<int> leafSizes = {1, 10, 100};
+    std::vector<double> radii = {0, 0.05, 0.2, 0.5, 2};
+    std::vector<double> epsilons = {0, 0.5, 2};
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(datasetSize);
+
+    for (int leafSize : leafSizes)
+    {
+        BBDTree<double, Dim> tree = BBDTree<double, Dim>::BuildMidpointSplitTree(leafSize, dataset);
+        BBDTree<double, Dim> lazyTree = BBDTree<double, Dim>::BuildLazyMidpointSplitTree(leafSize, dataset);
+        std::vector<PointObjD<Dim>> range;
+        for (int query = 0; query < queryCount; ++query) {
+            VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+            for (double radius : radii) {
+                std::vector<Vec<double, Dim>> expected;
+                for (const PointObjD<Dim>& obj : dataset) {
+                    if (queryPoint.DistSquared(obj.point) <= radius * radius)
+                        expected.push_back(obj.point);
+                }
+                SortByDistanceToPoint(expected, queryPoint);
+
+                FindRange(tree, queryPoint, radius, range);
+                std::vector<Vec<double, Dim>> result = ObjsToVec(range);
+                SortByDistanceToPoint(result, queryPoint);
+                EXPECT_EQ(expected, result) << "Incorrect range: l" << leafSize << ", p" << queryPoint << ", r" << radius;
+
+                FindRange(lazyTree, queryPoint, radius, range);
+                result = ObjsToVec(range);
+                SortByDistanceToPoint(result, queryPoint);
+                EXPECT_EQ(expected, result) << "Incorrect lazy range: l" << leafSize << ", p" << queryPoint << ", r" << radius;
+
+                // aproximate range contains the exact range and nothing farther than (1 + epsilon) * radius
+                for (double epsilon : epsilons) {
+                    size_t count = 0;
+                    size_t exactCount = 0;
+                    SearchAproximateRange(tree, queryPoint, radius, epsilon, [&](const PointObjD<Dim>& obj) {
+                        double dist = queryPoint.DistSquared(obj.point);
+                        EXPECT_LE(dist, ((1 + epsilon) * radius) * ((1 + epsilon) * radius));
+                        exactCount += dist <= radius * radius ? 1 : 0;
+                        ++count;
+                    });
+                    EXPECT_EQ(expected.size(), exactCount);
+                    EXPECT_GE(count, exactCount);
+                }
+
+                // radius bounded knn is prefix of the exact range
+                for (int k : {1, 5, 20}) {
+                    result = ObjsToVec(FindKNearestNeighborsInRadius(tree, queryPoint, k, radius, knnQueue));
+                    SortByDistanceToPoint(result, queryPoint);
+                    std::vector<Vec<double, Dim>> expectedKnn(expected.begin(), expected.begin() + std::min<size_t>(k, expected.size()));
+                    EXPECT_EQ(expectedKnn, result) << "Incorrect knn in radius: l" << leafSize << ", p" << queryPoint << ", r" << radius << ", k" << k;
+                }
+            }
+        }
+    }
+}
+
+TEST(RandomTestFindRange, dim2) {
+    RandomTestsFindRangeWithBBDTree<2>();
+}
+TEST(RandomTestFindRange, dim3) {
+    RandomTestsFindRangeWithBBDTree<3>();
+}
+TEST(RandomTestFindRange, dim4) {
+    RandomTestsFindRangeWithBBDTree<4>();
+}
+
+template<int Dim>
+void RandomTestsCountRangeWithBBDTree()
+{
+    int queryCount = 20;
+    int datasetSize = 1000;
+    std::vector<double> radii = {0, 0.05, 0.2, 0.5, 2};
+    std::vector<double> epsilons = {0, 0.5, 2};
+
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(datasetSize);
+
+    // trees with subtree counts, tree without them and tree with removed points
+    std::vector<BBDTree<double, Dim>> trees;
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(10, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildLazyMidpointSplitTree(10, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildBasicSplitTree(10, dataset));
+    trees.push_back(BBDTree<double, Dim>::BuildMidpointSplitTree(10, dataset));
+    EXPECT_TRUE(trees[0].HasSubtreeCounts());
+    EXPECT_FALSE(trees[2].HasSubtreeCounts());
+    for (index_t i = 0; i < trees[3].GetObjCount(); i += 3)
+        trees[3].Remove(i);
+
+    for (int query = 0; query < queryCount; ++query) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        for (double radius : radii) {
+            for (int t = 0; t < (int)trees.size(); ++t) {
+                const BBDTree<double, Dim>& tree = trees[t];
+                index_t expected = 0;
+                for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                    if (!tree.IsDeleted(i) && queryPoint.DistSquared(tree.GetObj(i)->point) <= radius * radius)
+                        ++expected;
+                }
+                EXPECT_EQ(expected, CountRange(tree, queryPoint, radius)) << "Incorrect count: t" << t << ", p" << queryPoint << ", r" << radius;
+                for (double epsilon : epsilons) {
+                    index_t expectedMax = 0;
+                    for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                        if (!tree.IsDeleted(i) && queryPoint.DistSquared(tree.GetObj(i)->point) <= ((1 + epsilon) * radius) * ((1 + epsilon) * radius))
+                            ++expectedMax;
+                    }
+                    index_t count = CountAproximateRange(tree, queryPoint, radius, epsilon);
+                    EXPECT_GE(count, expected) << "Incorrect count: t" << t << ", p" << queryPoint << ", r" << radius << ", e" << epsilon;
+                    EXPECT_LE(count, expectedMax) << "Incorrect count: t" << t << ", p" << queryPoint << ", r" << radius << ", e" << epsilon;
+                }
+            }
+        }
+    }
+}
+
+TEST(RandomTestCountRange, dim2) {
+    RandomTestsCountRangeWithBBDTree<2>();
+}
+TEST(RandomTestCountRange, dim3) {
+    RandomTestsCountRangeWithBBDTree<3>();
+}
+TEST(RandomTestCountRange, dim4) {
+    RandomTestsCountRangeWithBBDTree<4>();
+}
+
+//! Point data with one of 16 categories
+struct CategoryData
+{
+    int category = 0;
+    uint64_t GetCategoryMask() const { return ((uint64_t)1) << category; }
+};
+
+template<int Dim>
+void RandomTestsFindKNNFilteredWithBBDTree()
+{
+    using PointObjC = PointObj<double, Dim, CategoryData>;
+    int queryCount = 20;
+    int datasetSize = 2000;
+    std::vector<uint64_t> filters = {1, 2 | 4, 1 << 15, ~(uint64_t)0, 1 << 20};
+    HeapPriQueue<DistObj<double, Dim, CategoryData>> knnQueue;
+
+    // category 15 is rare
+    std::vector<PointObjC> dataset;
+    for (int i = 0; i < datasetSize; ++i) {
+        dataset.push_back(PointObjC({TestData::Get().GenRandVec<Dim>(), CategoryData({i % 100 == 0 ? 15 : i % 3})}));
+    }
+    std::vector<BBDTree<double, Dim, CategoryData>> trees;
+    trees.push_back(BBDTree<double, Dim, CategoryData>::BuildMidpointSplitTree(5, dataset));
+    trees.push_back(BBDTree<double, Dim, CategoryData>::BuildLazyMidpointSplitTree(5, dataset));
+    trees.push_back(BBDTree<double, Dim, CategoryData>::BuildMidpointSplitTree(5, dataset));
+    for (index_t i = 0; i < trees[2].GetObjCount(); i += 3)
+        trees[2].Remove(i);
+    trees.push_back(trees[2]);
+    trees[3].QuantizeLeafPoints(8);
+
+    for (int query = 0; query < queryCount; ++query) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        for (int t = 0; t < (int)trees.size(); ++t) {
+            const BBDTree<double, Dim, CategoryData>& tree = trees[t];
+            for (uint64_t filter : filters) {
+                std::vector<PointObjC> filtered;
+                for (index_t i = 0; i < tree.GetObjCount(); ++i) {
+                    if (!tree.IsDeleted(i) && (tree.GetObj(i)->data.GetCategoryMask() & filter) != 0)
+                        filtered.push_back(*tree.GetObj(i));
+                }
+                for (int k : {1, 10}) {
+                    std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim, CategoryData>(filtered, queryPoint, k));
+                    SortByDistanceToPoint(expected, queryPoint);
+                    std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighborsFiltered(tree, queryPoint, k, filter, knnQueue));
+                    SortByDistanceToPoint(result, queryPoint);
+                    EXPECT_EQ(expected, result) << "Incorrect result: t" << t << ", p" << queryPoint << ", f" << filter << ", k" << k;
+
+                    // compare only distances, L1 metric has more equidistant points
+                    std::vector<double> expectedDists;
+                    for (const PointObjC& obj : LinearFindKNearestNeighborsByMetric(filtered, queryPoint, k, L1Metric()))
+                        expectedDists.push_back(queryPoint.Distance(obj.point, L1Metric()));
+                    std::vector<double> resultDists;
+                    for (const PointObjC& obj : FindKNearestNeighborsFiltered(tree, queryPoint, k, filter, knnQueue, L1Metric()))
+                        resultDists.push_back(queryPoint.Distance(obj.point, L1Metric()));
+                    std::sort(expectedDists.begin(), expectedDists.end());
+                    std::sort(resultDists.begin(), resultDists.end());
+                    EXPECT_EQ(expectedDists, resultDists) << "Incorrect L1 result: t" << t << ", p" << queryPoint << ", f" << filter << ", k" << k;
+                }
+            }
+        }
+
+        // rare category skips the subtrees without it
+        TraversalStats<double, Dim> filteredStats;
+        TraversalStats<double, Dim> stats;
+        FindKAproximateNearestNeighborsFiltered<double, Dim, CategoryData, true>(trees[0], queryPoint, 5, 0, 1 << 15, knnQueue, filteredStats);
+        FindKAproximateNearestNeighbors<double, Dim, CategoryData, true>(trees[0], queryPoint, 5 * 100, 0, knnQueue, stats);
+        EXPECT_LT(filteredStats.traversalSteps, stats.traversalSteps);
+    }
+}
+
+TEST(RandomTestFindKNNFiltered, dim2) {
+    RandomTestsFindKNNFilteredWithBBDTree<2>();
+}
+TEST(RandomTestFindKNNFiltered, dim3) {
+    RandomTestsFindKNNFilteredWithBBDTree<3>();
+}
@@ -5,8 +5,12 @@
 #include <memory>
 #include <mutex>
 #include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
 
 #include <aknn/vec.h>
+#include <aknn/bbd_tree.h>
 #include <aknn/search.h>
 
 template<int Dim>
@@ -113,6 +117,16 @@ public:
         return res;
     }
 
+    template<int Dim>
+    std::vector<PointObjD<Dim>> GenRandDataset(int count) const
+    {
+        std::vector<PointObjD<Dim>> dataset;
+        for (int i = 0; i < count; ++i) {
+            dataset.push_back(PointObjD<Dim>({GenRandVec<Dim>()}));
+        }
+        return dataset;
+    }
+
 private:
     std::mt19937 gen;
     mutable std::default_random_engine eng;
@@ -155,4 +169,31 @@ private:
     }
 };
 
+//! Sorted squared distances of the point objects to query point, compares kNN results regardless of order of equidistant neighbors
+template<int Dim>
+std::vector<double> GetSortedDistances(const std::vector<PointObjD<Dim>>& objs, const VecD<Dim>& queryPoint)
+{
+    std::vector<double> dists;
+    for (const PointObjD<Dim>& obj : objs) {
+        dists.push_back(queryPoint.DistSquared(obj.point));
+    }
+    std::sort(dists.begin(), dists.end());
+    return dists;
+}
+
+//! Expects the same kNN result from the tree as from the linear search for random query points
+template<int Dim>
+void ExpectSameKNN(const BBDTree<double, Dim>& tree, const std::vector<PointObjD<Dim>>& dataset, int queryCount, int k)
+{
+    HeapPriQueue<DistObj<double, Dim>> knnQueue;
+    for (int query = 0; query < queryCount; ++query) {
+        VecD<Dim> queryPoint = TestData::Get().GenRandVec<Dim>();
+        std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(dataset, queryPoint, k));
+        std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(tree, queryPoint, k, knnQueue));
+        SortByDistanceToPoint(expected, queryPoint);
+        SortByDistanceToPoint(result, queryPoint);
+        EXPECT_EQ(expected, result) << "Incorrect result: p" << queryPoint << ", k" << k;
+    }
+}
+
 #endif // UNIT_TEST_DATA_H
\ No newline at end of file
@@ -34,4 +34,45 @@ TEST(Box_GetBoundingBox, grid4d10) {
     BoxD4 expected(VecD4(0.0), VecD4(10.0));
     BoxD4 result = BoxD4::GetBoundingBox(TestData::Get().grid4d10);
     EXPECT_EQ(expected, result);
-}
\ No newline at end of file
+}
+
+using VecI2 = Vec<int32_t, 2>;
+using BoxI2 = Box<int32_t, 2>;
+
+TEST(Vec_DistSquared, int32) {
+    // difference of 3e9, its square still fits into int64_t
+    VecI2 p1({-1500000000, 0});
+    VecI2 p2({1500000000, 3});
+    EXPECT_EQ((int64_t)3000000000LL * 3000000000LL + 9, p1.DistSquared(p2));
+}
+
+TEST(Box_Split, int32) {
+    BoxI2 box(VecI2({0, 0}), VecI2({7, 3}));
+    EXPECT_TRUE(box.CanSplit());
+    BoxSplit<int32_t, 2> split = box.Split();
+    EXPECT_EQ(0, split.dim);
+    EXPECT_EQ(3, split.value);
+    EXPECT_EQ(BoxI2(VecI2({0, 0}), VecI2({3, 3})), split.left);
+    EXPECT_EQ(BoxI2(VecI2({3, 0}), VecI2({7, 3})), split.right);
+    EXPECT_FALSE(BoxI2(VecI2({0, 0}), VecI2({1, 1})).CanSplit());
+    EXPECT_EQ(std::numeric_limits<int32_t>::max(), BoxI2().min[0]);
+}
+
+TEST(Box_Split, int32FullRange) {
+    // size 2^32 - 1 doesn't fit into int32_t
+    BoxI2 box(VecI2({std::numeric_limits<int32_t>::min(), 0}), VecI2({std::numeric_limits<int32_t>::max(), 3}));
+    EXPECT_EQ((int64_t)std::numeric_limits<uint32_t>::max(), box.GetSize(0));
+    EXPECT_TRUE(box.CanSplit());
+    BoxSplit<int32_t, 2> split = box.Split();
+    EXPECT_EQ(0, split.dim);
+    EXPECT_EQ(-1, split.value);
+    EXPECT_EQ(BoxI2(VecI2({std::numeric_limits<int32_t>::min(), 0}), VecI2({-1, 3})), split.left);
+    EXPECT_EQ(BoxI2(VecI2({-1, 0}), VecI2({std::numeric_limits<int32_t>::max(), 3})), split.right);
+}
+
+TEST(Box_MaxSquaredDistance, int32) {
+    BoxI2 box(VecI2({0, 0}), VecI2({7, 3}));
+    EXPECT_EQ(0, box.SquaredDistance(VecI2({2, 1})));
+    EXPECT_EQ(5 * 5 + 2 * 2, box.MaxSquaredDistance(VecI2({2, 1})));
+    EXPECT_EQ(10 * 10 + 2 * 2, box.MaxSquaredDistance(VecI2({-3, 2})));
+}
@@ -0,0 +1,68 @@
+
+#include <gtest/gtest.h>
+#include <aknn/versioned_bbd_tree.h>
+#include <aknn/search.h>
+
+#include "test_data.h"
+
+template<int Dim>
+void TestConcurrentRebuild(int readerCount, int rebuildCount)
+{
+    std::vector<PointObjD<Dim>> dataset = TestData::Get().GenRandDataset<Dim>(1000);
+    std::vector<VecD<Dim>> queryPoints;
+    for (int i = 0; i < 100; ++i)
+        queryPoints.push_back(TestData::Get().GenRandVec<Dim>());
+    std::vector<PointObjD<Dim>> newPoints = TestData::Get().GenRandDataset<Dim>(rebuildCount);
+
+    VersionedBBDTree<double, Dim> versionedTree(BBDTree<double, Dim>::BuildMidpointSplitTree(5, dataset));
+    std::atomic<bool> stop{false};
+    std::atomic<int> errorCount{0};
+    std::atomic<int> queryCount{0};
+    std::vector<std::thread> readers;
+    for (int reader = 0; reader < readerCount; ++reader) {
+        readers.emplace_back([&, reader]() {
+            HeapPriQueue<DistObj<double, Dim>> knnQueue;
+            for (int query = 0; !stop || query < 100; ++query) {
+                typename VersionedBBDTree<double, Dim>::Snapshot snapshot = versionedTree.GetSnapshot();
+                std::vector<PointObjD<Dim>> snapshotObjs(snapshot->GetObj(0), snapshot->GetObj(0) + snapshot->GetObjCount());
+                const VecD<Dim>& queryPoint = queryPoints[(query + reader) % queryPoints.size()];
+                std::vector<Vec<double, Dim>> expected = ObjsToVec(LinearFindKNearestNeighbors<double, Dim>(snapshotObjs, queryPoint, 5));
+                std::vector<Vec<double, Dim>> result = ObjsToVec(FindKNearestNeighbors(*snapshot, queryPoint, 5, knnQueue));
+                SortByDistanceToPoint(expected, queryPoint);
+                SortByDistanceToPoint(result, queryPoint);
+                if (expected != result)
+                    ++errorCount;
+                ++queryCount;
+            }
+        });
+    }
+
+    // each rebuild adds one point to the points of the previous tree
+    for (int i = 0; i < rebuildCount; ++i) {
+        PointObjD<Dim> newPoint = newPoints[i];
+        while (!versionedTree.StartRebuild([newPoint](const BBDTree<double, Dim>& tree) {
+            std::vector<PointObjD<Dim>> objs(tree.GetObj(0), tree.GetObj(0) + tree.GetObjCount());
+            objs.push_back(newPoint);
+            return BBDTree<double, Dim>::BuildMidpointSplitTree(5, objs);
+        })) {
+            std::this_thread::yield();
+        }
+        versionedTree.WaitForRebuild();
+    }
+    stop = true;
+    for (std::thread& reader : readers)
+        reader.join();
+
+    EXPECT_EQ(0, errorCount);
+    EXPECT_GE(queryCount, 100 * readerCount);
+    EXPECT_EQ((uint64_t)rebuildCount, versionedTree.GetVersion());
+    EXPECT_EQ((index_t)(dataset.size() + rebuildCount), versionedTree.GetSnapshot()->GetObjCount());
+    EXPECT_FALSE(versionedTree.IsRebuilding());
+}
+
+TEST(VersionedBBDTree_ConcurrentRebuild, dim2) {
+    TestConcurrentRebuild<2>(4, 20);
+}
+TEST(VersionedBBDTree_ConcurrentRebuild, dim3) {
+    TestConcurrentRebuild<3>(4, 20);
+}